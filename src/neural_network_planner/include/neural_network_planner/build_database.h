@@ -12,6 +12,11 @@
 #include <visualization_msgs/Marker.h>
 
 
+#include <neural_network_planner/check_table.h>
+#include <neural_network_planner/scan_archive.h>
+#include <neural_network_planner/scan_downsampler.h>
+#include <neural_network_planner/step_gate.h>
+
 #include <glog/logging.h>
 #include <vector>
 #include <string>
@@ -61,19 +66,42 @@ private:
 	LaserScan state_ranges;
 
 	int set_size, batch_size, state_sequence_size;
+
+	// debug table of the stored steps, flushed every check_flush_period seconds
+	CheckTable check_table;
+	std::string check_table_format;
+	double check_flush_period;
+	ros::WallTimer check_flush_timer;
+
+	// steps queued to the database writer, seconds a step waits at most for its commit
+	int write_queue_size;
+	double commit_period;
 	int db_writestep, timestep, database_counter;
+
+	// split: states_db and labels_db, unified: steps_db of step records, columnar: steps .nnd dataset
+	std::string database_format;
+
+	// goals received so far, stamp of the last scan: stored with every step of a unified database
+	int episode;
+	ros::Time scan_stamp;
+
+	// full resolution scan and pose of every stored step, for refeaturize, written by whole blocks
+	bool scan_archive;
+	ScanArchiveWriter scan_archive_writer;
+	ScanFrame scan_frame;
+	LaserScan::ConstPtr last_scan;
 	
 	double move_angle_distance;
 
 	vector<double> steering_angles;
 	
+	// state ranges of the last scan, downsampled in place: mean, min, median or pN
+	std::string downsampling;
+	ScanDownsampler downsampler;
 	vector<float> range_data;
 
-	std::pair<float, float> current_source;
-	std::pair<float, float> current_target;
-	
-	std::pair<float, float> prev_source;
-	std::pair<float, float> prev_target;
+	// odometry position and goal, when a step is stored
+	StepGate gate;
 	std::pair<float, float> tmp_source;
 
 	float current_orientation;
@@ -81,13 +109,20 @@ private:
 	float current_angular_z;
 	float minimal_step_dist, sampling_rate, pos_update_threshold;
 
-	bool show_lines, command_measured, goal_received;
+	bool show_lines, command_measured;
 
 	ros::Time cmdvel_time;
 
 	ros::NodeHandle db_nh;
 
+	/* show_lines: the rays of the last line_history scans in a ring of fixed size, published
+	 * as one marker line_rate times per second - nothing is computed without subscribers
+	 */
 	visualization_msgs::Marker line_list;	
+	vector<geometry_msgs::Point> ray_ring;
+	int line_history, ray_head, ray_scans;
+	double line_rate;
+	ros::WallTimer line_timer;
 
 	void build_callback(const LaserScan::ConstPtr& laser_msg, 
 					const Odometry::ConstPtr& odom_msg);
@@ -96,7 +131,9 @@ private:
 
 	void updateCmdVel_callback(const geometry_msgs::Twist::ConstPtr& cmdvel_msg);
 
-	float Step_dist();
+	void flush_callback(const ros::WallTimerEvent& event);
+
+	void lines_callback(const ros::WallTimerEvent& event);
 
 };
 
@@ -0,0 +1,28 @@
+#ifndef _BYTE_ORDER_H_
+#define _BYTE_ORDER_H_
+
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief byte order mark of the files read in place, without conversion (.nnw, .nnd, .nns):
+ *        written in native order after the magic, a file of the other byte order reads 0x04030201
+ */
+const uint32_t kByteOrder = 0x01020304;
+
+// false if mark was written by a machine of the other byte order
+inline bool NativeByteOrder(uint32_t mark)
+{
+
+	return mark == kByteOrder;
+
+}
+
+
+} // namespace neural_network_planner
+
+
+#endif
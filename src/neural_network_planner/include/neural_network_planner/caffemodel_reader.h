@@ -0,0 +1,82 @@
+#ifndef _CAFFEMODEL_READER_H_
+#define _CAFFEMODEL_READER_H_
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief minimal description of a trained caffe net, enough to run
+ *        the LSTM, BatchNorm and InnerProduct layers without caffe itself
+ */
+struct BlobDescription
+{
+	std::vector<int> shape;
+	std::vector<float> data;
+
+	// int8 weights instead of data: value = scales[row] * qdata, a scale per shape[0] row
+	std::vector<int8_t> qdata;
+	std::vector<float> scales;
+
+	int count() const;
+	bool quantized() const { return !qdata.empty(); }
+};
+
+struct LayerDescription
+{
+	std::string name, type;
+
+	std::vector<std::string> bottom, top;
+
+	std::vector<BlobDescription> blobs;
+
+	// inner_product_param / recurrent_param, axis and bias_term also scale_param
+	int num_output, axis;
+	bool bias_term, transpose;
+
+	// batch_norm_param, caffe default: global stats in TEST phase only
+	bool has_use_global_stats, use_global_stats;
+	float eps;
+
+	// concat_param
+	int concat_axis;
+
+	// input_param
+	std::vector<std::vector<int> > input_shapes;
+
+	LayerDescription();
+};
+
+struct NetDescription
+{
+	std::string name;
+	std::vector<LayerDescription> layers;
+
+	const LayerDescription* layer_by_name(const std::string& layer_name) const;
+};
+
+
+/*
+ * @brief decodes a binary NetParameter (.caffemodel) straight from the protobuf
+ *        wire format, unknown fields are skipped
+ * @return false if the file can not be read or is malformed
+ */
+bool ReadCaffeModel(const std::string& path, NetDescription* net);
+
+bool ParseCaffeModel(const char* buffer, size_t size, NetDescription* net);
+
+/*
+ * @brief marks the layers the output blob depends on, walking the net backward
+ * @return false if the output does not depend on the data blob
+ */
+bool RequiredLayers(const NetDescription& net, const std::string& output_blob, std::vector<bool>* used);
+
+
+} // namespace neural_network_planner
+
+
+#endif
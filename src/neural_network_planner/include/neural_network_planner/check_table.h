@@ -0,0 +1,65 @@
+#ifndef _CHECK_TABLE_H_
+#define _CHECK_TABLE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class CheckTable
+ * @brief debug table of BuildDatabase, one row per stored step: averaged ranges,
+ *        distance and relative angle of the state, then the labels.
+ *        The file stays open and buffered, rows reach the disk on Flush and Close.
+ *        Formats: "text" as the original check_db tables, "csv" with a header row,
+ *        "binary": "NNC1" magic and uint32 values per row, then per row an int32 step
+ *        and the float values, native byte order
+ */
+class CheckTable
+{
+
+public:
+
+	CheckTable();
+
+	~CheckTable();
+
+	/*
+	 * @param ranges averaged ranges of every state
+	 * @return false if the format is unknown or the file can not be created
+	 */
+	bool Open(const std::string& path, const std::string& format, int ranges);
+
+	void Write(int step, const std::vector<float>& ranges, float distance, float relative_angle,
+		   float linear, float angular);
+
+	void Flush();
+
+	void Close();
+
+	bool is_open() const { return file != NULL; }
+
+private:
+
+	enum Format { TEXT, CSV, BINARY };
+
+	FILE* file;
+	Format format;
+	std::string path;
+
+	// binary row
+	std::vector<float> values;
+
+	CheckTable(const CheckTable&);
+	CheckTable& operator=(const CheckTable&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
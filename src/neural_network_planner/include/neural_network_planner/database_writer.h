@@ -0,0 +1,139 @@
+#ifndef _DATABASE_WRITER_H_
+#define _DATABASE_WRITER_H_
+
+#include <neural_network_planner/spsc_ring.h>
+#include <neural_network_planner/step_dataset.h>
+
+#include "boost/scoped_ptr.hpp"
+#include "caffe/util/db.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <semaphore.h>
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief one recorded step as queued by the collection loop: the state
+ *        and its labels, stored under the same key in both databases,
+ *        or together with the episode and stamp in the unified one
+ */
+struct DatabaseRecord
+{
+	int key, episode;
+	double stamp;
+	std::vector<float> state, label;
+
+	DatabaseRecord() : key(0), episode(0), stamp(0) {}
+};
+
+
+/*
+ * @class DatabaseWriter
+ * @brief databases of BuildDatabase written by a background thread:
+ *        the collection loop only copies a step into a slot of a wait-free ring
+ *        and posts the writer, which sleeps on the semaphore in between.
+ *        The writer owns the databases, serializes the records and commits
+ *        every batch_size records or commit_period seconds.
+ *        Split: states and labels Datums in two databases, unified: a single
+ *        database of step records (step_record.h), columnar: a .nnd dataset (step_dataset.h)
+ */
+class DatabaseWriter
+{
+
+public:
+
+	DatabaseWriter();
+
+	~DatabaseWriter();
+
+	/*
+	 * @param capacity queued records before new ones are dropped
+	 * @param batch_size records of a commit
+	 * @param commit_period seconds a queued record waits at most for its commit
+	 */
+	void Open(const std::string& states_path, const std::string& labels_path, const std::string& backend,
+		  int capacity, int batch_size, double commit_period, int state_size, int label_size);
+
+	// unified steps database: one write per step
+	void Open(const std::string& steps_path, const std::string& backend,
+		  int capacity, int batch_size, double commit_period, int state_size, int label_size);
+
+	// columnar dataset: states flushed with every commit, completed by Close
+	void OpenDataset(const std::string& dataset_path,
+			 int capacity, int batch_size, double commit_period, int state_size, int label_size);
+
+	/*
+	 * @brief collection loop: free record to fill, NULL if the writer is behind - the step is dropped,
+	 *        the writer is woken and reports the drop
+	 */
+	DatabaseRecord* Reserve();
+
+	// collection loop: the filled record is handed to the writer
+	void Commit() {
+		queue->Commit();
+		sem_post(&records_queued);
+	}
+
+	// stops the writer once the queued records are committed, closes the databases
+	void Close();
+
+	unsigned long dropped() const { return dropped_.load(); }
+	unsigned long committed() const { return committed_.load(); }
+
+private:
+
+	void start(int capacity, int batch_size, double commit_period, int state_size, int label_size);
+
+	void writer();
+
+	// writer thread: a queued record, a drop, Close or the commit deadline of the pending records
+	void wait();
+
+	void put(const DatabaseRecord& record);
+
+	void commit();
+
+	boost::shared_ptr<SpscRing<DatabaseRecord> > queue;
+
+	// unified: steps in states_database, no labels_database
+	boost::scoped_ptr<caffe::db::DB> states_database, labels_database;
+	boost::scoped_ptr<caffe::db::Transaction> states_txn, labels_txn;
+
+	// columnar: no database
+	boost::scoped_ptr<StepDatasetWriter> dataset;
+
+	int batch_size;
+	double commit_period;
+
+	boost::thread writer_thread;
+	boost::atomic<bool> stop;
+	boost::atomic<unsigned long> dropped_, committed_;
+
+	// a post per committed or dropped record
+	sem_t records_queued;
+
+	// writer thread: records of the open transactions, queue and commit statistics since the last report
+	int pending;
+	double first_pending;
+	int commits, max_depth;
+	double commit_time, max_commit_time;
+	unsigned long reported_drops;
+
+	DatabaseWriter(const DatabaseWriter&);
+	DatabaseWriter& operator=(const DatabaseWriter&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _ENSEMBLE_ENGINE_H_
+#define _ENSEMBLE_ENGINE_H_
+
+#include <neural_network_planner/caffemodel_reader.h>
+#include <neural_network_planner/lstm_engine.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <string>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class EnsembleEngine
+ * @brief K snapshots of the same net evaluated on the same states, one LSTMEngine
+ *        per member: the members share no computation, an ensemble costs K models.
+ *        Returns the mean of the member outputs and their standard deviation
+ */
+class EnsembleEngine
+{
+
+public:
+
+	EnsembleEngine();
+
+	~EnsembleEngine();
+
+	/*
+	 * @brief loads every member as LSTMEngine::Load, .caffemodel, .nnq or .nnw files
+	 * @return false if a model can not be used or its output size differs from the first one
+	 */
+	bool Load(const std::vector<std::string>& models, int input_size, int max_timesteps,
+		  const std::string& output_blob = "out");
+
+	bool Load(const std::vector<NetDescription>& nets, int input_size, int max_timesteps,
+		  const std::string& output_blob = "out");
+
+	/*
+	 * @brief as LSTMEngine::Forward, every member on the same window
+	 * @return mean output of the members at the last timestep
+	 */
+	const float* Forward(const float* states, const float* clip, int timesteps);
+
+	// as LSTMEngine::Step, mean output of the members
+	const float* Step(const float* state, bool sequence_start);
+
+	// standard deviation of every output over the members, last timestep of the last evaluation
+	const float* Deviation() const { return &deviation[0]; }
+
+	// output of member m at timestep t of the last evaluation
+	const float* Output(int t, int m) const { return engines[m]->Output(t); }
+
+	void ResetState();
+
+	int members() const { return engines.size(); }
+	int input_size() const { return input_size_; }
+	int output_size() const { return output_size_; }
+	int max_timesteps() const { return max_timesteps_; }
+
+private:
+
+	// sizes once every member is loaded, false if their outputs differ
+	bool Loaded(int input_size, int max_timesteps, const std::string& output_blob);
+
+	// mean and deviation over the member outputs of timestep t
+	const float* Aggregate(int t);
+
+	int input_size_, output_size_, max_timesteps_;
+
+	std::vector<boost::shared_ptr<LSTMEngine> > engines;
+
+	std::vector<float> mean, deviation;
+
+	EnsembleEngine(const EnsembleEngine&);
+	EnsembleEngine& operator=(const EnsembleEngine&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
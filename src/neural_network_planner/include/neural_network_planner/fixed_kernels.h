@@ -0,0 +1,176 @@
+#ifndef _FIXED_KERNELS_H_
+#define _FIXED_KERNELS_H_
+
+#include <neural_network_planner/gate_kernels.h>
+#include <neural_network_planner/simd_math.h>
+
+#include <boost/static_assert.hpp>
+
+
+/*
+ * kernels with compile time sizes, instantiated by the dispatcher of fixed_kernels.cpp
+ * for the shipped nets and by the headers compile_model generates
+ */
+
+namespace neural_network_planner {
+
+namespace kernels {
+
+
+/* streams sharing each weight load: 4 gate accumulators per stream,
+ * 2 streams keep accumulators, weights and input in the 16 AVX2 registers
+ */
+const int kStreamRows = 2;
+
+/*
+ * @brief S streams of a LSTM layer with compile time sizes: the products over X and H
+ *        have constant trip counts and are unrolled, the i f o g gates of one vector
+ *        of hidden values are accumulated together so that the unit is applied in registers,
+ *        without writing the gates
+ */
+template<int S, int X, int H>
+inline void FixedLSTMRows(const float* Wt, const float* bias, const float* x, float cont,
+		      const float* h_prev, float* c, float* h)
+{
+
+	using namespace simd;
+
+	const int G = (4 * H + kPadding - 1) / kPadding * kPadding;
+
+	for(int d = 0; d < H; d += kLanes) {
+
+		vfloat acc[S][4];
+
+		for(int gate = 0; gate < 4; gate++) {
+			vfloat b = vload(bias + gate * H + d);
+			for(int s = 0; s < S; s++)
+				acc[s][gate] = b;
+		}
+
+		const float* w_row = Wt + d;
+
+		for(int k = 0; k < X; k++, w_row += G) {
+
+			vfloat w[4];
+			for(int gate = 0; gate < 4; gate++)
+				w[gate] = vload(w_row + gate * H);
+
+			for(int s = 0; s < S; s++) {
+				vfloat z = vbroadcast(x + s * X + k);
+				for(int gate = 0; gate < 4; gate++)
+					acc[s][gate] = vfma(z, w[gate], acc[s][gate]);
+			}
+		}
+
+		// a sequence start has no recurrent contribution
+		if( cont != 0 ) {
+
+			for(int k = 0; k < H; k++, w_row += G) {
+
+				vfloat w[4];
+				for(int gate = 0; gate < 4; gate++)
+					w[gate] = vload(w_row + gate * H);
+
+				for(int s = 0; s < S; s++) {
+					vfloat z = vset(cont * h_prev[s * H + k]);
+					for(int gate = 0; gate < 4; gate++)
+						acc[s][gate] = vfma(z, w[gate], acc[s][gate]);
+				}
+			}
+		}
+
+		for(int s = 0; s < S; s++) {
+
+			vfloat i = vsigmoid(acc[s][0]);
+			vfloat o = vsigmoid(acc[s][2]);
+			vfloat g = vtanh(acc[s][3]);
+
+			vfloat cell = vmul(i, g);
+			if( cont != 0 ) {
+				vfloat f = vmul(vset(cont), vsigmoid(acc[s][1]));
+				cell = vfma(f, vload(c + s * H + d), cell);
+			}
+
+			vstore(c + s * H + d, cell);
+			vstore(h + s * H + d, vmul(o, vtanh(cell)));
+		}
+	}
+
+}
+
+/*
+ * @brief one step of a LSTM layer of N streams, X inputs and H hidden values per stream,
+ *        same arguments and weight layout as the LSTMStepKernel of FixedLSTMStep
+ */
+template<int N, int X, int H>
+void FixedLSTM(const float* Wt, const float* bias, const float* x, float cont,
+		const float* h_prev, float* c, float* h)
+{
+
+	// every gate vector must start on a vector boundary of the stacked weights
+	BOOST_STATIC_ASSERT(H % kPadding == 0);
+
+	const int tail = N % kStreamRows;
+
+	int n = 0;
+	for(; n + kStreamRows <= N; n += kStreamRows)
+		FixedLSTMRows<kStreamRows, X, H>(Wt, bias, x + n * X, cont, h_prev + n * H, c + n * H, h + n * H);
+
+	if( tail )
+		FixedLSTMRows<tail ? tail : 1, X, H>(Wt, bias, x + n * X, cont, h_prev + n * H, c + n * H, h + n * H);
+
+}
+
+
+/*
+ * @brief y = bias + Wt^T z for a single input row, K x M weights laid out as for GemmT:
+ *        even and odd inputs accumulate separately to hide the multiply-add latency
+ */
+template<int K, int M>
+inline void FixedGemv(const float* Wt, const float* bias, const float* z, float* y)
+{
+
+	using namespace simd;
+
+	BOOST_STATIC_ASSERT(M % kPadding == 0);
+
+	const int V = kPadding / kLanes;
+
+	for(int m0 = 0; m0 < M; m0 += kPadding) {
+
+		vfloat even[V], odd[V];
+		for(int v = 0; v < V; v++) {
+			even[v] = vload(bias + m0 + v * kLanes);
+			odd[v] = vzero();
+		}
+
+		const float* w_row = Wt + m0;
+		int k = 0;
+
+		for(; k + 1 < K; k += 2, w_row += 2 * M) {
+			vfloat z0 = vbroadcast(z + k), z1 = vbroadcast(z + k + 1);
+			for(int v = 0; v < V; v++) {
+				even[v] = vfma(z0, vload(w_row + v * kLanes), even[v]);
+				odd[v] = vfma(z1, vload(w_row + M + v * kLanes), odd[v]);
+			}
+		}
+
+		if( k < K ) {
+			vfloat z0 = vbroadcast(z + k);
+			for(int v = 0; v < V; v++)
+				even[v] = vfma(z0, vload(w_row + v * kLanes), even[v]);
+		}
+
+		for(int v = 0; v < V; v++)
+			vstore(y + m0 + v * kLanes, vadd(even[v], odd[v]));
+	}
+
+}
+
+
+} // namespace kernels
+
+} // namespace neural_network_planner
+
+
+#endif
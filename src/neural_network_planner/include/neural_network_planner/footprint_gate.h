@@ -0,0 +1,91 @@
+#ifndef _FOOTPRINT_GATE_H_
+#define _FOOTPRINT_GATE_H_
+
+#include <utility>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief view of a costmap_2d char map: size_x x size_y costs, row major,
+ *        cell (0, 0) at origin, resolution meters per cell
+ */
+struct CostGrid
+{
+	const unsigned char* costs;
+	int size_x, size_y;
+	double origin_x, origin_y, resolution;
+};
+
+
+/*
+ * @class FootprintGate
+ * @brief safety filter of the network commands: the arc of a command is forward
+ *        simulated and the footprint checked against the costmap at every step.
+ *        The footprint is rasterized once per discretized heading into row spans
+ *        of cells, a check is a few wide byte compares per footprint row
+ */
+class FootprintGate
+{
+
+public:
+
+	FootprintGate();
+
+	/*
+	 * @param footprint polygon in the robot frame, meters
+	 * @param resolution costmap resolution the masks are rasterized for
+	 * @param headings discretized headings, one mask each
+	 * @param lethal_cost costs from this value block the footprint
+	 * @param unknown_is_lethal NO_INFORMATION (255) cells block as well
+	 */
+	void Init(const std::vector<std::pair<double, double> >& footprint, double resolution, int headings,
+		  unsigned char lethal_cost, bool unknown_is_lethal);
+
+	/*
+	 * @brief forward simulation of (linear, angular) from the pose, steps of sim_granularity seconds
+	 * @return seconds before the footprint hits a blocked cell, -1 if free within sim_time
+	 */
+	double CollisionTime(const CostGrid& grid, double x, double y, double theta,
+			     double linear, double angular, double sim_time, double sim_granularity) const;
+
+	/*
+	 * @brief footprint at the pose overlaps a blocked cell
+	 */
+	bool Blocked(const CostGrid& grid, double x, double y, double theta) const;
+
+	/*
+	 * @brief the command if its arc is free, else the largest linear velocity fraction
+	 *        (1/2, 1/4, 1/8) with a free arc, else rotation in place if it is free
+	 * @return false if no safe command is left: the command must be rejected
+	 */
+	bool Filter(const CostGrid& grid, double x, double y, double theta, double sim_time, double sim_granularity,
+		    double* linear, double* angular) const;
+
+	bool initialized() const { return !masks.empty(); }
+
+private:
+
+	// cells x0..x1 of row dy, relative to the robot cell
+	struct Span
+	{
+		int dy, x0, x1;
+	};
+
+	int heading(double theta) const;
+
+	std::vector<std::vector<Span> > masks;
+
+	double resolution;
+	unsigned char lethal_cost;
+	bool unknown_is_lethal;
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
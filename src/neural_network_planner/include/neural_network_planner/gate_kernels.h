@@ -0,0 +1,238 @@
+#ifndef _GATE_KERNELS_H_
+#define _GATE_KERNELS_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+namespace kernels {
+
+
+/*
+ * @brief vector width of the selected instruction set, in floats:
+ *        AVX2 + FMA, NEON or plain scalar code, chosen at compile time
+ */
+#if defined(__AVX2__) && defined(__FMA__)
+const int kLanes = 8;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+const int kLanes = 4;
+#else
+const int kLanes = 1;
+#endif
+
+// every weight matrix row and activation buffer is aligned to this boundary
+const int kAlignment = 32;
+
+// matrix widths are padded to a multiple of kPadding, whatever the instruction set
+const int kPadding = 8;
+
+inline int RoundUp(int n) { return (n + kPadding - 1) / kPadding * kPadding; }
+
+const char* InstructionSet();
+
+// false if this CPU lacks the instruction set the engine was built for (NNP_SIMD): no runtime dispatch
+inline bool InstructionSetSupported()
+{
+#if defined(__AVX2__) && defined(__FMA__)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return true;
+#endif
+}
+
+
+/*
+ * @brief aligned storage, allocated once and never resized on the hot path,
+ *        float activations and weights or int8 quantized weights.
+ *        Either owned or a view placed in an Arena
+ */
+template<typename T>
+class AlignedArray
+{
+
+public:
+
+	AlignedArray() : data_(NULL), size_(0), owned_(false) {}
+
+	explicit AlignedArray(size_t size) : data_(NULL), size_(0), owned_(false) { Allocate(size); }
+
+	~AlignedArray() { Release(); }
+
+	// zero filled, previous content is lost
+	void Allocate(size_t size) {
+
+		Release();
+		size_ = size;
+
+		if( size == 0 )
+			return;
+
+		// rounded up so that a full vector can always be loaded from the last element block
+		size_t bytes = RoundUp(size) * sizeof(T);
+		void* memory = NULL;
+		if( posix_memalign(&memory, kAlignment, bytes) != 0 )
+			throw std::bad_alloc();
+
+		data_ = static_cast<T*>(memory);
+		owned_ = true;
+		memset(data_, 0, bytes);
+
+	}
+
+	// size values at data, aligned and readable up to RoundUp(size), owned by the caller
+	void Attach(T* data, size_t size) {
+
+		Release();
+		data_ = data;
+		size_ = size;
+
+	}
+
+	T* data() { return data_; }
+	const T* data() const { return data_; }
+	size_t size() const { return size_; }
+
+	T& operator[](size_t i) { return data_[i]; }
+	const T& operator[](size_t i) const { return data_[i]; }
+
+private:
+
+	void Release() {
+
+		if( owned_ )
+			free(data_);
+		data_ = NULL;
+		size_ = 0;
+		owned_ = false;
+
+	}
+
+	T* data_;
+	size_t size_;
+	bool owned_;
+
+	AlignedArray(const AlignedArray&);
+	AlignedArray& operator=(const AlignedArray&);
+
+};
+
+typedef AlignedArray<float> AlignedBuffer;
+typedef AlignedArray<int8_t> AlignedInt8Buffer;
+
+
+/*
+ * @class Arena
+ * @brief single zero filled block holding every activation, scratch and state buffer
+ *        of an engine: buffers are reserved while the engine is set up and placed
+ *        by Allocate one after the other, each aligned. Nothing is allocated afterwards,
+ *        the hot path touches one contiguous, fixed set of memory
+ */
+class Arena
+{
+
+public:
+
+	Arena() {}
+
+	// buffer is placed in the arena by Allocate, count values
+	void Reserve(AlignedBuffer* buffer, size_t count) { requests.push_back(std::make_pair(buffer, count)); }
+
+	// places every reserved buffer, throws std::bad_alloc as AlignedArray
+	void Allocate() {
+
+		size_t total = 0;
+		for(size_t i = 0; i < requests.size(); i++)
+			total += RoundUp(requests[i].second);
+
+		memory.Allocate(total);
+
+		float* next = memory.data();
+		for(size_t i = 0; i < requests.size(); i++) {
+			requests[i].first->Attach(next, requests[i].second);
+			next += RoundUp(requests[i].second);
+		}
+
+		requests.clear();
+
+	}
+
+	// buffers placed in the arena must no longer be used
+	void Clear() {
+
+		requests.clear();
+		memory.Allocate(0);
+
+	}
+
+	// floats of the block
+	size_t size() const { return memory.size(); }
+
+private:
+
+	AlignedBuffer memory;
+	std::vector<std::pair<AlignedBuffer*, size_t> > requests;
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+};
+
+
+/*
+ * @brief Y[s] = bias + Wt^T Z[s] for every row s < rows
+ * @param Wt transposed weights, K x M row major, M multiple of kPadding and aligned
+ * @param bias M values, NULL for no bias
+ * @param Z rows x K inputs, row stride ldz
+ * @param Y rows x M outputs, row stride ldy, aligned rows
+ *        all gates of a LSTM are one fused M = 4 * hidden product
+ */
+void GemmT(const float* Wt, const float* bias, const float* Z, int ldz,
+	   int rows, int K, int M, float* Y, int ldy);
+
+/*
+ * @brief GemmT on int8 weights quantized per output: Y[s] = bias + scale * (Wq^T Z[s]),
+ *        weights are widened to float in registers, activations stay float
+ * @param Wq K x M quantized weights, as Wt, readable kPadding values past the end
+ * @param scale M values, one per output
+ */
+void GemmT8(const int8_t* Wq, const float* scale, const float* bias, const float* Z, int ldz,
+	    int rows, int K, int M, float* Y, int ldy);
+
+/*
+ * @brief LSTM unit of caffe LSTMUnitLayer on gates [ i f o g ], H values each
+ *        c = cont * f * c_prev + i * g, h = o * tanh(c)
+ *        c_prev and c may alias
+ */
+void LSTMUnit(const float* gates, int H, float cont, const float* c_prev, float* c, float* h);
+
+
+/*
+ * @brief one timestep of a whole LSTM layer, gate product and unit fused:
+ *        N streams of X inputs, H hidden values, weights laid out as for GemmT
+ * @param x N x X inputs, contiguous
+ * @param h_prev N x H hidden states of the previous timestep, must not alias h
+ * @param c N x H cell states, updated in place
+ */
+typedef void (*LSTMStepKernel)(const float* Wt, const float* bias, const float* x, float cont,
+			       const float* h_prev, float* c, float* h);
+
+/*
+ * @brief kernel compiled for these sizes (streams, inputs, hidden), see fixed_kernels.cpp
+ * @return NULL if there is no specialization: use GemmT and LSTMUnit
+ */
+LSTMStepKernel FixedLSTMStep(int N, int X, int H);
+
+
+} // namespace kernels
+
+} // namespace neural_network_planner
+
+
+#endif
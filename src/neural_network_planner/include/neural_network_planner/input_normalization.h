@@ -0,0 +1,60 @@
+#ifndef _INPUT_NORMALIZATION_H_
+#define _INPUT_NORMALIZATION_H_
+
+#include <caffe/caffe.hpp>
+#include "caffe/proto/caffe.pb.h"
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/* input normalization of the trained nets: a BatchNorm layer frozen to the per channel
+ * statistics of the training database, between the data blob and its readers.
+ * Its moving averages hold the statistics and are written with every snapshot,
+ * the inference engine folds it into the first layer when the weights allow it
+ */
+extern const char* const kInputNormLayer;
+
+
+/*
+ * @brief inserts the input_norm layer after the layers producing the data blob
+ *        and moves every reader of data on its output
+ * @return false if the net has no data blob or already normalizes it
+ */
+bool AddInputNormalization(caffe::NetParameter* net_param);
+
+/*
+ * @brief source and backend of the Data, StepData or MappedData (backend "mapped") layer
+ *        producing the data blob of the TRAIN phase
+ * @return false if data is not read from a database
+ */
+bool TrainingDatabase(const caffe::NetParameter& net_param, std::string* source, std::string* backend);
+
+/*
+ * @brief per channel mean and variance of the states of a database, Datum float_data or step records,
+ *        in a single streaming pass (Welford), the first max_samples datums, all if max_samples <= 0.
+ *        Backend "mapped": the statistics of all the states stored in the .nnd header
+ * @return datums read
+ */
+long InputStatistics(const std::string& source, const std::string& backend, int channels, long max_samples,
+		     std::vector<double>* mean, std::vector<double>* variance);
+
+/*
+ * @brief stores the statistics as the moving averages of the input_norm layer of the net
+ * @return false if the net has no input_norm layer of as many channels
+ */
+bool SetInputNormalization(caffe::Net<float>* net, const std::vector<double>& mean, const std::vector<double>& variance);
+
+/*
+ * @brief input_norm holds statistics: false for a layer never set, moving averages all zero
+ */
+bool HasInputNormalization(caffe::Net<float>* net);
+
+
+} // namespace neural_network_planner
+
+
+#endif
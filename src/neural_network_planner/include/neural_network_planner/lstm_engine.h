@@ -0,0 +1,151 @@
+#ifndef _LSTM_ENGINE_H_
+#define _LSTM_ENGINE_H_
+
+#include <neural_network_planner/caffemodel_reader.h>
+#include <neural_network_planner/gate_kernels.h>
+#include <neural_network_planner/mapped_model.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <string>
+#include <map>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief activations of one blob for a window of timesteps: timestep t holds
+ *        channels x inner values at data + t * step, step padded for the kernels
+ *        (caffe axis 0 is time, axis 1 channels - streams for recurrent layers)
+ */
+struct EngineBlob
+{
+	int channels, inner, step;
+	kernels::AlignedBuffer data;
+
+	EngineBlob() : channels(0), inner(1), step(0) {}
+
+	int count() const { return channels * inner; }
+	float* at(int t) { return data.data() + t * step; }
+	const float* at(int t) const { return data.data() + t * step; }
+};
+
+
+class EngineLayer
+{
+
+public:
+
+	virtual ~EngineLayer() {}
+
+	// output shapes for windows up to max_timesteps, activation and state buffers reserved in the arena
+	virtual bool Setup(int max_timesteps, kernels::Arena* arena) = 0;
+
+	virtual void Forward(const float* clip, int timesteps) = 0;
+
+	virtual void ResetState() {}
+
+	// weights in the kernel layout, as written to .nnw files
+	virtual void Tensors(std::vector<MappedTensor>* tensors) const {}
+
+	std::string name;
+
+};
+
+
+/*
+ * @class LSTMEngine
+ * @brief caffe free evaluation of the trained LSTM nets:
+ *        reads LSTM, BatchNorm and InnerProduct weights from the .caffemodel,
+ *        the int8 .nnq written by quantize_model or maps a .nnw of convert_model,
+ *        evaluates only the layers the output blob depends on,
+ *        every buffer is allocated by Load - activations and states in one arena -
+ *        Forward never allocates
+ */
+class LSTMEngine
+{
+
+public:
+
+	LSTMEngine();
+
+	~LSTMEngine();
+
+	/*
+	 * @brief builds the engine for the output blob of a trained model
+	 * @param input_size state values per timestep fed to the "data" blob
+	 * @param max_timesteps longest window Forward will be called with
+	 * @return false if the model can not be read or uses unsupported layers
+	 */
+	bool Load(const std::string& caffemodel, int input_size, int max_timesteps,
+		  const std::string& output_blob = "out");
+
+	bool Load(const NetDescription& net, int input_size, int max_timesteps,
+		  const std::string& output_blob = "out");
+
+	/*
+	 * @brief evaluates a window of states, timesteps x input_size values,
+	 *        clip holds one value per timestep: 0 starts a new sequence.
+	 *        Like caffe recurrent layers, hidden states are carried between calls
+	 * @return output of the last timestep
+	 */
+	const float* Forward(const float* states, const float* clip, int timesteps);
+
+	/*
+	 * @brief stateful inference: advances every recurrent layer by exactly one timestep,
+	 *        hidden and cell states stay resident between calls
+	 * @param sequence_start true clears the states, like a 0 clip
+	 * @return output for this timestep
+	 */
+	const float* Step(const float* state, bool sequence_start);
+
+	// output of timestep t of the last Forward
+	const float* Output(int t) const;
+
+	// any evaluated blob of the last Forward, NULL if the net has no such blob
+	const EngineBlob* blob(const std::string& blob_name) const;
+
+	// clears hidden and cell states of every recurrent layer
+	void ResetState();
+
+	// weights of the evaluated layers, in the layout of the kernels
+	void Tensors(std::vector<MappedTensor>* tensors) const;
+
+	const std::string& name() const { return net_name; }
+	int input_size() const { return input_size_; }
+	int output_size() const { return output_size_; }
+	int max_timesteps() const { return max_timesteps_; }
+	int num_layers() const { return layers.size(); }
+
+private:
+
+	bool Load(const NetDescription& net, int input_size, int max_timesteps,
+		  const std::string& output_blob, boost::shared_ptr<MappedModel> model);
+
+	std::string net_name;
+
+	int input_size_, output_size_, max_timesteps_;
+
+	// activations and recurrent states of every layer, sized by Load
+	kernels::Arena arena;
+
+	std::map<std::string, boost::shared_ptr<EngineBlob> > blobs;
+	std::vector<boost::shared_ptr<EngineLayer> > layers;
+
+	boost::shared_ptr<EngineBlob> input, output;
+
+	// weights used in place by the layers, mapped as long as the engine lives
+	boost::shared_ptr<MappedModel> mapped;
+
+	LSTMEngine(const LSTMEngine&);
+	LSTMEngine& operator=(const LSTMEngine&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef _LSTM_PLANNER_ROS_H_
+#define _LSTM_PLANNER_ROS_H_
+
+// ROS related
+#include <ros/ros.h>
+#include <nav_core/base_local_planner.h>
+#include <costmap_2d/costmap_2d_ros.h>
+#include <tf/transform_listener.h>
+#include <sensor_msgs/LaserScan.h>
+#include <nav_msgs/Odometry.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/Twist.h>
+#include <std_srvs/Trigger.h>
+#include <pluginlib/class_loader.h>
+
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/ensemble_engine.h>
+#include <neural_network_planner/spsc_ring.h>
+#include <neural_network_planner/malloc_guard.h>
+#include <neural_network_planner/shadow_logger.h>
+#include <neural_network_planner/footprint_gate.h>
+#include <neural_network_planner/scan_downsampler.h>
+
+// caffe related, only to compare the engine against caffe forward
+#ifdef PLANNER_CAFFE_BACKEND
+#include <caffe/caffe.hpp>
+#endif
+
+// general
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <ctime>
+#include <semaphore.h>
+#include <vector>
+#include <string>
+
+
+namespace neural_network_planner {
+
+
+// header generated by compile_model at build time, see PLANNER_COMPILED_MODEL
+namespace compiled { class CompiledModel; }
+
+
+/*
+ * @class LSTMPlannerROS
+ * @brief local planner plugin driving the robot with the trained LSTM:
+ *        every scan builds the same state of BuildDatabase, queued to the inference
+ *        thread running the network on the freshest one - spinner threads never wait
+ *        for the network - computeVelocityCommands only hands out the latest network command.
+ *        The native engine can be replaced while driving: a new network is loaded
+ *        in background and swapped in between two scans.
+ *        An ensemble of snapshots measures its own disagreement: when the members
+ *        disagree the fallback planner drives instead of the network
+ */
+class LSTMPlannerROS : public nav_core::BaseLocalPlanner
+{
+
+public:
+
+	LSTMPlannerROS();
+
+	~LSTMPlannerROS();
+
+	/*
+	 * @brief loads the network and subscribes to scan and odometry topics
+	 * @param name The name of this planner
+	 * @param tf A pointer to a transform listener
+	 * @param costmap_ros The cost map used by the controller
+	 */
+	void initialize(std::string name, tf::TransformListener* tf, costmap_2d::Costmap2DROS* costmap_ros);
+
+	/*
+	 * @brief latest network command, within the hard latency budget
+	 * @return false if no fresh command is available
+	 */
+	bool computeVelocityCommands(geometry_msgs::Twist& cmd_vel);
+
+	bool isGoalReached();
+
+	/*
+	 * @brief the network only needs the plan target, transformed in odometry frame
+	 */
+	bool setPlan(const std::vector<geometry_msgs::PoseStamped>& plan);
+
+	// states skipped by the inference thread for a fresher one, or not queued because the queue was full
+	unsigned long droppedScans() const { return dropped_scans.load(); }
+
+private:
+
+	// a featurized scan waiting for the network
+	struct QueuedState
+	{
+		std::vector<float> state;
+		bool sequence_start;
+		// shadow mode: nearest obstacle of every averaged block
+		std::vector<float> obstacles;
+		float sector_start, sector_width;
+	};
+
+	ros::NodeHandle private_nh;
+
+	tf::TransformListener* tf_;
+	costmap_2d::Costmap2DROS* costmap_ros_;
+
+	ros::Subscriber scan_sub_;
+	ros::Subscriber odom_sub_;
+	ros::ServiceServer reload_srv_;
+
+	// native engine in use, owned by the inference thread
+	LSTMEngine* engine;
+
+	/* hot swap: the loader thread builds an engine from trained_weights on reload_model
+	 * or from the newest model of model_directory, the inference thread takes it before
+	 * an inference and hands the previous one back for deletion - atomic exchanges, no lock
+	 */
+	boost::atomic<LSTMEngine*> pending_engine, retired_engine;
+
+	boost::thread loader_thread;
+	boost::mutex loader_mutex;
+	boost::condition_variable loader_condition;
+	bool loader_stop;
+
+	std::string requested_model, model_directory;
+	std::time_t loaded_model_time;
+	double model_poll_period;
+
+	// network built into the planner, no file read at startup
+	boost::shared_ptr<compiled::CompiledModel> compiled_net;
+
+	// snapshots of the same net, evaluated together on every scan
+	boost::shared_ptr<EnsembleEngine> ensemble;
+	std::vector<std::string> ensemble_weights;
+	double max_disagreement;
+
+	// classic planner driving in shadow mode or when the ensemble is not confident, destroyed before its class loader
+	pluginlib::ClassLoader<nav_core::BaseLocalPlanner> fallback_loader;
+	boost::shared_ptr<nav_core::BaseLocalPlanner> fallback;
+	std::string fallback_planner;
+
+	/* shadow mode: the classic planner drives, every control cycle logs both commands
+	 * and the obstacles of the network scan - the inference thread keeps them in scan_obstacles,
+	 * handed to the control thread with the network command in shadow_obstacles
+	 */
+	bool shadow_mode;
+	std::string shadow_log_path;
+	double robot_radius, ttc_horizon;
+	ShadowLogger shadow_log;
+	std::vector<float> scan_obstacles, shadow_obstacles;
+	float scan_sector_start, scan_sector_width, sector_start, sector_width;
+
+	/* footprint gate: a network command whose arc brings the footprint on a lethal
+	 * costmap cell within gate_sim_time is slowed down, turned in place or rejected
+	 */
+	bool footprint_gate;
+	FootprintGate gate;
+	double gate_sim_time, gate_sim_granularity;
+	int gated_commands, rejected_commands;
+
+#ifdef PLANNER_CAFFE_BACKEND
+	boost::shared_ptr<caffe::Net<float> > net;
+
+	boost::shared_ptr<caffe::Blob<float> > blobData;
+	boost::shared_ptr<caffe::Blob<float> > blobClip;
+	boost::shared_ptr<caffe::Blob<float> > blobOut;
+#endif
+
+	std::string inference_engine, net_model, trained_weights;
+	std::string scan_topic, odom_topic, odom_frame;
+
+	int averaged_ranges_size, state_sequence_size, time_sequence;
+
+	// state ranges of the scan callback, as downsampled for the training databases,
+	// and the nearest obstacle of every block for the shadow log
+	std::string downsampling;
+	ScanDownsampler downsampler, obstacle_sampler;
+
+	// stateful: recurrent states carried between scans, one timestep evaluated per scan
+	bool stateful, new_sequence;
+	int evaluated_timesteps, sequence_length, sequence_step;
+	double goal_update_threshold;
+
+	// network input buffers of the inference thread, sized at initialize
+	kernels::Arena arena;
+
+	// ring of the last time_sequence states fed to the network
+	kernels::AlignedBuffer window;
+	int window_head, window_fill;
+
+	// window in time order and its clip, as fed to the network - current state only if stateful
+	kernels::AlignedBuffer sequence, sequence_clip;
+
+	// debug: after allocation_warmup inferences, any heap allocation of an inference is fatal
+	MallocGuard malloc_guard;
+	bool check_allocations;
+	int allocation_warmup, inferences;
+
+	/* scan callbacks featurize and queue, the inference thread - pinned to inference_cpu,
+	 * real time if inference_priority > 0 - takes the freshest state and drops the older ones
+	 */
+	boost::shared_ptr<SpscRing<QueuedState> > scan_queue;
+	sem_t scans_queued;
+	boost::thread inference_thread;
+	boost::atomic<bool> inference_stop;
+	boost::atomic<unsigned long> dropped_scans;
+	int scan_queue_size, inference_cpu, inference_priority;
+
+	std::pair<float, float> current_source;
+	std::pair<float, float> current_target;
+	float current_orientation;
+
+	double max_vel_x, max_rot_vel, xy_goal_tolerance;
+	double max_inference_time, command_timeout;
+
+	geometry_msgs::Twist net_cmd;
+	ros::Time net_cmd_time;
+
+	bool initialized, goal_received, odom_received;
+	int overruns;
+
+	// ensemble: members agreed on the latest command
+	bool net_confident;
+	int uncertain_commands;
+
+	boost::mutex state_mutex;
+
+	void scan_callback(const sensor_msgs::LaserScan::ConstPtr& laser_msg);
+
+	void odom_callback(const nav_msgs::Odometry::ConstPtr& odom_msg);
+
+	// queues the classic and the latest network command to the shadow log, never waits
+	void log_shadow(const geometry_msgs::Twist& classic_cmd, bool classic_valid);
+
+	// footprint gate of the network command against the local costmap, false if it is rejected
+	bool gate_command(geometry_msgs::Twist* cmd);
+
+	void inference_loop();
+
+	// the freshest queued state into the network input, false if the queue is empty
+	bool take_state();
+
+	void Forward();
+
+	// engine for the planner state and output, NULL if the model can not be used
+	LSTMEngine* load_engine(const std::string& path);
+
+	void model_loader();
+
+	// model of model_directory newer than the running one and no longer written, empty if none
+	std::string newest_model(std::time_t* model_time);
+
+	// loads the trained_weights parameter again, in background
+	bool reload_callback(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _MALLOC_GUARD_H_
+#define _MALLOC_GUARD_H_
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class MallocGuard
+ * @brief counts the heap allocations made by the calling thread between Arm and Disarm.
+ *        A debug tool: malloc and its siblings are wrapped by libnn_malloc_guard.so,
+ *        preloaded in the process (LD_PRELOAD) - without it available() is false
+ *        and nothing is counted
+ */
+class MallocGuard
+{
+
+public:
+
+	MallocGuard();
+
+	bool available() const { return arm != 0; }
+
+	void Arm();
+
+	// allocations of this thread since Arm
+	unsigned long Disarm();
+
+private:
+
+	void (*arm)(int);
+	unsigned long (*allocations)();
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
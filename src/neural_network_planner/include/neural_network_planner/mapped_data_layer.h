@@ -0,0 +1,70 @@
+#ifndef _MAPPED_DATA_LAYER_H_
+#define _MAPPED_DATA_LAYER_H_
+
+#include <neural_network_planner/step_dataset.h>
+
+#include <caffe/caffe.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class MappedDataLayer
+ * @brief caffe layer "MappedData" reading a .nnd dataset of BuildDatabase (step_dataset.h):
+ *        batch_size consecutive steps are copied from the state and label columns of the
+ *        mapping to the data and labels tops (data_param source and batch_size).
+ *        The optional clip top, batch_size x state values, is 0 on the first step of an
+ *        episode and 1 otherwise. The dataset is read in a loop
+ */
+template <typename Dtype>
+class MappedDataLayer : public caffe::Layer<Dtype>
+{
+
+public:
+
+	explicit MappedDataLayer(const caffe::LayerParameter& param)
+		: caffe::Layer<Dtype>(param), batch_size(0), position(0) {}
+
+	virtual void LayerSetUp(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top);
+
+	virtual void Reshape(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top) {}
+
+	virtual inline const char* type() const { return "MappedData"; }
+	virtual inline int ExactNumBottomBlobs() const { return 0; }
+	virtual inline int MinTopBlobs() const { return 2; }
+	virtual inline int MaxTopBlobs() const { return 3; }
+
+protected:
+
+	virtual void Forward_cpu(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top);
+
+	virtual void Backward_cpu(const std::vector<caffe::Blob<Dtype>*>& top, const std::vector<bool>& propagate_down,
+				  const std::vector<caffe::Blob<Dtype>*>& bottom) {}
+
+private:
+
+	boost::shared_ptr<StepDataset> dataset;
+
+	int batch_size;
+
+	// next step to read
+	uint64_t position;
+
+};
+
+
+/*
+ * @brief makes the MappedData layer type known to caffe, before the nets using it are created
+ */
+void RegisterMappedDataLayer();
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _MAPPED_MODEL_H_
+#define _MAPPED_MODEL_H_
+
+#include <neural_network_planner/caffemodel_reader.h>
+
+#include <map>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+enum TensorType { TENSOR_FLOAT32 = 0, TENSOR_INT8 = 1 };
+
+/*
+ * @brief weights of an engine layer as the kernels use them (transposed, stacked, padded),
+ *        named "<layer>/<tensor>": count values of the dtype at data
+ */
+struct MappedTensor
+{
+	std::string name;
+	int dtype;
+	const void* data;
+	size_t count;
+
+	MappedTensor() : dtype(TENSOR_FLOAT32), data(NULL), count(0) {}
+	MappedTensor(const std::string& n, int t, const void* d, size_t c) : name(n), dtype(t), data(d), count(c) {}
+};
+
+
+/*
+ * @brief .nnw files: flat, versioned weights of LSTMEngine, memory mapped and used in place.
+ *        A header (magic, byte order, version, alignment), the layer descriptions without
+ *        their weights and a tensor table are followed by the tensors, each aligned
+ *        to kMappedAlignment, so that kernels load them straight from the mapping
+ */
+class MappedModel
+{
+
+public:
+
+	MappedModel();
+
+	~MappedModel();
+
+	/*
+	 * @brief maps the file read only and reads the layer descriptions, blobs have
+	 *        their shapes but no data: the weights are the tensors of the mapping
+	 * @return false if the file can not be mapped, is malformed or of another version
+	 */
+	bool Open(const std::string& path, NetDescription* net);
+
+	// tensor of the expected type and size, NULL otherwise
+	const float* Floats(const std::string& name, size_t count) const;
+	const int8_t* Int8(const std::string& name, size_t count) const;
+
+	bool has(const std::string& name) const { return tensors.count(name) != 0; }
+	size_t size() const { return size_; }
+
+private:
+
+	const MappedTensor* find(const std::string& name, int dtype, size_t count) const;
+
+	void* mapping;
+	size_t size_;
+
+	std::map<std::string, MappedTensor> tensors;
+
+	MappedModel(const MappedModel&);
+	MappedModel& operator=(const MappedModel&);
+
+};
+
+
+// tensors start on this boundary, from the page aligned start of the mapping
+const int kMappedAlignment = 64;
+
+/*
+ * @brief writes the layer descriptions and the engine tensors,
+ *        to a temporary file renamed over path: a model mapped by a running
+ *        engine is never modified in place
+ */
+bool WriteMappedModel(const std::string& path, const NetDescription& net, const std::vector<MappedTensor>& tensors);
+
+bool IsMappedModel(const std::string& path);
+
+
+} // namespace neural_network_planner
+
+
+#endif
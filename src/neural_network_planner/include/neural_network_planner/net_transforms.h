@@ -0,0 +1,39 @@
+#ifndef _NET_TRANSFORMS_H_
+#define _NET_TRANSFORMS_H_
+
+#include <neural_network_planner/caffemodel_reader.h>
+
+#include <vector>
+#include <string>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief per channel affine transform of an inference BatchNorm from its stored
+ *        moving averages: y = scale * x + shift
+ */
+void BatchNormAffine(const LayerDescription& batch_norm, std::vector<float>* scale, std::vector<float>* shift);
+
+/*
+ * @brief keeps only the layers the output blob depends on
+ * @return false if the output does not depend on the data blob
+ */
+bool PruneNet(NetDescription* net, const std::string& output_blob);
+
+/*
+ * @brief folds every BatchNorm, and the Scale following it, into the layers reading its output:
+ *        InnerProduct columns of channel c are scaled and the shift moves into the bias.
+ *        LSTM input weights are shared by all the streams (channels), so a BatchNorm
+ *        feeding a LSTM folds only if its transform is the same on every stream.
+ *        BatchNorm layers left in place are frozen to their moving averages
+ * @return number of folded BatchNorm layers
+ */
+int FoldBatchNorm(NetDescription* net);
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _QUANTIZED_MODEL_H_
+#define _QUANTIZED_MODEL_H_
+
+#include <neural_network_planner/caffemodel_reader.h>
+
+#include <vector>
+#include <string>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief second moments E[z z^T] of the inputs of a layer over calibration data:
+ *        the expected output error of a weight row quantized with error d is d^T E[z z^T] d
+ */
+class InputMoments
+{
+
+public:
+
+	InputMoments() : K(0), samples(0) {}
+
+	explicit InputMoments(int input_size) : K(input_size), samples(0), sum(input_size * input_size, 0) {}
+
+	void Add(const float* z);
+
+	int size() const { return K; }
+	long count() const { return samples; }
+
+	// expected output error of a row quantization error d
+	double Error(const std::vector<double>& d) const;
+
+private:
+
+	int K;
+	long samples;
+	std::vector<double> sum;
+
+};
+
+
+/*
+ * @brief symmetric int8 scale of every row of W (rows x K): the row maximum is clipped
+ *        to the fraction minimizing the calibration error, plain maximum without moments
+ */
+void ChooseScales(const std::vector<float>& W, int rows, int K, const InputMoments* moments,
+		  std::vector<float>* scales);
+
+/*
+ * @brief replaces the weights of a LSTM or InnerProduct layer with int8 values,
+ *        a scale per output. LSTM W_xc and W_hc rows feed the same fused gate product
+ *        and share the scale, moments are over the stacked [ x ; h_prev ] input
+ * @return false if the layer has no weights to quantize
+ */
+bool QuantizeLayer(LayerDescription* layer, const InputMoments* moments);
+
+
+/*
+ * @brief .nnq files: a NetDescription with quantized weights, native byte order,
+ *        read by LSTMEngine::Load as a .caffemodel
+ */
+bool WriteQuantizedModel(const std::string& path, const NetDescription& net);
+
+bool ReadQuantizedModel(const std::string& path, NetDescription* net);
+
+bool IsQuantizedModel(const std::string& path);
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef _SCAN_ARCHIVE_H_
+#define _SCAN_ARCHIVE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief a stored step of BuildDatabase before its features: the full resolution
+ *        scan, the pose and target the state is computed from and the labels
+ */
+struct ScanFrame
+{
+	int step, episode;
+	double stamp;
+
+	float angle_min, angle_max, range_min, range_max;
+
+	// pose of the step, orientation is the raw odometry quaternion z as in the databases
+	float x, y, orientation;
+	float target_x, target_y;
+	float linear_x, angular_z;
+
+	std::vector<float> ranges;
+
+	ScanFrame() : step(0), episode(0), stamp(0), angle_min(0), angle_max(0), range_min(0), range_max(0),
+		      x(0), y(0), orientation(0), target_x(0), target_y(0), linear_x(0), angular_z(0) {}
+};
+
+
+/*
+ * @brief .nns scan archives: a header ("NNA1" magic, byte order, version) and blocks of frames,
+ *        each block compressed on its own (snappy) so that readers decode them in parallel.
+ *        Ranges are stored in millimeters on 16 bits, as zigzag deltas of the previous range:
+ *        neighbouring ranges differ little and the deltas compress well. Ranges not finite
+ *        or beyond 65.534 m are kept as NaN and +inf
+ */
+class ScanArchiveWriter
+{
+
+public:
+
+	ScanArchiveWriter();
+
+	~ScanArchiveWriter();
+
+	// block_frames: frames compressed together
+	bool Open(const std::string& path, int block_frames = 64);
+
+	bool Append(const ScanFrame& frame);
+
+	// the frames appended so far reach the file, as a block of their own
+	bool Flush();
+
+	void Close();
+
+	bool is_open() const { return file != NULL; }
+	unsigned long frames() const { return frames_; }
+
+	// bytes of the encoded and of the compressed frames
+	unsigned long raw_bytes() const { return raw_bytes_; }
+	unsigned long compressed_bytes() const { return compressed_bytes_; }
+
+private:
+
+	bool write_block();
+
+	FILE* file;
+	int block_frames, pending;
+	std::string block, compressed;
+
+	unsigned long frames_, raw_bytes_, compressed_bytes_;
+
+	ScanArchiveWriter(const ScanArchiveWriter&);
+	ScanArchiveWriter& operator=(const ScanArchiveWriter&);
+
+};
+
+
+class ScanArchiveReader
+{
+
+public:
+
+	/*
+	 * @brief reads the archive and indexes its blocks
+	 * @return false if the file can not be read, is malformed or of another version
+	 */
+	bool Open(const std::string& path);
+
+	int blocks() const { return offsets.size(); }
+
+	// decodes a block, may be called from several threads
+	bool ReadBlock(int block, std::vector<ScanFrame>* frames) const;
+
+private:
+
+	std::string data;
+	std::vector<size_t> offsets;
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
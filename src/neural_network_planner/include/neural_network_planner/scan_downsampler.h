@@ -0,0 +1,71 @@
+#ifndef _SCAN_DOWNSAMPLER_H_
+#define _SCAN_DOWNSAMPLER_H_
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class ScanDownsampler
+ * @brief state ranges of a laser scan, the same code in BuildDatabase, the offline tools and the
+ *        LSTM planner. The scan is cut in output_size blocks of ranges.size() / output_size
+ *        neighbouring ranges, trailing ranges not filling a whole block are ignored, and every
+ *        block gives one value: the mean of its ranges, their minimum (nearest obstacle) or a
+ *        percentile of them.
+ *        Ranges below range_min, -inf and NaN are no measurement and are left out of their block,
+ *        ranges beyond range_max and +inf mean nothing within range_max and count as range_max.
+ *        A block without any measurement is range_max.
+ *        Mean and minimum run on the vectors of simd_math.h, the percentile selects in a scratch
+ *        buffer kept from scan to scan: no allocation once the largest block was seen
+ */
+class ScanDownsampler
+{
+
+public:
+
+	enum Mode { MEAN, MIN, PERCENTILE };
+
+	ScanDownsampler();
+
+	/*
+	 * @brief mode: mean, min, median or pN for the N-th percentile (p10, p90 ...)
+	 * @return false if the mode is unknown, output_size is not positive or this CPU lacks the
+	 *         instruction set of the build (NNP_SIMD)
+	 */
+	bool Init(int output_size, const std::string& mode = "mean");
+
+	/*
+	 * @brief the blocks of the scan into output[0, output_size)
+	 * @return false if the scan has less ranges than output_size, output is left untouched
+	 */
+	bool Downsample(const float* ranges, int count, float range_min, float range_max, float* output);
+
+	bool Downsample(const std::vector<float>& ranges, float range_min, float range_max, float* output) {
+		return Downsample(ranges.empty() ? NULL : &ranges[0], ranges.size(), range_min, range_max, output);
+	}
+
+	int output_size() const { return output_size_; }
+	Mode mode() const { return mode_; }
+	const std::string& name() const { return name_; }
+
+private:
+
+	float percentile_of(const float* block, int size, float range_min, float range_max);
+
+	int output_size_;
+	Mode mode_;
+	float percentile;
+	std::string name_;
+
+	std::vector<float> scratch;
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
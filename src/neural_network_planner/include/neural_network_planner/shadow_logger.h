@@ -0,0 +1,135 @@
+#ifndef _SHADOW_LOGGER_H_
+#define _SHADOW_LOGGER_H_
+
+#include <neural_network_planner/spsc_ring.h>
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <semaphore.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief one control cycle in shadow mode, as queued by the control thread:
+ *        the commands of both controllers and the nearest obstacle of every scan sector
+ */
+struct ShadowSample
+{
+	double stamp;
+	float classic_linear, classic_angular;
+	float net_linear, net_angular;
+	// seconds since the network command was computed
+	float net_age;
+	bool classic_valid;
+	// sector k covers the scan angles from sector_start + k * sector_width, one sector_width wide
+	float sector_start, sector_width;
+	std::vector<float> obstacles;
+
+	ShadowSample() : stamp(0), classic_linear(0), classic_angular(0), net_linear(0), net_angular(0),
+			 net_age(0), classic_valid(false), sector_start(0), sector_width(0) {}
+};
+
+/*
+ * @brief record of the shadow log file, after the "NNS1" magic and a uint32 record size,
+ *        native byte order: both commands and their time to collision, ttc_horizon if none
+ */
+struct ShadowRecord
+{
+	double stamp;
+	float classic_linear, classic_angular;
+	float net_linear, net_angular;
+	float net_age;
+	float classic_ttc, net_ttc;
+	uint32_t classic_valid;
+};
+
+
+/*
+ * @brief seconds before a disc of robot_radius moving at (linear, angular) from the scan origin
+ *        reaches one of the sector obstacles, placed at the sector center; horizon if none
+ *        within horizon seconds
+ */
+float TimeToCollision(float linear, float angular, const std::vector<float>& obstacles,
+		      float sector_start, float sector_width, float robot_radius, float horizon);
+
+
+/*
+ * @class ShadowLogger
+ * @brief shadow mode log: the control thread only fills a slot of a wait-free ring
+ *        and posts the writer thread, which sleeps on the semaphore in between, computes the times to collision, writes the records
+ *        buffered to the binary file and keeps running divergence statistics
+ */
+class ShadowLogger
+{
+
+public:
+
+	ShadowLogger();
+
+	~ShadowLogger();
+
+	/*
+	 * @param capacity queued cycles before new ones are dropped
+	 * @param sectors obstacle values of every sample
+	 * @return false if the file can not be created
+	 */
+	bool Open(const std::string& path, int capacity, int sectors, float robot_radius, float horizon);
+
+	/*
+	 * @brief control thread: free sample to fill, NULL if the writer is behind - the cycle is not logged
+	 */
+	ShadowSample* Reserve();
+
+	// control thread: the filled sample is handed to the writer
+	void Commit() {
+		queue->Commit();
+		sem_post(&samples_queued);
+	}
+
+	// stops the writer once the queued samples are written
+	void Close();
+
+	unsigned long dropped() const { return dropped_.load(); }
+
+private:
+
+	void writer();
+
+	void write(const ShadowSample& sample);
+
+	boost::shared_ptr<SpscRing<ShadowSample> > queue;
+
+	FILE* file;
+	std::string path;
+	float robot_radius, horizon;
+
+	boost::thread writer_thread;
+	boost::atomic<bool> stop;
+	boost::atomic<unsigned long> dropped_;
+
+	// a post per committed sample
+	sem_t samples_queued;
+
+	// writer thread: divergence since the last report
+	long records;
+	double linear_error, angular_error, ttc_error;
+
+	ShadowLogger(const ShadowLogger&);
+	ShadowLogger& operator=(const ShadowLogger&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
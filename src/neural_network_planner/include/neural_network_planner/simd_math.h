@@ -0,0 +1,214 @@
+#ifndef _SIMD_MATH_H_
+#define _SIMD_MATH_H_
+
+#include <neural_network_planner/gate_kernels.h>
+
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+namespace neural_network_planner {
+
+namespace kernels {
+
+/*
+ * @brief kLanes wide float vector and its operations, shared by the kernels:
+ *        the scalar build maps vfloat to float so that templates compile everywhere
+ */
+namespace simd {
+
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+typedef __m256 vfloat;
+
+inline vfloat vload(const float* p) { return _mm256_load_ps(p); }
+inline vfloat vloadu(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vfloat v) { _mm256_store_ps(p, v); }
+inline void vstoreu(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vbroadcast(const float* p) { return _mm256_broadcast_ss(p); }
+inline vfloat vload_int8(const int8_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*) p))); }
+inline vfloat vset(float x) { return _mm256_set1_ps(x); }
+inline vfloat vzero() { return _mm256_setzero_ps(); }
+inline vfloat vfma(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+
+// a where x >= threshold, b elsewhere and where x is NaN
+inline vfloat vselect_ge(vfloat x, vfloat threshold, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, threshold, _CMP_GE_OQ)); }
+
+// 1 where x >= threshold, 0 elsewhere and where x is NaN
+inline vfloat vcount_ge(vfloat x, vfloat threshold) { return _mm256_and_ps(_mm256_cmp_ps(x, threshold, _CMP_GE_OQ), vset(1.0f)); }
+
+inline float vhsum(vfloat v)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+inline float vhmin(vfloat v)
+{
+	__m128 s = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_min_ps(s, _mm_movehl_ps(s, s));
+	return _mm_cvtss_f32(_mm_min_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+// cephes single precision exp
+inline vfloat vexp(vfloat x)
+{
+
+	x = _mm256_min_ps(x, vset(88.3762626647949f));
+	x = _mm256_max_ps(x, vset(-88.3762626647949f));
+
+	vfloat fx = _mm256_floor_ps(vfma(x, vset(1.44269504088896341f), vset(0.5f)));
+
+	x = vsub(x, vmul(fx, vset(0.693359375f)));
+	x = vsub(x, vmul(fx, vset(-2.12194440e-4f)));
+
+	vfloat y = vset(1.9875691500E-4f);
+	y = vfma(y, x, vset(1.3981999507E-3f));
+	y = vfma(y, x, vset(8.3334519073E-3f));
+	y = vfma(y, x, vset(4.1665795894E-2f));
+	y = vfma(y, x, vset(1.6666665459E-1f));
+	y = vfma(y, x, vset(5.0000001201E-1f));
+	y = vfma(y, vmul(x, x), vadd(x, vset(1.0f)));
+
+	__m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127));
+	return vmul(y, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+typedef float32x4_t vfloat;
+
+inline vfloat vload(const float* p) { return vld1q_f32(p); }
+inline vfloat vloadu(const float* p) { return vld1q_f32(p); }
+inline void vstore(float* p, vfloat v) { vst1q_f32(p, v); }
+inline void vstoreu(float* p, vfloat v) { vst1q_f32(p, v); }
+inline vfloat vbroadcast(const float* p) { return vld1q_dup_f32(p); }
+// reads 8 bytes, widens the first 4
+inline vfloat vload_int8(const int8_t* p) { return vcvtq_f32_s32(vmovl_s16(vget_low_s16(vmovl_s8(vld1_s8(p))))); }
+inline vfloat vset(float x) { return vdupq_n_f32(x); }
+inline vfloat vzero() { return vdupq_n_f32(0); }
+inline vfloat vfma(vfloat a, vfloat b, vfloat c) { return vmlaq_f32(c, a, b); }
+inline vfloat vadd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+
+inline vfloat vdiv(vfloat a, vfloat b)
+{
+#if defined(__aarch64__)
+	return vdivq_f32(a, b);
+#else
+	vfloat r = vrecpeq_f32(b);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	r = vmulq_f32(vrecpsq_f32(b, r), r);
+	return vmulq_f32(a, r);
+#endif
+}
+
+inline vfloat vmin(vfloat a, vfloat b) { return vminq_f32(a, b); }
+
+// a where x >= threshold, b elsewhere and where x is NaN
+inline vfloat vselect_ge(vfloat x, vfloat threshold, vfloat a, vfloat b) { return vbslq_f32(vcgeq_f32(x, threshold), a, b); }
+
+// 1 where x >= threshold, 0 elsewhere and where x is NaN
+inline vfloat vcount_ge(vfloat x, vfloat threshold) { return vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(x, threshold), vreinterpretq_u32_f32(vset(1.0f)))); }
+
+inline float vhsum(vfloat v)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+inline float vhmin(vfloat v)
+{
+	float32x2_t s = vmin_f32(vget_low_f32(v), vget_high_f32(v));
+	return vget_lane_f32(vpmin_f32(s, s), 0);
+}
+
+// cephes single precision exp
+inline vfloat vexp(vfloat x)
+{
+
+	x = vminq_f32(x, vset(88.3762626647949f));
+	x = vmaxq_f32(x, vset(-88.3762626647949f));
+
+	vfloat fx = vfma(x, vset(1.44269504088896341f), vset(0.5f));
+	vfloat tx = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+	uint32x4_t greater = vcgtq_f32(tx, fx);
+	fx = vsubq_f32(tx, vreinterpretq_f32_u32(vandq_u32(greater, vreinterpretq_u32_f32(vset(1.0f)))));
+
+	x = vsub(x, vmul(fx, vset(0.693359375f)));
+	x = vsub(x, vmul(fx, vset(-2.12194440e-4f)));
+
+	vfloat y = vset(1.9875691500E-4f);
+	y = vfma(y, x, vset(1.3981999507E-3f));
+	y = vfma(y, x, vset(8.3334519073E-3f));
+	y = vfma(y, x, vset(4.1665795894E-2f));
+	y = vfma(y, x, vset(1.6666665459E-1f));
+	y = vfma(y, x, vset(5.0000001201E-1f));
+	y = vfma(y, vmul(x, x), vadd(x, vset(1.0f)));
+
+	int32x4_t e = vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127));
+	return vmul(y, vreinterpretq_f32_s32(vshlq_n_s32(e, 23)));
+
+}
+
+#else
+
+typedef float vfloat;
+
+inline vfloat vload(const float* p) { return *p; }
+inline vfloat vloadu(const float* p) { return *p; }
+inline void vstore(float* p, vfloat v) { *p = v; }
+inline void vstoreu(float* p, vfloat v) { *p = v; }
+inline vfloat vbroadcast(const float* p) { return *p; }
+inline vfloat vload_int8(const int8_t* p) { return *p; }
+inline vfloat vset(float x) { return x; }
+inline vfloat vzero() { return 0; }
+inline vfloat vfma(vfloat a, vfloat b, vfloat c) { return a * b + c; }
+inline vfloat vadd(vfloat a, vfloat b) { return a + b; }
+inline vfloat vsub(vfloat a, vfloat b) { return a - b; }
+inline vfloat vmul(vfloat a, vfloat b) { return a * b; }
+inline vfloat vdiv(vfloat a, vfloat b) { return a / b; }
+inline vfloat vexp(vfloat x) { return exp(x); }
+inline vfloat vmin(vfloat a, vfloat b) { return b < a ? b : a; }
+inline vfloat vselect_ge(vfloat x, vfloat threshold, vfloat a, vfloat b) { return x >= threshold ? a : b; }
+inline vfloat vcount_ge(vfloat x, vfloat threshold) { return x >= threshold ? 1.0f : 0.0f; }
+inline float vhsum(vfloat v) { return v; }
+inline float vhmin(vfloat v) { return v; }
+
+#endif
+
+
+inline vfloat vsigmoid(vfloat x)
+{
+	return vdiv(vset(1.0f), vadd(vset(1.0f), vexp(vsub(vzero(), x))));
+}
+
+inline vfloat vtanh(vfloat x)
+{
+	vfloat e = vexp(vmul(x, vset(-2.0f)));
+	return vsub(vdiv(vset(2.0f), vadd(vset(1.0f), e)), vset(1.0f));
+}
+
+
+} // namespace simd
+
+} // namespace kernels
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <boost/atomic.hpp>
+
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class SpscRing
+ * @brief bounded ring between exactly one producer and one consumer thread,
+ *        wait-free on both sides. Slots are allocated once and filled in place:
+ *        the producer writes Reserve() and publishes it with Commit(),
+ *        the consumer reads Front() and hands it back with Pop()
+ */
+template <typename T>
+class SpscRing
+{
+
+public:
+
+	// capacity - 1 slots can be filled at once, every slot is a copy of prototype
+	explicit SpscRing(int capacity, const T& prototype = T())
+		: slots(capacity, prototype), head(0), tail(0) {}
+
+	// producer: free slot to fill, NULL if the consumer has not released any
+	T* Reserve() {
+		int h = head.load(boost::memory_order_relaxed);
+		if( next(h) == tail.load(boost::memory_order_acquire) )
+			return NULL;
+		return &slots[h];
+	}
+
+	// producer: the reserved slot becomes visible to the consumer
+	void Commit() {
+		head.store(next(head.load(boost::memory_order_relaxed)), boost::memory_order_release);
+	}
+
+	// consumer: oldest filled slot, NULL if empty
+	T* Front() {
+		int t = tail.load(boost::memory_order_relaxed);
+		if( t == head.load(boost::memory_order_acquire) )
+			return NULL;
+		return &slots[t];
+	}
+
+	// consumer: the front slot can be reused by the producer
+	void Pop() {
+		tail.store(next(tail.load(boost::memory_order_relaxed)), boost::memory_order_release);
+	}
+
+	// filled slots, exact from the consumer, a lower bound from the producer
+	int size() const {
+		int n = head.load(boost::memory_order_acquire) - tail.load(boost::memory_order_acquire);
+		return n < 0 ? n + slots.size() : n;
+	}
+
+	int capacity() const { return slots.size(); }
+
+private:
+
+	int next(int i) const { return i + 1 == slots.size() ? 0 : i + 1; }
+
+	std::vector<T> slots;
+
+	// written by one side each, on their own cache lines
+	char pad0[64];
+	boost::atomic<int> head;
+	char pad1[64];
+	boost::atomic<int> tail;
+	char pad2[64];
+
+	SpscRing(const SpscRing&);
+	SpscRing& operator=(const SpscRing&);
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _STATE_FEATURES_H_
+#define _STATE_FEATURES_H_
+
+#include <vector>
+#include <utility>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief network state layout, shared by database building and online planning:
+ *        averaged_ranges_size downsampled ranges (ScanDownsampler) followed by
+ *        target distance and relative angle
+ */
+
+inline int state_size(int averaged_ranges_size) { return averaged_ranges_size + 2; }
+
+/*
+ * @brief target distance and relative angle from source pose to target point,
+ *        orientation is the raw odometry quaternion z component as stored in databases
+ */
+void TargetFeatures(const std::pair<float, float>& source, const std::pair<float, float>& target,
+				float orientation, float* distance, float* relative_angle);
+
+
+} // namespace neural_network_planner
+
+
+#endif
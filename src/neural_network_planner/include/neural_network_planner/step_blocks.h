@@ -0,0 +1,41 @@
+#ifndef _STEP_BLOCKS_H_
+#define _STEP_BLOCKS_H_
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief steps featurized offline by a worker thread (refeaturize, bag_to_database):
+ *        keys, episodes and stamps of the steps with their states and labels, row by row
+ */
+struct StepBlock
+{
+	std::vector<int> keys, episodes;
+	std::vector<double> stamps;
+	std::vector<float> states, labels;
+	bool ok;
+	int skipped;
+
+	StepBlock() : ok(false), skipped(0) {}
+};
+
+
+/*
+ * @brief writes the blocks in their order, the databases named as BuildDatabase names them with
+ *        the resolution in place of the date: <prefix>states_db-rN_<backend> and
+ *        <prefix>labels_db-rN_twist-variant_<backend> (split), <prefix>steps_db-rN_<backend>
+ *        (unified) or <prefix>steps-rN.nnd (columnar). Keys are the ones of the steps
+ * @return the steps written
+ */
+long WriteStepBlocks(const std::vector<StepBlock>& blocks, int state_size, int label_size, const std::string& prefix,
+		     int averaged_ranges_size, const std::string& format, const std::string& backend);
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _STEP_DATA_LAYER_H_
+#define _STEP_DATA_LAYER_H_
+
+#include <caffe/caffe.hpp>
+#include "caffe/util/db.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class StepDataLayer
+ * @brief caffe layer "StepData" reading the unified steps database of BuildDatabase:
+ *        a single read per step fills both the data and labels tops, batch_size consecutive
+ *        steps each (data_param source, backend and batch_size). An optional third top is
+ *        the clip of the recurrent layers, batch_size x state values: 0 where an episode
+ *        starts, 1 where the step follows the previous one - across batches as well,
+ *        like caffe recurrent layers carry their states. The database is read in a loop
+ */
+template <typename Dtype>
+class StepDataLayer : public caffe::Layer<Dtype>
+{
+
+public:
+
+	explicit StepDataLayer(const caffe::LayerParameter& param)
+		: caffe::Layer<Dtype>(param), batch_size(0), state_size(0), label_size(0), episode(0), continued(false) {}
+
+	virtual void LayerSetUp(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top);
+
+	virtual void Reshape(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top) {}
+
+	virtual inline const char* type() const { return "StepData"; }
+	virtual inline int ExactNumBottomBlobs() const { return 0; }
+	virtual inline int MinTopBlobs() const { return 2; }
+	virtual inline int MaxTopBlobs() const { return 3; }
+
+protected:
+
+	virtual void Forward_cpu(const std::vector<caffe::Blob<Dtype>*>& bottom, const std::vector<caffe::Blob<Dtype>*>& top);
+
+	virtual void Backward_cpu(const std::vector<caffe::Blob<Dtype>*>& top, const std::vector<bool>& propagate_down,
+				  const std::vector<caffe::Blob<Dtype>*>& bottom) {}
+
+private:
+
+	boost::shared_ptr<caffe::db::DB> database;
+	boost::shared_ptr<caffe::db::Cursor> cursor;
+
+	int batch_size, state_size, label_size;
+
+	// episode of the last step read, false after the database wrapped
+	int episode;
+	bool continued;
+
+};
+
+
+/*
+ * @brief makes the StepData layer type known to caffe, before the nets using it are created
+ */
+void RegisterStepDataLayer();
+
+
+} // namespace neural_network_planner
+
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _STEP_DATABASE_H_
+#define _STEP_DATABASE_H_
+
+#include <string>
+#include <vector>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief value of the split states and labels databases: a float Datum of size
+ *        channels, height and width 1, the layout caffe's Data layer reads
+ */
+void EncodeDatum(const float* values, int size, std::string* value);
+
+/*
+ * @brief the first max_steps steps of a recording of BuildDatabase, in any database_format:
+ *        a .nnd dataset, a unified steps database or a split database, which holds either
+ *        the states or the labels of the steps
+ * @param states state_size floats appended per step, NULL to skip the states
+ * @param labels label_size floats appended per step, NULL to skip the labels
+ * @return steps read
+ */
+int ReadSteps(const std::string& path, const std::string& backend, int max_steps,
+	      int state_size, std::vector<float>* states, int label_size, std::vector<float>* labels);
+
+
+} // namespace neural_network_planner
+
+
+#endif
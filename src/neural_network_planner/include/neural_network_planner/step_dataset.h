@@ -0,0 +1,137 @@
+#ifndef _STEP_DATASET_H_
+#define _STEP_DATASET_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief .nnd files: the steps of BuildDatabase in columns of fixed stride, memory mapped
+ *        and copied to the net blobs in place, without a per step decode.
+ *        The header (magic, byte order, version, sizes, column offsets) is followed by the
+ *        columns, each aligned to kDatasetAlignment: states (count x state_size floats),
+ *        labels (count x label_size floats), episodes (int32), stamps (double), per channel
+ *        mean and variance of the states (double) and the first step of every episode (uint32).
+ *        Packed datasets (pack_windows) are made of window_length step windows, each time
+ *        ordered and contiguous, their episodes are the continuous segments of the recording
+ */
+struct StepDatasetHeader
+{
+	char magic[4];
+	uint32_t byte_order, version;
+	uint32_t state_size, label_size;
+	uint32_t episode_count;
+	// 0 if the steps are in recording order
+	uint32_t window_length, reserved;
+	uint64_t count;
+	// byte offsets of the columns from the start of the file
+	uint64_t states, labels, episodes, stamps, mean, variance, episode_starts;
+};
+
+const int kDatasetAlignment = 64;
+
+
+class StepDataset
+{
+
+public:
+
+	StepDataset();
+
+	~StepDataset();
+
+	/*
+	 * @brief maps the file read only
+	 * @return false if the file can not be mapped, is malformed or of another version
+	 */
+	bool Open(const std::string& path);
+
+	uint64_t count() const { return header->count; }
+	int state_size() const { return header->state_size; }
+	int label_size() const { return header->label_size; }
+	int episode_count() const { return header->episode_count; }
+	int window_length() const { return header->window_length; }
+
+	// columns in the mapping, states and labels row major
+	const float* states() const { return column<float>(header->states); }
+	const float* labels() const { return column<float>(header->labels); }
+	const int32_t* episodes() const { return column<int32_t>(header->episodes); }
+	const double* stamps() const { return column<double>(header->stamps); }
+	const double* mean() const { return column<double>(header->mean); }
+	const double* variance() const { return column<double>(header->variance); }
+	const uint32_t* episode_starts() const { return column<uint32_t>(header->episode_starts); }
+
+private:
+
+	template <typename T>
+	const T* column(uint64_t offset) const { return reinterpret_cast<const T*>(static_cast<const char*>(mapping) + offset); }
+
+	void* mapping;
+	size_t size;
+	const StepDatasetHeader* header;
+
+	StepDataset(const StepDataset&);
+	StepDataset& operator=(const StepDataset&);
+
+};
+
+
+/*
+ * @class StepDatasetWriter
+ * @brief appends steps to a .nnd file: the states are streamed to a temporary file,
+ *        labels, episodes and stamps are kept until Close (a few bytes per step) which
+ *        writes the other columns and the header and renames the file over path.
+ *        The channel statistics are accumulated while appending (Welford)
+ */
+class StepDatasetWriter
+{
+
+public:
+
+	StepDatasetWriter();
+
+	~StepDatasetWriter();
+
+	bool Open(const std::string& path, int state_size, int label_size, int window_length = 0);
+
+	bool Append(const float* state, const float* label, int episode, double stamp);
+
+	// the appended states reach the file
+	void Flush();
+
+	// false if the dataset could not be completed, the temporary file is left
+	bool Close();
+
+	uint64_t count() const { return count_; }
+
+private:
+
+	std::string path, temporary;
+	FILE* file;
+
+	int state_size, label_size, window_length;
+	uint64_t count_;
+
+	std::vector<float> labels;
+	std::vector<int32_t> episodes;
+	std::vector<double> stamps, mean, m2;
+	std::vector<uint32_t> episode_starts;
+
+	StepDatasetWriter(const StepDatasetWriter&);
+	StepDatasetWriter& operator=(const StepDatasetWriter&);
+
+};
+
+
+bool IsStepDataset(const std::string& path);
+
+
+} // namespace neural_network_planner
+
+
+#endif
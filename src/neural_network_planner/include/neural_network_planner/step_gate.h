@@ -0,0 +1,51 @@
+#ifndef _STEP_GATE_H_
+#define _STEP_GATE_H_
+
+#include <utility>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @class StepGate
+ * @brief when BuildDatabase stores a step, shared by the live recording and bag_to_database.
+ *        Positions closer than pos_update_threshold to the current one are ignored. At every
+ *        tick of the sampling loop a step is due if the robot moved more than minimal_step_distance
+ *        since the previous tick and a goal is pending. The first such movement only arms the gate:
+ *        odometry may be alive before the recording starts. A goal is reached, and no step stored,
+ *        once the robot stands within minimal_step_distance of it
+ */
+class StepGate
+{
+
+public:
+
+	StepGate(float minimal_step_distance = 0.5, float pos_update_threshold = 0.001);
+
+	// synchronized odometry
+	void UpdatePosition(const std::pair<float, float>& position);
+
+	void SetTarget(const std::pair<float, float>& target);
+
+	// sampling loop: true if a step is due
+	bool Tick();
+
+	const std::pair<float, float>& source() const { return current_source; }
+	const std::pair<float, float>& target() const { return current_target; }
+	bool goal_received() const { return goal_received_; }
+
+private:
+
+	float minimal_step_distance, pos_update_threshold;
+
+	std::pair<float, float> current_source, prev_source, current_target;
+	bool actual_start, goal_received_;
+
+};
+
+
+} // namespace neural_network_planner
+
+
+#endif
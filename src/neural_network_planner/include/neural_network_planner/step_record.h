@@ -0,0 +1,82 @@
+#ifndef _STEP_RECORD_H_
+#define _STEP_RECORD_H_
+
+#include <cstring>
+#include <string>
+#include <stdint.h>
+
+
+namespace neural_network_planner {
+
+
+/*
+ * @brief value of the unified steps database, one per stored step: this header,
+ *        then state_size state floats and label_size label floats, native byte order.
+ *        Keys are the step index, format_int(step, 8) as the split databases
+ */
+struct StepRecordHeader
+{
+	char magic[4];
+	uint16_t state_size, label_size;
+	// goal the step was recorded for, seconds of the scan
+	int32_t episode;
+	uint32_t reserved;
+	double stamp;
+};
+
+struct StepRecord
+{
+	const StepRecordHeader* header;
+	const float* state;
+	const float* label;
+};
+
+const char kStepRecordMagic[4] = { 'N', 'N', 'R', '1' };
+
+
+inline void EncodeStepRecord(const float* state, int state_size, const float* label, int label_size,
+			     int episode, double stamp, std::string* value)
+{
+
+	StepRecordHeader header;
+	memcpy(header.magic, kStepRecordMagic, sizeof(header.magic));
+	header.state_size = state_size;
+	header.label_size = label_size;
+	header.episode = episode;
+	header.reserved = 0;
+	header.stamp = stamp;
+
+	value->resize(sizeof(header) + (state_size + label_size) * sizeof(float));
+	char* out = &(*value)[0];
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + sizeof(header), state, state_size * sizeof(float));
+	memcpy(out + sizeof(header) + state_size * sizeof(float), label, label_size * sizeof(float));
+
+}
+
+/*
+ * @brief pointers into value, valid as long as value is
+ * @return false if value is not a step record
+ */
+inline bool DecodeStepRecord(const std::string& value, StepRecord* record)
+{
+
+	if( value.size() < sizeof(StepRecordHeader) )
+		return false;
+
+	record->header = reinterpret_cast<const StepRecordHeader*>(value.data());
+	if( memcmp(record->header->magic, kStepRecordMagic, sizeof(kStepRecordMagic)) != 0
+	    || value.size() != sizeof(StepRecordHeader) + (record->header->state_size + record->header->label_size) * sizeof(float) )
+		return false;
+
+	record->state = reinterpret_cast<const float*>(value.data() + sizeof(StepRecordHeader));
+	record->label = record->state + record->header->state_size;
+	return true;
+
+}
+
+
+} // namespace neural_network_planner
+
+
+#endif
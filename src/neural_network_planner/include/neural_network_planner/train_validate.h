@@ -61,6 +61,10 @@ namespace neural_network_planner {
 	std::string solver_conf, trained, folder_path;
 	bool solver_mode, TRAIN, GPU, resume;
 
+	// input_norm layer in front of the net, statistics of the first normalization_samples training states
+	bool input_normalization;
+	int normalization_samples;
+
 	int batch_updates, iter_size, val_freq;
 	int train_batch_size, train_set_size, train_batch_num; 	
 	int validate_batch_size, validate_set_size,  validate_batch_num;
@@ -0,0 +1,387 @@
+// builds the databases of BuildDatabase from a recorded bag of /base_scan, /odom, /move_base/goal
+// and /cmd_vel instead of a live run. The steps are chosen as the node chooses them: a sequential
+// pass over the bag times replays its sampling loop at sampling_rate with the same StepGate, every
+// scan paired with the odometry closest in time as the synchronizer pairs them. Only the light
+// messages are decoded there, the scans of the chosen steps are then decoded and featurized by
+// threads workers, each on its own time slice of the bag, and written in time order with the keys
+// 0, 1, 2 ... of a live run: the same bag always gives the same databases
+// usage: bag_to_database recording.bag output_prefix [averaged_ranges_size] [sampling_rate]
+//        [minimal_step_distance] [pos_update_threshold] [command_measured] [threads] [format] [backend] [downsampling]
+
+#include <neural_network_planner/scan_downsampler.h>
+#include <neural_network_planner/state_features.h>
+#include <neural_network_planner/step_blocks.h>
+#include <neural_network_planner/step_gate.h>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include <geometry_msgs/Twist.h>
+#include <move_base_msgs/MoveBaseActionGoal.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include "glog/logging.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+using boost::lexical_cast;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+const int kLabelsSize = 2;
+
+const string kScanTopic = "/base_scan";
+const string kOdomTopic = "/odom";
+const string kGoalTopic = "/move_base/goal";
+const string kCommandTopic = "/cmd_vel";
+
+
+double seconds()
+{
+
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + 1e-6 * now.tv_usec;
+
+}
+
+
+struct Odom
+{
+	double time;
+	std::pair<float, float> position;
+	float orientation, linear_x, angular_z;
+};
+
+struct Timed
+{
+	double time;
+	float first, second;
+};
+
+// a scan of the bag: its bag time and how many scans before it share that time
+struct Scan
+{
+	ros::Time time;
+	int rank;
+};
+
+// a step chosen by the gate, its state waits for the scan
+struct Step
+{
+	int scan, episode;
+	std::pair<float, float> source, target;
+	float orientation, linear_x, angular_z;
+};
+
+
+// the messages of the gate, in bag time order
+void read_light_topics(rosbag::Bag& bag, vector<Scan>* scans, vector<Odom>* odoms, vector<Timed>* goals, vector<Timed>* commands)
+{
+
+	vector<string> topics;
+	topics.push_back(kScanTopic);
+	topics.push_back(kOdomTopic);
+	topics.push_back(kGoalTopic);
+	topics.push_back(kCommandTopic);
+
+	rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+	for(rosbag::View::iterator it = view.begin(); it != view.end(); ++it) {
+
+		const rosbag::MessageInstance& message = *it;
+
+		// scans are left encoded: their time is enough to replay the gate
+		if( message.getTopic() == kScanTopic ) {
+			Scan scan = { message.getTime(), 0 };
+			if( !scans->empty() && scans->back().time == scan.time )
+				scan.rank = scans->back().rank + 1;
+			scans->push_back(scan);
+		}
+		else if( message.getTopic() == kOdomTopic ) {
+			nav_msgs::Odometry::ConstPtr odom_msg = message.instantiate<nav_msgs::Odometry>();
+			if( !odom_msg )
+				continue;
+			Odom odom;
+			odom.time = message.getTime().toSec();
+			odom.position = std::pair<float, float>(odom_msg->pose.pose.position.x, odom_msg->pose.pose.position.y);
+			odom.orientation = odom_msg->pose.pose.orientation.z;
+			odom.linear_x = odom_msg->twist.twist.linear.x;
+			odom.angular_z = odom_msg->twist.twist.angular.z;
+			odoms->push_back(odom);
+		}
+		else if( message.getTopic() == kGoalTopic ) {
+			move_base_msgs::MoveBaseActionGoal::ConstPtr goal_msg = message.instantiate<move_base_msgs::MoveBaseActionGoal>();
+			if( !goal_msg )
+				continue;
+			Timed goal = { message.getTime().toSec(), static_cast<float>(goal_msg->goal.target_pose.pose.position.x),
+				       static_cast<float>(goal_msg->goal.target_pose.pose.position.y) };
+			goals->push_back(goal);
+		}
+		else {
+			geometry_msgs::Twist::ConstPtr command_msg = message.instantiate<geometry_msgs::Twist>();
+			if( !command_msg )
+				continue;
+			Timed command = { message.getTime().toSec(), static_cast<float>(command_msg->linear.x),
+					  static_cast<float>(command_msg->angular.z) };
+			commands->push_back(command);
+		}
+	}
+
+}
+
+// odometry closest in time to a scan, -1 without odometry
+int closest_odom(const vector<Odom>& odoms, double time)
+{
+
+	if( odoms.empty() )
+		return -1;
+
+	int after = 0, before = odoms.size();
+	while( after < before ) {
+		int middle = (after + before) / 2;
+		if( odoms[middle].time < time )
+			after = middle + 1;
+		else
+			before = middle;
+	}
+
+	if( after == odoms.size() || (after > 0 && time - odoms[after - 1].time < odoms[after].time - time) )
+		after--;
+	return after;
+
+}
+
+/*
+ * the sampling loop of BuildDatabase over the bag time: at every tick the goals, commands and
+ * synchronized scans received since the previous one update the gate, then the gate decides
+ */
+void select_steps(const vector<Scan>& scans, const vector<Odom>& odoms, const vector<Timed>& goals, const vector<Timed>& commands,
+		  float sampling_rate, float minimal_step_distance, float pos_update_threshold, bool command_measured, vector<Step>* steps)
+{
+
+	StepGate gate(minimal_step_distance, pos_update_threshold);
+	Step current;
+	current.scan = -1;
+	current.episode = -1;
+	current.orientation = current.linear_x = current.angular_z = 0;
+
+	double begin = scans.front().time.toSec(), end = scans.back().time.toSec();
+	if( !odoms.empty() )
+		begin = std::min(begin, odoms.front().time);
+
+	int scan = 0, goal = 0, command = 0;
+	for(long tick = 1; ; tick++) {
+
+		double now = begin + tick / sampling_rate;
+
+		for(; goal < goals.size() && goals[goal].time <= now; goal++) {
+			gate.SetTarget(std::make_pair(goals[goal].first, goals[goal].second));
+			current.episode++;
+		}
+
+		for(; !command_measured && command < commands.size() && commands[command].time <= now; command++) {
+			current.linear_x = commands[command].first;
+			current.angular_z = commands[command].second;
+		}
+
+		for(; scan < scans.size() && scans[scan].time.toSec() <= now; scan++) {
+
+			int odom = closest_odom(odoms, scans[scan].time.toSec());
+			if( odom < 0 )
+				continue;
+
+			gate.UpdatePosition(odoms[odom].position);
+			current.scan = scan;
+			current.orientation = odoms[odom].orientation;
+			if( command_measured ) {
+				current.linear_x = odoms[odom].linear_x;
+				current.angular_z = odoms[odom].angular_z;
+			}
+		}
+
+		if( gate.Tick() && current.scan >= 0 ) {
+			current.source = gate.source();
+			current.target = gate.target();
+			steps->push_back(current);
+		}
+
+		if( now > end )
+			break;
+	}
+
+}
+
+
+// the scans of steps [first, last) in a view of their time slice
+void featurize(const string& bag_path, const vector<Scan>* scans, const vector<Step>* steps, int first, int last,
+	       int averaged_ranges_size, const string& downsampling, StepBlock* block)
+{
+
+	if( first == last ) {
+		block->ok = true;
+		return;
+	}
+
+	rosbag::Bag bag;
+	try {
+		bag.open(bag_path, rosbag::bagmode::Read);
+	}
+	catch( rosbag::BagException& e ) {
+		LOG(ERROR) << "can not read " << bag_path << ": " << e.what();
+		return;
+	}
+
+	const Scan& first_scan = (*scans)[(*steps)[first].scan];
+	const Scan& last_scan = (*scans)[(*steps)[last - 1].scan];
+	rosbag::View view(bag, rosbag::TopicQuery(kScanTopic), first_scan.time, last_scan.time);
+
+	ScanDownsampler downsampler;
+	downsampler.Init(averaged_ranges_size, downsampling);
+
+	int size = state_size(averaged_ranges_size);
+	vector<float> state(size);
+
+	block->states.reserve((last - first) * size);
+	block->labels.reserve((last - first) * kLabelsSize);
+
+	ros::Time previous_time;
+	int rank = 0, step = first;
+
+	for(rosbag::View::iterator it = view.begin(); it != view.end() && step < last; ++it) {
+
+		rank = it->getTime() == previous_time ? rank + 1 : 0;
+		previous_time = it->getTime();
+
+		const Scan& scan = (*scans)[(*steps)[step].scan];
+		if( previous_time != scan.time || rank != scan.rank )
+			continue;
+
+		// the scan of a step
+		const Step& chosen = (*steps)[step++];
+		sensor_msgs::LaserScan::ConstPtr laser_msg = it->instantiate<sensor_msgs::LaserScan>();
+
+		if( !laser_msg || !downsampler.Downsample(laser_msg->ranges, laser_msg->range_min, laser_msg->range_max, &state[0]) ) {
+			block->skipped++;
+			continue;
+		}
+		TargetFeatures(chosen.source, chosen.target, chosen.orientation, &state[averaged_ranges_size], &state[averaged_ranges_size + 1]);
+
+		// numbered once every block is featurized
+		block->keys.push_back(0);
+		block->episodes.push_back(chosen.episode);
+		block->stamps.push_back(laser_msg->header.stamp.toSec());
+		block->states.insert(block->states.end(), state.begin(), state.end());
+		block->labels.push_back(chosen.linear_x);
+		block->labels.push_back(chosen.angular_z);
+	}
+
+	block->skipped += last - step;
+	block->ok = true;
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s recording.bag output_prefix [averaged_ranges_size] [sampling_rate] [minimal_step_distance] "
+		       "[pos_update_threshold] [command_measured] [threads] [format] [backend] [downsampling]\n", argv[0]);
+		return 1;
+	}
+
+	string bag_path = argv[1], prefix = argv[2];
+	int averaged_ranges_size = argc > 3 ? lexical_cast<int>(argv[3]) : 24;
+	float sampling_rate = argc > 4 ? lexical_cast<float>(argv[4]) : 1;
+	float minimal_step_distance = argc > 5 ? lexical_cast<float>(argv[5]) : 0.5;
+	float pos_update_threshold = argc > 6 ? lexical_cast<float>(argv[6]) : 0.001;
+	bool command_measured = argc > 7 ? string(argv[7]) == "true" || string(argv[7]) == "1" : true;
+	int threads = argc > 8 ? lexical_cast<int>(argv[8]) : boost::thread::hardware_concurrency();
+	string format = argc > 9 ? argv[9] : "split";
+	string backend = argc > 10 ? argv[10] : "lmdb";
+	string downsampling = argc > 11 ? argv[11] : "mean";
+
+	CHECK(ScanDownsampler().Init(averaged_ranges_size, downsampling)) << "averaged_ranges_size must be positive, downsampling mean, min, median or pN";
+	CHECK_GT(sampling_rate, 0);
+	CHECK(format == "split" || format == "unified" || format == "columnar") << "format must be split, unified or columnar";
+	threads = std::max(threads, 1);
+
+	double start = seconds();
+
+	vector<Scan> scans;
+	vector<Odom> odoms;
+	vector<Timed> goals, commands;
+	{
+		rosbag::Bag bag;
+		try {
+			bag.open(bag_path, rosbag::bagmode::Read);
+		}
+		catch( rosbag::BagException& e ) {
+			LOG(FATAL) << "can not read " << bag_path << ": " << e.what();
+		}
+		read_light_topics(bag, &scans, &odoms, &goals, &commands);
+	}
+
+	CHECK(!scans.empty()) << "no " << kScanTopic << " message in " << bag_path;
+	if( odoms.empty() )
+		LOG(WARNING) << "no " << kOdomTopic << " message in " << bag_path << ": no step";
+	if( goals.empty() )
+		LOG(WARNING) << "no " << kGoalTopic << " message in " << bag_path << ": no step";
+
+	vector<Step> steps;
+	select_steps(scans, odoms, goals, commands, sampling_rate, minimal_step_distance, pos_update_threshold, command_measured, &steps);
+
+	double select_time = seconds() - start;
+	start = seconds();
+
+	// consecutive time slices of about the same number of steps
+	threads = std::min<int>(threads, std::max<int>(steps.size(), 1));
+	vector<StepBlock> blocks(threads);
+	boost::thread_group workers;
+	for(int t = 0; t < threads; t++)
+		workers.create_thread(boost::bind(&featurize, bag_path, &scans, &steps, steps.size() * t / threads,
+						  steps.size() * (t + 1) / threads, averaged_ranges_size, downsampling, &blocks[t]));
+	workers.join_all();
+
+	double featurize_time = seconds() - start;
+
+	// the steps of skipped scans leave no gap: keys counted over the written steps, as the node counts them
+	int skipped = 0, key = 0;
+	for(int b = 0; b < blocks.size(); b++) {
+		CHECK(blocks[b].ok) << "can not read the scans of " << bag_path;
+		skipped += blocks[b].skipped;
+		for(int i = 0; i < blocks[b].keys.size(); i++)
+			blocks[b].keys[i] = key++;
+	}
+	if( skipped > 0 )
+		LOG(WARNING) << skipped << " scans with less than " << averaged_ranges_size << " ranges skipped";
+
+	start = seconds();
+	long written = WriteStepBlocks(blocks, state_size(averaged_ranges_size), kLabelsSize, prefix, averaged_ranges_size, format, backend);
+	double write_time = seconds() - start;
+
+	double total = select_time + featurize_time + write_time;
+	double recorded = scans.back().time.toSec() - scans.front().time.toSec();
+	printf("%ld steps of %d ranges from %lu scans, %d goals, %d threads: select %.3f s, featurize %.3f s, write %.3f s",
+	       written, averaged_ranges_size, (unsigned long)scans.size(), (int)goals.size(), threads, select_time, featurize_time, write_time);
+	if( total > 0 && recorded > 0 )
+		printf(", %.0fx real time", recorded / total);
+	printf("\n");
+
+	return 0;
+
+}
@@ -3,6 +3,7 @@
 
 #include <math.h>
 #include <neural_network_planner/build_database.h>
+#include <neural_network_planner/database_writer.h>
 
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
@@ -15,14 +16,12 @@
 #include <iostream>
 
 #include "boost/scoped_ptr.hpp"
-#include "caffe/proto/caffe.pb.h"
-#include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
-#include "caffe/util/format.hpp"
 
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 
 
 using namespace sensor_msgs;
@@ -48,6 +47,11 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 
 	private_nh.param("set_size", set_size, 10000);
 	private_nh.param("batch_size", batch_size, 100);	
+	private_nh.param("commit_period", commit_period, 1.0);
+	private_nh.param("write_queue_size", write_queue_size, 1000);
+	private_nh.param("check_table_format", check_table_format, std::string("text"));
+	private_nh.param("check_flush_period", check_flush_period, 5.0);
+	private_nh.param("scan_archive", scan_archive, false);
 	private_nh.param("move_angle_distance", move_angle_distance, 45.0);	
 	private_nh.param("scan_topic", scan_topic, std::string("/base_scan") );
 	private_nh.param("goal_topic", goal_topic, std::string("/move_base/goal") );	
@@ -55,12 +59,16 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	private_nh.param("command_topic", command_topic, std::string("/cmd_vel") );
 	private_nh.param("base_path", base_path, std::string("") );
 	private_nh.param("averaged_ranges_size", averaged_ranges_size, 15 );
+	private_nh.param("downsampling", downsampling, std::string("mean"));
 	private_nh.param("database_backend", backend, std::string("leveldb"));
+	private_nh.param("database_format", database_format, std::string("split"));
 	private_nh.param("logs_path", logs_path, std::string(""));
 	private_nh.param<float>("minimal_step_distance", minimal_step_dist, 0.5); 
 	private_nh.param<float>("sampling_rate", sampling_rate, 1);
 	private_nh.param<float>("pos_update_threshold", pos_update_threshold, 0.001);
 	private_nh.param("show_lines", show_lines, false);
+	private_nh.param("line_history", line_history, 10);
+	private_nh.param("line_rate", line_rate, 2.0);
 	private_nh.param("command_measured", command_measured, true);
 
 	FLAGS_log_dir = logs_path;
@@ -68,10 +76,9 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	FLAGS_alsologtostderr = 1;
 	FLAGS_minloglevel = 0;
 
-	prev_target = std::pair<float, float>(0,0);
-	current_source = std::pair<float,float>(0,0);
-	prev_source = std::pair<float,float>(0,0);
-	
+	gate = StepGate(minimal_step_dist, pos_update_threshold);
+
+	CHECK(downsampler.Init(averaged_ranges_size, downsampling)) << "downsampling must be mean, min, median or pN";
 	range_data = vector<float>(averaged_ranges_size, 0);
 
 	// related neural network input size selected for this build_database run 
@@ -80,9 +87,12 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	int labels_size = 2;
 
 	timestep = database_counter = 0;
+	episode = -1;
 	db_writestep = 0;
 
 	CHECK_EQ(set_size % batch_size, 0) << "set_size must be multiple of batch_size!";
+	CHECK(database_format == "split" || database_format == "unified" || database_format == "columnar")
+		<< "database_format must be split, unified or columnar";
 
 	ros::NodeHandle db_nh("build_db");
 	laserscan_sub_.subscribe(db_nh, scan_topic, 25);
@@ -101,7 +111,24 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 
 	net_ranges_pub_ = nh.advertise<LaserScan>("state_ranges", 1);
 	if( show_lines ) {
+		CHECK_GT(line_history, 0) << "line_history must be positive";
+		CHECK_GT(line_rate, 0) << "line_rate must be positive";
+
+		// a ray is a segment from the robot to the range end: two points
+		ray_ring = vector<geometry_msgs::Point>(2 * averaged_ranges_size * line_history);
+		ray_head = ray_scans = 0;
+
+		line_list.header.frame_id = "/odom";
+		line_list.action = visualization_msgs::Marker::ADD;
+		line_list.pose.orientation.w = 1.0;
+		line_list.id = 0;
+		line_list.type = visualization_msgs::Marker::LINE_LIST;
+		line_list.color.r = 1.0;
+		line_list.color.a = 1.0;
+		line_list.points.reserve(ray_ring.size());
+
 		marker_pub_ = nh.advertise<Marker>("range_lines", 1);
+		line_timer = nh.createWallTimer(ros::WallDuration(1.0 / line_rate), &BuildDatabase::lines_callback, this);
 	}
 
 	time_t init = time(0);
@@ -111,17 +138,38 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	std::string states_db_path = base_path + "states_db-" + lexical_cast<std::string>(init_tm->tm_mon+1) 
 				              + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour) 
 				              + "-" + lexical_cast<std::string>(init_tm->tm_min) + "_" + backend;
-	scoped_ptr<caffe::db::DB> states_database(caffe::db::GetDB(backend));
-	states_database->Open(states_db_path, caffe::db::NEW);
-	scoped_ptr<caffe::db::Transaction> states_txn(states_database->NewTransaction());
 
 	// labels databse initialization
 	std::string labels_db_path = base_path + "labels_db-" + lexical_cast<std::string>(init_tm->tm_mon+1) 
 				              + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour) 
 				              + "-" + lexical_cast<std::string>(init_tm->tm_min) + "_twist-variant_" + backend;
-	scoped_ptr<caffe::db::DB> labels_database(caffe::db::GetDB(backend));
-	labels_database->Open(labels_db_path, caffe::db::NEW);
-	scoped_ptr<caffe::db::Transaction> labels_txn(labels_database->NewTransaction());
+
+	// unified: states, labels, episodes and stamps in a single database, one write per step
+	std::string steps_db_path = base_path + "steps_db-" + lexical_cast<std::string>(init_tm->tm_mon+1)
+				             + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour)
+				             + "-" + lexical_cast<std::string>(init_tm->tm_min) + "_" + backend;
+
+	// columnar: memory mapped by the MappedData layer, the database backend is not used
+	std::string dataset_path = base_path + "steps-" + lexical_cast<std::string>(init_tm->tm_mon+1)
+				          + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour)
+				          + "-" + lexical_cast<std::string>(init_tm->tm_min) + ".nnd";
+
+	if( database_format == "unified" )
+		states_db_path = labels_db_path = steps_db_path;
+	else if( database_format == "columnar" )
+		states_db_path = labels_db_path = dataset_path;
+
+	// the databases are owned by the writer thread, this loop never waits on the disk
+	DatabaseWriter database_writer;
+	if( database_format == "unified" )
+		database_writer.Open(steps_db_path, backend, write_queue_size, batch_size, commit_period,
+				     state_sequence_size, labels_size);
+	else if( database_format == "columnar" )
+		database_writer.OpenDataset(dataset_path, write_queue_size, batch_size, commit_period,
+					    state_sequence_size, labels_size);
+	else
+		database_writer.Open(states_db_path, labels_db_path, backend, write_queue_size, batch_size, commit_period,
+				     state_sequence_size, labels_size);
 
 
 	// creating a text file to debug database building - just first times
@@ -131,64 +179,54 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 				         + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour) 
 				         + "-" + lexical_cast<std::string>(init_tm->tm_min) + "_" + backend;
 
-	int print_check;
-	FILE * table = fopen(check_text.c_str(), "w");
-	if( table == NULL ) {
-		cout << "Plot file opening failed.\n";
-		exit(1);
+	// text, csv or binary, none to skip it
+	if( check_table_format != "none" ) {
+		if( check_table_format == "csv" )
+			check_text += ".csv";
+		else if( check_table_format == "binary" )
+			check_text += ".bin";
+		CHECK(check_table.Open(check_text, check_table_format, averaged_ranges_size)) << "Can not write the check table " << check_text;
 	}
 
-	bool actual_start = false;
-	goal_received = false;
+	// raw scans of the stored steps, compressed: other resolutions are built offline from them
+	std::string scan_archive_path = base_path + "scans-" + lexical_cast<std::string>(init_tm->tm_mon+1)
+				            + "-" + lexical_cast<std::string>(init_tm->tm_mday) + "-" + lexical_cast<std::string>(init_tm->tm_hour)
+				            + "-" + lexical_cast<std::string>(init_tm->tm_min) + ".nns";
+
+	if( scan_archive )
+		CHECK(scan_archive_writer.Open(scan_archive_path)) << "Can not write the scan archive " << scan_archive_path;
+
+	if( check_table_format != "none" )
+		check_flush_timer = nh.createWallTimer(ros::WallDuration(check_flush_period), &BuildDatabase::flush_callback, this);
 
 	ros::Rate store_rate(sampling_rate);
 
 	while( ros::ok() && db_writestep < set_size) {
 
-//	  LOG(INFO) << "Distance from previous point: " << Step_dist() << "   " << goal_received;
+	  // step distance and goal gating, shared with bag_to_database
+	  bool valid_step = gate.Tick();
+	  DatabaseRecord* record = valid_step ? database_writer.Reserve() : NULL;
 
-	/* step consistency checking:
-      * condition 1: actual movement more than the minimal distance  
-	 * condition 2: first iteration check is always a false positive
-      *              odom could remain alive while database node can
-      *              restart - meaning the first callback will update 
-      *              a position always distant from initial zero values 
-      */
+	  if( valid_step && record == NULL ) // writer behind the disk: the step is dropped rather than waited for
+		LOG_EVERY_N(WARNING, 100) << "Database writer is behind, " << database_writer.dropped() << " steps dropped";
+	  else if( valid_step ) { 
 
-		
-	  if( Step_dist() > minimal_step_dist && actual_start && goal_received) { 
-
-		float x_rel = current_target.first - current_source.first;
-		float y_rel = current_target.second - current_source.second;	 
+		float x_rel = gate.target().first - gate.source().first;
+		float y_rel = gate.target().second - gate.source().second;	 
 
 		float distance = hypot( x_rel, y_rel);
 		float relative_angle = fabs(atan2( y_rel , x_rel ) - current_orientation);
 
 		//LOG(INFO) << "Writing step " << db_writestep << " in " << states_db_path << " and " << labels_db_path;
 	
-		std::string state_value;
-		caffe::Datum state_datum;
-		state_datum.set_channels(state_sequence_size);
-		state_datum.set_height(1);
-		state_datum.set_width(1);
-		
-		// storing the state data 				
-		for(int i = 0; i < range_data.size(); i++) {
-			state_datum.add_float_data(range_data[i]);
-		}		
-		state_datum.add_float_data(distance);
-		state_datum.add_float_data(relative_angle);
-
-		state_datum.set_encoded(false);
-		state_datum.SerializeToString(&state_value);	
-		std::string key_str = caffe::format_int(db_writestep, 8);
-		states_txn->Put(key_str, state_value);
-		
-		std::string label_value;
-		caffe::Datum label_datum;
-		label_datum.set_channels(labels_size);
-		label_datum.set_height(1);	
-		label_datum.set_width(1);
+		record->key = db_writestep;
+		record->episode = episode;
+		record->stamp = scan_stamp.toSec();
+
+		// storing the state data
+		std::copy(range_data.begin(), range_data.end(), record->state.begin());
+		record->state[range_data.size()] = distance;
+		record->state[range_data.size() + 1] = relative_angle;
 
 		// storing labels
 		/* debugging tool: if real command mode is selected
@@ -203,50 +241,41 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	
 		}
     
-		label_datum.add_float_data(current_linear_x);
-		label_datum.add_float_data(current_angular_z);
-		label_datum.set_encoded(false);
-		label_datum.SerializeToString(&label_value);
-		
-		// using same key as state one - consistent accessing to databases
-		label_datum.SerializeToString(&label_value);
-		labels_txn->Put(key_str, label_value);
-
-		table = fopen(check_text.c_str(), "a");
-		if( table == NULL ) {
-			cout << "Plot file opening failed.\n";
-			exit(1);
+		// same key as the state: consistent accessing to databases
+		record->label[0] = current_linear_x;
+		record->label[1] = current_angular_z;
+
+		database_writer.Commit();
+
+		check_table.Write(db_writestep, range_data, distance, relative_angle, current_linear_x, current_angular_z);
+
+		if( scan_archive ) {
+			scan_frame.step = db_writestep;
+			scan_frame.episode = episode;
+			scan_frame.stamp = scan_stamp.toSec();
+			scan_frame.angle_min = last_scan->angle_min;
+			scan_frame.angle_max = last_scan->angle_max;
+			scan_frame.range_min = last_scan->range_min;
+			scan_frame.range_max = last_scan->range_max;
+			scan_frame.x = gate.source().first;
+			scan_frame.y = gate.source().second;
+			scan_frame.orientation = current_orientation;
+			scan_frame.target_x = gate.target().first;
+			scan_frame.target_y = gate.target().second;
+			scan_frame.linear_x = current_linear_x;
+			scan_frame.angular_z = current_angular_z;
+			scan_frame.ranges = last_scan->ranges;
+			if( !scan_archive_writer.Append(scan_frame) )
+				LOG_EVERY_N(ERROR, 100) << "Can not write the scan archive " << scan_archive_path;
 		}
-		for(int i = 0; i < range_data.size(); i++) {
-		 fprintf(table, "%.4f   ", range_data[i]); 
-		}
-		 fprintf(table, "%.4f   ", distance); 
-		 fprintf(table, "%.4f \n  ", relative_angle); 
-		 fprintf(table, "DB STEP %d   LABELS   %.4f  %.4f \n ", db_writestep, current_linear_x, current_angular_z); 
-		 fclose(table);
-		
-
-		if( ++db_writestep % batch_size == 0 ) { // commit the batch to dbs
 
-			states_txn->Commit();	
-			labels_txn->Commit();
-			states_txn.reset(states_database->NewTransaction());
-			labels_txn.reset(labels_database->NewTransaction());			
-
-      	} 
+		db_writestep++;
 
 		LOG(INFO) << "Stored step  " << db_writestep;
 		
 
 	     
 	  } // check available step
-	  else if ( Step_dist() > minimal_step_dist ) 
-		actual_start = true;
-	  else if ( point_distance(current_source, current_target) <= minimal_step_dist ) // current pos has achieved target within the minimal step range
-		goal_received = false;
-	  
-		
-	  prev_source = current_source;
 
 	  store_rate.sleep();
 	
@@ -255,12 +284,15 @@ BuildDatabase::BuildDatabase(std::string& database_name) : private_nh("~")
 	}
 
 	
-	if( db_writestep % batch_size != 0) { // Last commit if needed for a safe closing
-
-		LOG(INFO) << "Closing DATABASES ";
-		states_txn->Commit();
-		labels_txn->Commit();
-
+	// last commit for a safe closing, once the queued steps are written
+	LOG(INFO) << "Closing DATABASES ";
+	database_writer.Close();
+	check_table.Close();
+
+	if( scan_archive ) {
+		scan_archive_writer.Close();
+		LOG(INFO) << "Scan archive " << scan_archive_path << ": " << scan_archive_writer.frames() << " scans, "
+			  << scan_archive_writer.compressed_bytes() << " bytes (" << scan_archive_writer.raw_bytes() << " encoded)";
 	}
 
 	
@@ -284,7 +316,15 @@ void BuildDatabase::build_callback(const LaserScan::ConstPtr& laser_msg,
 							const Odometry::ConstPtr& odom_msg)
 {
 	
+	// a scan too short for the state leaves the previous step untouched
+	if( !downsampler.Downsample(laser_msg->ranges, laser_msg->range_min, laser_msg->range_max, &range_data[0]) ) {
+		LOG_EVERY_N(WARNING, 100) << "Scan of " << laser_msg->ranges.size() << " ranges, less than " << averaged_ranges_size;
+		return;
+	}
+
 	timestep++;
+	scan_stamp = laser_msg->header.stamp;
+	last_scan = laser_msg;
 //	ROS_INFO("Database_callback timestep: %d", timestep);
 	
 
@@ -294,8 +334,7 @@ void BuildDatabase::build_callback(const LaserScan::ConstPtr& laser_msg,
 	tmp_source.second = odom_msg->pose.pose.position.y;
 	current_orientation = odom_msg->pose.pose.orientation.z;
 
-	if ( point_distance(current_source, tmp_source) > pos_update_threshold ) 
-		current_source = tmp_source;
+	gate.UpdatePosition(tmp_source);
 
 	if( command_measured ) {
 		// update velocity commands with measured values 
@@ -303,87 +342,59 @@ void BuildDatabase::build_callback(const LaserScan::ConstPtr& laser_msg,
 		current_angular_z = odom_msg->twist.twist.angular.z;
 	}
 
-	vector<float> ranges = laser_msg->ranges;
-	
-	float range_num = ranges.size();
-	vector<float> current_ranges;
-
-//	LOG(INFO) << "Range measures total num:" << range_num;
-//     LOG(INFO) << "Scan message ranges size: " << ranges.size();
-//	LOG(INFO) << "ANGLE INCREMENT: " << laser_msg->angle_increment;
-	
-	int average_base = range_num / averaged_ranges_size;
+	// visualization only: nothing to do without subscribers
+	bool publish_ranges = net_ranges_pub_.getNumSubscribers() > 0;
+	bool store_rays = show_lines && marker_pub_.getNumSubscribers() > 0;
+	if( !publish_ranges && !store_rays )
+		return;
 
-	float add_range;	
-		
-	for(int i = 0; i < range_num; i++) {
-
-		add_range += ranges[i];
-
-		if( (i+1) % average_base == 0 ) {
-			current_ranges.push_back( add_range / average_base );
-			add_range = 0;
-		}
-			
-	}		
-
-
-	CHECK_EQ(current_ranges.size(), averaged_ranges_size);
-
-	for(int i = 0; i < current_ranges.size(); i++) {
-		range_data[i] = current_ranges[i];
-	}
-	
-		
 	float start_angle = (float) (laser_msg->angle_max - laser_msg->angle_min) / (averaged_ranges_size*2);
  
 	state_ranges.angle_min = laser_msg->angle_min + start_angle;
 	state_ranges.angle_max = laser_msg->angle_max;
 	state_ranges.range_min = laser_msg->range_min;
 	state_ranges.range_max = laser_msg->range_max;
-	state_ranges.header.stamp = line_list.header.stamp = ros::Time::now();
-	state_ranges.ranges = range_data;
+	state_ranges.header.stamp = ros::Time::now();
 	state_ranges.angle_increment = (state_ranges.angle_max - state_ranges.angle_min) / averaged_ranges_size;
 	state_ranges.header.frame_id = "hokuyo_link";
-	line_list.header.frame_id = "/odom";
-	line_list.action = visualization_msgs::Marker::ADD;
-	line_list.pose.orientation.w = 1.0;
-	line_list.id = 0;
-	line_list.type = visualization_msgs::Marker::LINE_LIST;
-	line_list.color.r = 1.0;
-     line_list.color.a = 1.0;
-
-	geometry_msgs::Point p_source;
-	p_source.x = tmp_source.first;
-	p_source.y = tmp_source.second;
 
-	if( show_lines ) {
+	if( store_rays ) {
+
+		geometry_msgs::Point p_source;
+		p_source.x = tmp_source.first;
+		p_source.y = tmp_source.second;
 
-		for(int i = 0; i < current_ranges.size(); i++) {
+		// the rays of this scan take the place of the oldest ones
+		geometry_msgs::Point* rays = &ray_ring[2 * averaged_ranges_size * ray_head];
 
-			geometry_msgs::Point p;
-			p.x = p_source.x + current_ranges[i] * cos(state_ranges.angle_min + state_ranges.angle_increment * i);
-			p.y = p_source.y + current_ranges[i] * sin(state_ranges.angle_min + state_ranges.angle_increment * i);
+		for(int i = 0; i < range_data.size(); i++) {
+
+			geometry_msgs::Point& p = rays[2 * i];
+			p.x = p_source.x + range_data[i] * cos(state_ranges.angle_min + state_ranges.angle_increment * i);
+			p.y = p_source.y + range_data[i] * sin(state_ranges.angle_min + state_ranges.angle_increment * i);
 			p.z = 0.025;
 
-			line_list.points.push_back(p);
-			line_list.points.push_back(p_source);
+			rays[2 * i + 1] = p_source;
 
 		}
-		
-		marker_pub_.publish(line_list);
+
+		ray_head = (ray_head + 1) % line_history;
+		ray_scans = std::min(ray_scans + 1, line_history);
 	}
 
-	net_ranges_pub_.publish(state_ranges);	
+	if( publish_ranges ) {
+		state_ranges.ranges = range_data;
+		net_ranges_pub_.publish(state_ranges);	
+	}
 
 }
 
 void BuildDatabase::updateTarget_callback( const MoveBaseActionGoal::ConstPtr& actiongoal_msg) {
 
 	LOG(INFO) << "Updating target pose";
-	current_target.first = actiongoal_msg->goal.target_pose.pose.position.x;
-	current_target.second = actiongoal_msg->goal.target_pose.pose.position.y;
-	goal_received = true;
+	gate.SetTarget(std::pair<float, float>(actiongoal_msg->goal.target_pose.pose.position.x,
+					       actiongoal_msg->goal.target_pose.pose.position.y));
+	episode++;
 
 }
 
@@ -396,9 +407,29 @@ void BuildDatabase::updateCmdVel_callback( const geometry_msgs::Twist::ConstPtr&
 
 }
 
-float BuildDatabase::Step_dist() {
+void BuildDatabase::flush_callback(const ros::WallTimerEvent& event) {
+
+	check_table.Flush();
+
+}
+
+void BuildDatabase::lines_callback(const ros::WallTimerEvent& event) {
+
+	if( ray_scans == 0 || marker_pub_.getNumSubscribers() == 0 )
+		return;
+
+	// oldest scan first, the marker never holds more than line_history scans
+	int scan_points = 2 * averaged_ranges_size;
+	int oldest = (ray_head - ray_scans + line_history) % line_history;
+
+	line_list.points.clear();
+	for(int k = 0; k < ray_scans; k++) {
+		vector<geometry_msgs::Point>::const_iterator rays = ray_ring.begin() + scan_points * ((oldest + k) % line_history);
+		line_list.points.insert(line_list.points.end(), rays, rays + scan_points);
+	}
 
-	return hypot(current_source.second - prev_source.second, current_source.first - prev_source.first);
+	line_list.header.stamp = ros::Time::now();
+	marker_pub_.publish(line_list);
 
 }
 
@@ -0,0 +1,427 @@
+#include <neural_network_planner/caffemodel_reader.h>
+
+#include "glog/logging.h"
+
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+
+namespace neural_network_planner {
+
+
+int BlobDescription::count() const
+{
+
+	int c = 1;
+	for(int i = 0; i < shape.size(); i++)
+		c *= shape[i];
+	return c;
+
+}
+
+LayerDescription::LayerDescription() : num_output(0), axis(1), bias_term(true), transpose(false),
+				       has_use_global_stats(false), use_global_stats(false), eps(1e-5),
+				       concat_axis(1)
+{
+
+}
+
+const LayerDescription* NetDescription::layer_by_name(const std::string& layer_name) const
+{
+
+	for(int i = 0; i < layers.size(); i++)
+		if( layers[i].name == layer_name )
+			return &layers[i];
+
+	return NULL;
+
+}
+
+
+namespace {
+
+// caffe.proto field numbers used here
+enum {
+	NET_NAME = 1, NET_LAYER = 100,
+	LAYER_NAME = 1, LAYER_TYPE = 2, LAYER_BOTTOM = 3, LAYER_TOP = 4, LAYER_BLOBS = 7,
+	LAYER_CONCAT = 104, LAYER_INNER_PRODUCT = 117, LAYER_BATCH_NORM = 139,
+	LAYER_SCALE = 142, LAYER_INPUT = 143, LAYER_RECURRENT = 146,
+	BLOB_NUM = 1, BLOB_CHANNELS = 2, BLOB_HEIGHT = 3, BLOB_WIDTH = 4,
+	BLOB_DATA = 5, BLOB_SHAPE = 7, BLOB_DOUBLE_DATA = 8,
+	SHAPE_DIM = 1
+};
+
+enum { WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_BYTES = 2, WIRE_FIXED32 = 5 };
+
+
+/*
+ * @brief one protobuf field: varint and fixed values in value,
+ *        length delimited payloads in [data, data + size)
+ */
+struct Field
+{
+	int number, wire;
+	uint64_t value;
+	const char* data;
+	size_t size;
+};
+
+class WireReader
+{
+
+public:
+
+	WireReader(const char* begin, size_t size) : pos(begin), end(begin + size), failed(false) {}
+
+	bool done() const { return failed || pos >= end; }
+	bool ok() const { return !failed; }
+
+	bool Varint(uint64_t* value) {
+
+		*value = 0;
+		for(int shift = 0; shift < 64; shift += 7) {
+			if( pos >= end )
+				return fail();
+			uint8_t byte = *pos++;
+			*value |= uint64_t(byte & 0x7f) << shift;
+			if( !(byte & 0x80) )
+				return true;
+		}
+		return fail();
+
+	}
+
+	bool Next(Field* field) {
+
+		uint64_t key;
+		if( !Varint(&key) )
+			return false;
+
+		field->number = key >> 3;
+		field->wire = key & 7;
+		field->data = NULL;
+		field->size = 0;
+
+		switch( field->wire ) {
+		  case WIRE_VARINT:
+			return Varint(&field->value);
+		  case WIRE_FIXED64:
+			return Fixed(field, 8);
+		  case WIRE_FIXED32:
+			return Fixed(field, 4);
+		  case WIRE_BYTES:
+			if( !Varint(&field->value) || field->value > size_t(end - pos) )
+				return fail();
+			field->data = pos;
+			field->size = field->value;
+			pos += field->size;
+			return true;
+		  default:
+			return fail();
+		}
+
+	}
+
+private:
+
+	const char* pos;
+	const char* end;
+	bool failed;
+
+	bool fail() { failed = true; return false; }
+
+	bool Fixed(Field* field, size_t bytes) {
+
+		if( size_t(end - pos) < bytes )
+			return fail();
+		field->data = pos;
+		field->size = bytes;
+		field->value = 0;
+		memcpy(&field->value, pos, bytes);
+		pos += bytes;
+		return true;
+
+	}
+
+};
+
+inline std::string to_string(const Field& f) { return std::string(f.data, f.size); }
+
+inline float to_float(const Field& f)
+{
+	float v;
+	uint32_t bits = f.value;
+	memcpy(&v, &bits, 4);
+	return v;
+}
+
+// repeated numeric fields come either packed or one per field
+template<typename T>
+bool read_repeated(const Field& f, std::vector<T>* values, int fixed_bytes)
+{
+
+	if( f.wire != WIRE_BYTES ) {
+		if( fixed_bytes == 4 )
+			values->push_back(T(to_float(f)));
+		else if( fixed_bytes == 8 ) {
+			double d;
+			memcpy(&d, &f.value, 8);
+			values->push_back(T(d));
+		}
+		else
+			values->push_back(T(f.value));
+		return true;
+	}
+
+	if( fixed_bytes == 4 ) {
+		size_t n = f.size / 4, offset = values->size();
+		values->resize(offset + n);
+		for(size_t i = 0; i < n; i++) {
+			float v;
+			memcpy(&v, f.data + 4 * i, 4);
+			(*values)[offset + i] = T(v);
+		}
+		return f.size % 4 == 0;
+	}
+
+	if( fixed_bytes == 8 ) {
+		for(size_t i = 0; i + 8 <= f.size; i += 8) {
+			double d;
+			memcpy(&d, f.data + i, 8);
+			values->push_back(T(d));
+		}
+		return f.size % 8 == 0;
+	}
+
+	WireReader packed(f.data, f.size);
+	while( !packed.done() ) {
+		uint64_t v;
+		if( !packed.Varint(&v) )
+			return false;
+		values->push_back(T(v));
+	}
+	return true;
+
+}
+
+bool parse_shape(const char* data, size_t size, std::vector<int>* shape)
+{
+
+	WireReader reader(data, size);
+	Field f;
+	while( !reader.done() && reader.Next(&f) ) {
+		if( f.number == SHAPE_DIM && !read_repeated(f, shape, 0) )
+			return false;
+	}
+	return reader.ok();
+
+}
+
+bool parse_blob(const char* data, size_t size, BlobDescription* blob)
+{
+
+	WireReader reader(data, size);
+	Field f;
+	int legacy[4] = { 0, 0, 0, 0 };
+	bool has_legacy = false;
+
+	while( !reader.done() && reader.Next(&f) ) {
+
+		switch( f.number ) {
+		  case BLOB_SHAPE:
+			if( !parse_shape(f.data, f.size, &blob->shape) )
+				return false;
+			break;
+		  case BLOB_DATA:
+			if( !read_repeated(f, &blob->data, 4) )
+				return false;
+			break;
+		  case BLOB_DOUBLE_DATA:
+			if( !read_repeated(f, &blob->data, 8) )
+				return false;
+			break;
+		  case BLOB_NUM: case BLOB_CHANNELS: case BLOB_HEIGHT: case BLOB_WIDTH:
+			legacy[f.number - BLOB_NUM] = f.value;
+			has_legacy = true;
+			break;
+		  default:
+			break;
+		}
+	}
+
+	if( blob->shape.empty() && has_legacy )
+		blob->shape.assign(legacy, legacy + 4);
+
+	return reader.ok() && blob->count() == blob->data.size();
+
+}
+
+bool parse_layer(const char* data, size_t size, LayerDescription* layer)
+{
+
+	WireReader reader(data, size);
+	Field f;
+
+	while( !reader.done() && reader.Next(&f) ) {
+
+		switch( f.number ) {
+		  case LAYER_NAME: layer->name = to_string(f); break;
+		  case LAYER_TYPE: layer->type = to_string(f); break;
+		  case LAYER_BOTTOM: layer->bottom.push_back(to_string(f)); break;
+		  case LAYER_TOP: layer->top.push_back(to_string(f)); break;
+		  case LAYER_BLOBS:
+			layer->blobs.push_back(BlobDescription());
+			if( !parse_blob(f.data, f.size, &layer->blobs.back()) ) {
+				LOG(ERROR) << "Malformed blob in layer " << layer->name;
+				return false;
+			}
+			break;
+		  case LAYER_INNER_PRODUCT:
+		  case LAYER_RECURRENT: {
+			// num_output = 1 for both, bias_term = 2, axis = 5 and transpose = 6 inner product only
+			bool inner_product = f.number == LAYER_INNER_PRODUCT;
+			WireReader param(f.data, f.size);
+			Field p;
+			while( !param.done() && param.Next(&p) ) {
+				if( p.number == 1 ) layer->num_output = p.value;
+				else if( inner_product && p.number == 2 ) layer->bias_term = p.value;
+				else if( inner_product && p.number == 5 ) layer->axis = int32_t(p.value);
+				else if( inner_product && p.number == 6 ) layer->transpose = p.value;
+			}
+			if( !param.ok() ) return false;
+			break;
+		  }
+		  case LAYER_BATCH_NORM: {
+			WireReader param(f.data, f.size);
+			Field p;
+			while( !param.done() && param.Next(&p) ) {
+				if( p.number == 1 ) {
+					layer->has_use_global_stats = true;
+					layer->use_global_stats = p.value;
+				}
+				else if( p.number == 3 ) layer->eps = to_float(p);
+			}
+			if( !param.ok() ) return false;
+			break;
+		  }
+		  case LAYER_SCALE: {
+			WireReader param(f.data, f.size);
+			Field p;
+			while( !param.done() && param.Next(&p) ) {
+				// axis = 1, bias_term = 4
+				if( p.number == 1 ) layer->axis = int32_t(p.value);
+				else if( p.number == 4 ) layer->bias_term = p.value;
+			}
+			if( !param.ok() ) return false;
+			break;
+		  }
+		  case LAYER_CONCAT: {
+			WireReader param(f.data, f.size);
+			Field p;
+			while( !param.done() && param.Next(&p) ) {
+				// concat_dim = 1 (deprecated), axis = 2
+				if( p.number == 1 || p.number == 2 ) layer->concat_axis = int32_t(p.value);
+			}
+			if( !param.ok() ) return false;
+			break;
+		  }
+		  case LAYER_INPUT: {
+			WireReader param(f.data, f.size);
+			Field p;
+			while( !param.done() && param.Next(&p) ) {
+				if( p.number == 1 ) {
+					layer->input_shapes.push_back(std::vector<int>());
+					if( !parse_shape(p.data, p.size, &layer->input_shapes.back()) )
+						return false;
+				}
+			}
+			if( !param.ok() ) return false;
+			break;
+		  }
+		  default:
+			break;
+		}
+	}
+
+	return reader.ok();
+
+}
+
+} // namespace
+
+
+bool ParseCaffeModel(const char* buffer, size_t size, NetDescription* net)
+{
+
+	net->name.clear();
+	net->layers.clear();
+
+	WireReader reader(buffer, size);
+	Field f;
+
+	while( !reader.done() && reader.Next(&f) ) {
+
+		if( f.number == NET_NAME && f.wire == WIRE_BYTES )
+			net->name = to_string(f);
+		else if( f.number == NET_LAYER && f.wire == WIRE_BYTES ) {
+			net->layers.push_back(LayerDescription());
+			if( !parse_layer(f.data, f.size, &net->layers.back()) )
+				return false;
+		}
+	}
+
+	if( !reader.ok() )
+		LOG(ERROR) << "Truncated or malformed net parameter";
+
+	return reader.ok() && !net->layers.empty();
+
+}
+
+bool ReadCaffeModel(const std::string& path, NetDescription* net)
+{
+
+	FILE* model = fopen(path.c_str(), "rb");
+	if( model == NULL ) {
+		LOG(ERROR) << "Can not open model " << path;
+		return false;
+	}
+
+	std::vector<char> buffer;
+	char chunk[1 << 16];
+	size_t read;
+	while( (read = fread(chunk, 1, sizeof(chunk), model)) > 0 )
+		buffer.insert(buffer.end(), chunk, chunk + read);
+	fclose(model);
+
+	if( buffer.empty() || !ParseCaffeModel(&buffer[0], buffer.size(), net) ) {
+		LOG(ERROR) << "Can not parse model " << path << " (V1 layers format is not supported)";
+		return false;
+	}
+
+	return true;
+
+}
+
+bool RequiredLayers(const NetDescription& net, const std::string& output_blob, std::vector<bool>* used)
+{
+
+	std::set<std::string> needed;
+	needed.insert(output_blob);
+	used->assign(net.layers.size(), false);
+
+	for(int i = net.layers.size() - 1; i >= 0; i--) {
+		const LayerDescription& desc = net.layers[i];
+		for(int j = 0; j < desc.top.size(); j++)
+			if( needed.count(desc.top[j]) )
+				(*used)[i] = true;
+		if( (*used)[i] )
+			needed.insert(desc.bottom.begin(), desc.bottom.end());
+	}
+
+	return needed.count("data");
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,143 @@
+#include <neural_network_planner/check_table.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'C', '1' };
+
+} // namespace
+
+
+CheckTable::CheckTable() : file(NULL), format(TEXT)
+{
+
+}
+
+CheckTable::~CheckTable()
+{
+
+	Close();
+
+}
+
+bool CheckTable::Open(const string& table_path, const string& table_format, int ranges)
+{
+
+	Close();
+
+	if( table_format == "text" )
+		format = TEXT;
+	else if( table_format == "csv" )
+		format = CSV;
+	else if( table_format == "binary" )
+		format = BINARY;
+	else {
+		LOG(ERROR) << "Unknown check table format " << table_format << ", expected text, csv or binary";
+		return false;
+	}
+
+	file = fopen(table_path.c_str(), format == BINARY ? "wb" : "w");
+	if( file == NULL ) {
+		LOG(ERROR) << "Can not open check table " << table_path;
+		return false;
+	}
+
+	// rows reach the disk in large writes, on Flush
+	setvbuf(file, NULL, _IOFBF, 1 << 16);
+
+	path = table_path;
+	values.resize(ranges + 4);
+
+	if( format == CSV ) {
+		fprintf(file, "step");
+		for(int i = 0; i < ranges; i++)
+			fprintf(file, ",range_%d", i);
+		fprintf(file, ",distance,relative_angle,linear_x,angular_z\n");
+	}
+	else if( format == BINARY ) {
+		uint32_t row_values = values.size();
+		fwrite(kMagic, 1, sizeof(kMagic), file);
+		fwrite(&row_values, sizeof(row_values), 1, file);
+	}
+
+	return true;
+
+}
+
+void CheckTable::Write(int step, const vector<float>& ranges, float distance, float relative_angle,
+		       float linear, float angular)
+{
+
+	if( !file )
+		return;
+
+	DCHECK_EQ(ranges.size() + 4, values.size());
+
+	switch( format ) {
+
+	case TEXT:
+		for(int i = 0; i < ranges.size(); i++)
+			fprintf(file, "%.4f   ", ranges[i]);
+		fprintf(file, "%.4f   ", distance);
+		fprintf(file, "%.4f \n  ", relative_angle);
+		fprintf(file, "DB STEP %d   LABELS   %.4f  %.4f \n ", step, linear, angular);
+		break;
+
+	case CSV:
+		fprintf(file, "%d", step);
+		for(int i = 0; i < ranges.size(); i++)
+			fprintf(file, ",%.4f", ranges[i]);
+		fprintf(file, ",%.4f,%.4f,%.4f,%.4f\n", distance, relative_angle, linear, angular);
+		break;
+
+	case BINARY: {
+		int32_t row_step = step;
+		std::copy(ranges.begin(), ranges.end(), values.begin());
+		values[ranges.size()] = distance;
+		values[ranges.size() + 1] = relative_angle;
+		values[ranges.size() + 2] = linear;
+		values[ranges.size() + 3] = angular;
+		fwrite(&row_step, sizeof(row_step), 1, file);
+		fwrite(&values[0], sizeof(float), values.size(), file);
+		break;
+	}
+	}
+
+	if( ferror(file) )
+		LOG_EVERY_N(ERROR, 1000) << "Can not write check table " << path;
+
+}
+
+void CheckTable::Flush()
+{
+
+	if( file )
+		fflush(file);
+
+}
+
+void CheckTable::Close()
+{
+
+	if( !file )
+		return;
+
+	fclose(file);
+	file = NULL;
+
+}
+
+
+} // namespace neural_network_planner
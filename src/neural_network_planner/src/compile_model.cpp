@@ -0,0 +1,361 @@
+// compiles a trained snapshot into a self contained C++ header: weights are static aligned
+// arrays in the layout of the inference engine and the forward pass is a sequence of kernels
+// with compile time sizes, the planner then needs no file or protobuf at startup
+// usage: compile_model weights.caffemodel output.h [class_name] [averaged_ranges_size] [output_blob]
+
+#include <neural_network_planner/caffemodel_reader.h>
+#include <neural_network_planner/gate_kernels.h>
+#include <neural_network_planner/net_transforms.h>
+#include <neural_network_planner/state_features.h>
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using boost::lexical_cast;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+// buffer of a blob for a single timestep, offsets in the aligned activation buffer
+struct BlobLayout
+{
+	int channels, inner, offset;
+
+	int count() const { return channels * inner; }
+};
+
+string identifier(const string& name)
+{
+
+	string id;
+	for(int i = 0; i < name.size(); i++)
+		id += isalnum(name[i]) ? name[i] : '_';
+
+	// names of the generated step function
+	if( id.empty() || isdigit(id[0]) || id == "input" || id == "state" || id == "cont" || id == "buffer" )
+		id = "_" + id;
+	return id;
+
+}
+
+// CompiledModel -> COMPILED_MODEL
+string guard_name(const string& class_name)
+{
+
+	string guard;
+	for(int i = 0; i < class_name.size(); i++) {
+		if( i > 0 && isupper(class_name[i]) && islower(class_name[i - 1]) )
+			guard += '_';
+		guard += toupper(class_name[i]);
+	}
+	return guard;
+
+}
+
+void write_array(FILE* out, const string& name, const vector<float>& values)
+{
+
+	fprintf(out, "static const float %s[%d] __attribute__((aligned(%d))) = {", name.c_str(), int(values.size()), kernels::kAlignment);
+	for(int i = 0; i < values.size(); i++)
+		fprintf(out, "%s%.9ef%s", i % 8 ? " " : "\n\t", values[i], i + 1 < values.size() ? "," : "");
+	fprintf(out, "\n};\n\n");
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s weights.caffemodel output.h [class_name] [averaged_ranges_size] [output_blob]\n", argv[0]);
+		return 1;
+	}
+
+	string weights = argv[1], header = argv[2];
+	string class_name = argc > 3 ? argv[3] : "CompiledModel";
+	int averaged_ranges_size = argc > 4 ? lexical_cast<int>(argv[4]) : 24;
+	string output_blob = argc > 5 ? argv[5] : "out";
+	int input_size = state_size(averaged_ranges_size);
+
+	NetDescription net;
+	CHECK(ReadCaffeModel(weights, &net)) << "can not read " << weights;
+
+	// inference only: dead branches dropped, BatchNorm frozen to its moving averages and folded where possible
+	CHECK(PruneNet(&net, output_blob)) << output_blob << " does not depend on the data blob";
+	int folded = FoldBatchNorm(&net);
+
+	string weights_namespace = class_name + "_weights";
+
+	std::map<string, BlobLayout> blobs;
+	int buffer_size = 0;
+
+	// recurrent states of the LSTM layers, after the activations in the buffer
+	int recurrent_size = 0;
+
+	BlobLayout data = { input_size, 1, 0 };
+	blobs["data"] = data;
+	buffer_size += kernels::RoundUp(input_size);
+
+	// declarations of the weights and statements of the forward pass, written once the shapes are known
+	vector<string> arrays;
+	vector<vector<float> > values;
+	string forward;
+	std::set<string> referenced;
+	int evaluated = 0;
+
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		const LayerDescription& desc = net.layers[i];
+
+		if( desc.type == "Input" || desc.type == "Data" )
+			continue;
+
+		for(int j = 0; j < desc.bottom.size(); j++)
+			CHECK(blobs.count(desc.bottom[j]) || desc.bottom[j] == "clip")
+				<< "layer " << desc.name << ": unknown bottom " << desc.bottom[j];
+
+		if( desc.type == "Split" || (desc.type == "Concat" && desc.bottom.size() == 1) ) {
+			for(int j = 0; j < desc.top.size(); j++)
+				blobs[desc.top[j]] = blobs[desc.bottom[0]];
+			continue;
+		}
+
+		CHECK_EQ(desc.top.size(), 1) << "layer " << desc.name << ": expected a single top blob";
+		for(int j = 0; j < desc.blobs.size(); j++)
+			CHECK(!desc.blobs[j].quantized()) << "layer " << desc.name << ": quantized weights can not be compiled";
+
+		const BlobLayout& bottom = blobs[desc.bottom[0]];
+		string layer = identifier(desc.name);
+		string x = identifier(desc.bottom[0]), y = identifier(desc.top[0]);
+		referenced.insert(desc.bottom[0]);
+		referenced.insert(desc.top[0]);
+
+		BlobLayout top = { 0, 0, buffer_size };
+		char line[512];
+
+		if( desc.type == "LSTM" ) {
+
+			CHECK_EQ(desc.blobs.size(), 3) << "LSTM layer " << desc.name << ": expected W_xc, b_c and W_hc weights";
+
+			int N = bottom.channels, X = desc.blobs[0].shape[1], H = desc.blobs[2].shape[1];
+			int G = kernels::RoundUp(4 * H), Kz = X + H;
+
+			CHECK_EQ(bottom.inner, X) << "LSTM layer " << desc.name << ": input values per stream";
+			CHECK_EQ(H % kernels::kPadding, 0) << "LSTM layer " << desc.name << ": hidden size must be a multiple of "
+							   << kernels::kPadding << " to be compiled";
+
+			const vector<float>& W_xc = desc.blobs[0].data;
+			const vector<float>& W_hc = desc.blobs[2].data;
+
+			vector<float> Wt(Kz * G, 0.f), bias(G, 0.f);
+			for(int m = 0; m < 4 * H; m++) {
+				for(int k = 0; k < X; k++)
+					Wt[k * G + m] = W_xc[m * X + k];
+				for(int k = 0; k < H; k++)
+					Wt[(X + k) * G + m] = W_hc[m * H + k];
+				bias[m] = desc.blobs[1].data[m];
+			}
+
+			arrays.push_back(layer + "_Wt");
+			values.push_back(Wt);
+			arrays.push_back(layer + "_bias");
+			values.push_back(bias);
+
+			top.channels = N;
+			top.inner = H;
+			buffer_size += kernels::RoundUp(N * H);
+
+			// hidden of the previous step and cell
+			int h_offset = recurrent_size, c_offset = recurrent_size + kernels::RoundUp(N * H);
+			recurrent_size += 2 * kernels::RoundUp(N * H);
+
+			snprintf(line, sizeof(line),
+				 "\t\t// %s: LSTM %d streams, %d -> %d\n"
+				 "\t\tkernels::FixedLSTM<%d, %d, %d>(%s::%s_Wt, %s::%s_bias, %s, cont, state + %d, state + %d, %s);\n"
+				 "\t\tmemcpy(state + %d, %s, %d * sizeof(float));\n",
+				 desc.name.c_str(), N, X, H,
+				 N, X, H, weights_namespace.c_str(), layer.c_str(), weights_namespace.c_str(), layer.c_str(),
+				 x.c_str(), h_offset, c_offset, y.c_str(), h_offset, y.c_str(), N * H);
+			forward += line;
+		}
+		else if( desc.type == "BatchNorm" || desc.type == "Scale" ) {
+
+			vector<float> scale, shift;
+
+			if( desc.type == "BatchNorm" ) {
+				CHECK_EQ(desc.blobs.size(), 3) << "BatchNorm layer " << desc.name << ": expected mean, variance and scale factor";
+				BatchNormAffine(desc, &scale, &shift);
+			}
+			else {
+				CHECK(desc.axis == 1 && !desc.blobs.empty()) << "Scale layer " << desc.name << ": only learned per channel scales on axis 1";
+				scale = desc.blobs[0].data;
+				shift = desc.blobs.size() > 1 ? desc.blobs[1].data : vector<float>(scale.size(), 0.f);
+			}
+
+			CHECK_EQ(scale.size(), bottom.channels) << "layer " << desc.name << ": channels";
+
+			arrays.push_back(layer + "_scale");
+			values.push_back(scale);
+			arrays.push_back(layer + "_shift");
+			values.push_back(shift);
+
+			top.channels = bottom.channels;
+			top.inner = bottom.inner;
+			buffer_size += kernels::RoundUp(top.count());
+
+			snprintf(line, sizeof(line),
+				 "\t\t// %s: %s %d channels\n"
+				 "\t\tfor(int ch = 0; ch < %d; ch++)\n"
+				 "\t\t\tfor(int s = 0; s < %d; s++)\n"
+				 "\t\t\t\t%s[ch * %d + s] = %s[ch * %d + s] * %s::%s_scale[ch] + %s::%s_shift[ch];\n",
+				 desc.name.c_str(), desc.type.c_str(), top.channels,
+				 top.channels, top.inner,
+				 y.c_str(), top.inner, x.c_str(), top.inner,
+				 weights_namespace.c_str(), layer.c_str(), weights_namespace.c_str(), layer.c_str());
+			forward += line;
+		}
+		else if( desc.type == "InnerProduct" ) {
+
+			CHECK(desc.axis == 1 && !desc.blobs.empty() && desc.blobs[0].shape.size() == 2)
+				<< "InnerProduct layer " << desc.name << ": only axis 1 with weights is supported";
+
+			const BlobDescription& W = desc.blobs[0];
+			int M = desc.transpose ? W.shape[1] : W.shape[0];
+			int K = desc.transpose ? W.shape[0] : W.shape[1];
+			int Mp = kernels::RoundUp(M);
+
+			CHECK_EQ(bottom.count(), K) << "InnerProduct layer " << desc.name << ": input values";
+
+			vector<float> Wt(K * Mp, 0.f), bias(Mp, 0.f);
+			for(int m = 0; m < M; m++)
+				for(int k = 0; k < K; k++)
+					Wt[k * Mp + m] = desc.transpose ? W.data[k * M + m] : W.data[m * K + k];
+			if( desc.bias_term && desc.blobs.size() > 1 )
+				std::copy(desc.blobs[1].data.begin(), desc.blobs[1].data.end(), bias.begin());
+
+			arrays.push_back(layer + "_Wt");
+			values.push_back(Wt);
+			arrays.push_back(layer + "_bias");
+			values.push_back(bias);
+
+			top.channels = M;
+			top.inner = 1;
+			buffer_size += Mp;
+
+			snprintf(line, sizeof(line),
+				 "\t\t// %s: InnerProduct %d -> %d\n"
+				 "\t\tkernels::FixedGemv<%d, %d>(%s::%s_Wt, %s::%s_bias, %s, %s);\n",
+				 desc.name.c_str(), K, M,
+				 K, Mp, weights_namespace.c_str(), layer.c_str(), weights_namespace.c_str(), layer.c_str(),
+				 x.c_str(), y.c_str());
+			forward += line;
+		}
+		else if( desc.type == "Concat" && desc.concat_axis == 1 ) {
+
+			top.inner = bottom.inner;
+
+			snprintf(line, sizeof(line), "\t\t// %s: Concat of %d blobs\n", desc.name.c_str(), int(desc.bottom.size()));
+			forward += line;
+
+			for(int j = 0; j < desc.bottom.size(); j++) {
+				const BlobLayout& part = blobs[desc.bottom[j]];
+				referenced.insert(desc.bottom[j]);
+				CHECK_EQ(part.inner, top.inner) << "Concat layer " << desc.name << ": inputs differ beyond the channel axis";
+				snprintf(line, sizeof(line), "\t\tmemcpy(%s + %d, %s, %d * sizeof(float));\n",
+					 y.c_str(), top.count(), identifier(desc.bottom[j]).c_str(), part.count());
+				forward += line;
+				top.channels += part.channels;
+			}
+
+			buffer_size += kernels::RoundUp(top.count());
+		}
+		else {
+			LOG(FATAL) << "Layer " << desc.name << " of type " << desc.type << " can not be compiled";
+		}
+
+		blobs[desc.top[0]] = top;
+		evaluated++;
+	}
+
+	CHECK(blobs.count(output_blob)) << net.name << " has no blob " << output_blob;
+
+	FILE* out = fopen(header.c_str(), "w");
+	CHECK(out) << "can not write " << header;
+
+	string guard = "_" + guard_name(class_name) + "_H_";
+	int output_size = blobs[output_blob].count();
+
+	fprintf(out, "// generated by compile_model from %s, do not edit\n", weights.c_str());
+	fprintf(out, "// %s: %d states -> %s, %d values, %d layers, %d BatchNorm folded\n\n",
+		net.name.c_str(), input_size, output_blob.c_str(), output_size, evaluated, folded);
+	fprintf(out, "#ifndef %s\n#define %s\n\n", guard.c_str(), guard.c_str());
+	fprintf(out, "#include <neural_network_planner/fixed_kernels.h>\n\n#include <algorithm>\n#include <cstring>\n\n\n");
+	fprintf(out, "namespace neural_network_planner {\n\nnamespace compiled {\n\n\n");
+
+	fprintf(out, "namespace %s {\n\n", weights_namespace.c_str());
+	for(int i = 0; i < arrays.size(); i++)
+		write_array(out, arrays[i], values[i]);
+	fprintf(out, "} // namespace %s\n\n\n", weights_namespace.c_str());
+
+	fprintf(out,
+		"/*\n"
+		" * @brief %s compiled for %d states: Step and Forward as LSTMEngine,\n"
+		" *        BatchNorm uses the moving averages\n"
+		" */\n"
+		"class %s\n"
+		"{\n\n"
+		"public:\n\n"
+		"\tstatic const int input_size = %d;\n"
+		"\tstatic const int output_size = %d;\n\n"
+		"\tstatic const char* name() { return \"%s\"; }\n\n"
+		"\t%s() : buffer(%d) {}\n\n"
+		"\tvoid ResetState() { std::fill(buffer.data() + %d, buffer.data() + %d, 0.f); }\n\n"
+		"\tconst float* Step(const float* state, bool sequence_start) { return step(state, sequence_start ? 0 : 1); }\n\n"
+		"\t// timesteps in sequence, clip as the caffe clip blob: output of the last one\n"
+		"\tconst float* Forward(const float* states, const float* clip, int timesteps) {\n\n"
+		"\t\tconst float* output = NULL;\n"
+		"\t\tfor(int t = 0; t < timesteps; t++)\n"
+		"\t\t\toutput = step(states + t * input_size, clip ? clip[t] : 1);\n"
+		"\t\treturn output;\n\n"
+		"\t}\n\n"
+		"private:\n\n"
+		"\tconst float* step(const float* input, float cont) {\n\n"
+		"\t\tfloat* state = buffer.data() + %d;\n",
+		net.name.c_str(), input_size, class_name.c_str(), input_size, output_size, net.name.c_str(),
+		class_name.c_str(), buffer_size + recurrent_size, buffer_size, buffer_size + recurrent_size, buffer_size);
+
+	// aliases of Split and single input Concat share the buffer of their bottom
+	referenced.insert("data");
+	referenced.insert(output_blob);
+	for(std::set<string>::const_iterator it = referenced.begin(); it != referenced.end(); ++it)
+		fprintf(out, "\t\tfloat* %s = buffer.data() + %d;\n", identifier(*it).c_str(), blobs[*it].offset);
+
+	fprintf(out, "\n\t\tmemcpy(data, input, input_size * sizeof(float));\n\n%s\n\t\treturn %s;\n\n\t}\n\n",
+		forward.c_str(), identifier(output_blob).c_str());
+	fprintf(out, "\t// activations of one timestep then recurrent states\n\tkernels::AlignedBuffer buffer;\n\n");
+	fprintf(out, "\t%s(const %s&);\n\t%s& operator=(const %s&);\n\n};\n\n\n",
+		class_name.c_str(), class_name.c_str(), class_name.c_str(), class_name.c_str());
+	fprintf(out, "} // namespace compiled\n\n} // namespace neural_network_planner\n\n\n#endif\n");
+
+	fclose(out);
+
+	long weight_bytes = 0;
+	for(int i = 0; i < values.size(); i++)
+		weight_bytes += values[i].size() * sizeof(float);
+
+	printf("%s: %d layers compiled into %s (class %s), %ld bytes of weights, %d bytes of buffers\n",
+	       net.name.c_str(), evaluated, header.c_str(), class_name.c_str(), weight_bytes,
+	       int((buffer_size + recurrent_size) * sizeof(float)));
+
+	return 0;
+
+}
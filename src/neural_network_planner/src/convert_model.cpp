@@ -0,0 +1,104 @@
+// converts a trained snapshot (.caffemodel, or the int8 .nnq of quantize_model) into a .nnw:
+// only the layers the output depends on, weights already laid out for the engine kernels,
+// mapped and used in place by LSTMEngine::Load without parsing or copying
+// usage: convert_model weights.caffemodel output.nnw [averaged_ranges_size] [output_blob] [time_sequence]
+
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/mapped_model.h>
+#include <neural_network_planner/net_transforms.h>
+#include <neural_network_planner/quantized_model.h>
+#include <neural_network_planner/state_features.h>
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+using boost::lexical_cast;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+double seconds()
+{
+
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + 1e-6 * now.tv_usec;
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s weights.caffemodel output.nnw [averaged_ranges_size] [output_blob] [time_sequence]\n", argv[0]);
+		return 1;
+	}
+
+	string weights = argv[1], output = argv[2];
+	int averaged_ranges_size = argc > 3 ? lexical_cast<int>(argv[3]) : 24;
+	string output_blob = argc > 4 ? argv[4] : "out";
+	int time_sequence = argc > 5 ? lexical_cast<int>(argv[5]) : 16;
+	int state_sequence_size = state_size(averaged_ranges_size);
+
+	double start = seconds();
+
+	NetDescription net;
+	bool read = IsQuantizedModel(weights) ? ReadQuantizedModel(weights, &net) : ReadCaffeModel(weights, &net);
+	CHECK(read) << "can not read " << weights;
+
+	CHECK(PruneNet(&net, output_blob)) << output_blob << " does not depend on the data blob";
+
+	LSTMEngine reference;
+	CHECK(reference.Load(net, state_sequence_size, time_sequence, output_blob)) << "engine can not load " << weights;
+
+	double parse_time = seconds() - start;
+
+	vector<MappedTensor> tensors;
+	reference.Tensors(&tensors);
+	CHECK(WriteMappedModel(output, net, tensors)) << "can not write " << output;
+
+	start = seconds();
+	LSTMEngine engine;
+	CHECK(engine.Load(output, state_sequence_size, time_sequence, output_blob)) << "engine can not load " << output;
+	double map_time = seconds() - start;
+
+	// same kernels on the same weights: outputs must be identical
+	vector<float> states(time_sequence * state_sequence_size);
+	vector<float> clip(time_sequence, 1);
+	clip[0] = 0;
+
+	srand(1);
+	for(int i = 0; i < states.size(); i++)
+		states[i] = 5.0 * rand() / RAND_MAX;
+
+	reference.Forward(&states[0], &clip[0], time_sequence);
+	engine.Forward(&states[0], &clip[0], time_sequence);
+
+	double max_diff = 0;
+	for(int t = 0; t < time_sequence; t++)
+		for(int i = 0; i < engine.output_size(); i++)
+			max_diff = std::max(max_diff, double(fabs(reference.Output(t)[i] - engine.Output(t)[i])));
+
+	size_t tensor_bytes = 0;
+	for(int i = 0; i < tensors.size(); i++)
+		tensor_bytes += tensors[i].dtype == TENSOR_INT8 ? tensors[i].count : tensors[i].count * sizeof(float);
+
+	printf("%s -> %s: %d layers, %d tensors, %lu bytes of weights\n", weights.c_str(), output.c_str(),
+	       int(net.layers.size()), int(tensors.size()), (unsigned long) tensor_bytes);
+	printf("load: parsed %.3f ms, mapped %.3f ms, output max abs diff %g\n", 1e3 * parse_time, 1e3 * map_time, max_diff);
+
+	return max_diff == 0 ? 0 : 1;
+
+}
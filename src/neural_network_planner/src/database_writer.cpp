@@ -0,0 +1,292 @@
+#include <neural_network_planner/database_writer.h>
+#include <neural_network_planner/step_database.h>
+#include <neural_network_planner/step_record.h>
+
+#include "caffe/util/format.hpp"
+
+#include "glog/logging.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <time.h>
+
+
+using std::string;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+// commits between two writer reports
+const int kReportCommits = 20;
+
+double seconds()
+{
+
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+
+}
+
+} // namespace
+
+
+DatabaseWriter::DatabaseWriter() : batch_size(1), commit_period(0), stop(false), dropped_(0), committed_(0),
+				   pending(0), first_pending(0), commits(0), max_depth(0), commit_time(0), max_commit_time(0),
+				   reported_drops(0)
+{
+
+	sem_init(&records_queued, 0, 0);
+
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+
+	Close();
+	sem_destroy(&records_queued);
+
+}
+
+void DatabaseWriter::Open(const string& states_path, const string& labels_path, const string& backend,
+			  int capacity, int batch, double period, int state_size, int label_size)
+{
+
+	Close();
+
+	states_database.reset(caffe::db::GetDB(backend));
+	states_database->Open(states_path, caffe::db::NEW);
+	states_txn.reset(states_database->NewTransaction());
+
+	labels_database.reset(caffe::db::GetDB(backend));
+	labels_database->Open(labels_path, caffe::db::NEW);
+	labels_txn.reset(labels_database->NewTransaction());
+
+	start(capacity, batch, period, state_size, label_size);
+
+}
+
+void DatabaseWriter::Open(const string& steps_path, const string& backend,
+			  int capacity, int batch, double period, int state_size, int label_size)
+{
+
+	Close();
+
+	states_database.reset(caffe::db::GetDB(backend));
+	states_database->Open(steps_path, caffe::db::NEW);
+	states_txn.reset(states_database->NewTransaction());
+
+	start(capacity, batch, period, state_size, label_size);
+
+}
+
+void DatabaseWriter::OpenDataset(const string& dataset_path,
+				 int capacity, int batch, double period, int state_size, int label_size)
+{
+
+	Close();
+
+	dataset.reset(new StepDatasetWriter());
+	CHECK(dataset->Open(dataset_path, state_size, label_size)) << "Can not write the dataset " << dataset_path;
+
+	start(capacity, batch, period, state_size, label_size);
+
+}
+
+void DatabaseWriter::start(int capacity, int batch, double period, int state_size, int label_size)
+{
+
+	CHECK_GT(capacity, 0);
+	CHECK_GT(batch, 0);
+
+	batch_size = batch;
+	commit_period = period;
+
+	DatabaseRecord prototype;
+	prototype.state = std::vector<float>(state_size, 0);
+	prototype.label = std::vector<float>(label_size, 0);
+	queue.reset(new SpscRing<DatabaseRecord>(capacity + 1, prototype));
+
+	stop = false;
+	dropped_ = 0;
+	committed_ = 0;
+	pending = commits = max_depth = 0;
+	commit_time = max_commit_time = 0;
+	reported_drops = 0;
+
+	writer_thread = boost::thread(&DatabaseWriter::writer, this);
+
+}
+
+DatabaseRecord* DatabaseWriter::Reserve()
+{
+
+	DatabaseRecord* record = queue->Reserve();
+	if( !record ) {
+		dropped_++;
+		sem_post(&records_queued);
+	}
+	return record;
+
+}
+
+void DatabaseWriter::Close()
+{
+
+	if( !states_database && !dataset )
+		return;
+
+	stop = true;
+	sem_post(&records_queued);
+	if( writer_thread.joinable() )
+		writer_thread.join();
+
+	// uncommitted transactions are empty, the databases close on destruction
+	states_txn.reset();
+	labels_txn.reset();
+	states_database.reset();
+	labels_database.reset();
+
+	if( dataset ) {
+		dataset->Close();
+		dataset.reset();
+	}
+
+	LOG(INFO) << "Database writer closed: " << committed_.load() << " records committed, "
+		  << dropped_.load() << " dropped";
+
+}
+
+void DatabaseWriter::writer()
+{
+
+	while( true ) {
+
+		wait();
+
+		bool stopping = stop;
+
+		max_depth = std::max(max_depth, queue->size());
+
+		for(DatabaseRecord* record = queue->Front(); record; record = queue->Front()) {
+
+			put(*record);
+			queue->Pop();
+
+			if( pending == batch_size )
+				commit();
+		}
+
+		unsigned long drops = dropped_;
+		if( drops > reported_drops ) {
+			LOG(WARNING) << "Database writer: queue of " << queue->capacity() - 1 << " records full, "
+				     << drops - reported_drops << " records dropped (" << drops << " in total)";
+			reported_drops = drops;
+		}
+
+		// a slow recording still reaches the disk every commit_period
+		if( pending > 0 && (stopping || seconds() - first_pending >= commit_period) )
+			commit();
+
+		if( stopping )
+			break;
+	}
+
+}
+
+void DatabaseWriter::wait()
+{
+
+	if( pending == 0 ) {
+		while( sem_wait(&records_queued) != 0 && errno == EINTR )
+			;
+		return;
+	}
+
+	double remaining = first_pending + commit_period - seconds();
+	if( remaining <= 0 )
+		return;
+
+	// sem_timedwait takes an absolute CLOCK_REALTIME deadline
+	timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	long nanoseconds = deadline.tv_nsec + long(1e9 * (remaining - long(remaining)));
+	deadline.tv_sec += long(remaining) + nanoseconds / 1000000000;
+	deadline.tv_nsec = nanoseconds % 1000000000;
+
+	while( sem_timedwait(&records_queued, &deadline) != 0 && errno == EINTR )
+		;
+
+}
+
+void DatabaseWriter::put(const DatabaseRecord& record)
+{
+
+	string key = caffe::format_int(record.key, 8);
+	string value;
+
+	if( dataset )
+		dataset->Append(&record.state[0], &record.label[0], record.episode, record.stamp);
+	else if( !labels_database ) {
+		EncodeStepRecord(&record.state[0], record.state.size(), &record.label[0], record.label.size(),
+				 record.episode, record.stamp, &value);
+		states_txn->Put(key, value);
+	}
+	else {
+		EncodeDatum(&record.state[0], record.state.size(), &value);
+		states_txn->Put(key, value);
+
+		// same key as the state: consistent access to both databases
+		EncodeDatum(&record.label[0], record.label.size(), &value);
+		labels_txn->Put(key, value);
+	}
+
+	if( pending++ == 0 )
+		first_pending = seconds();
+
+}
+
+void DatabaseWriter::commit()
+{
+
+	double start = seconds();
+
+	if( dataset )
+		dataset->Flush();
+	else {
+		states_txn->Commit();
+		states_txn.reset(states_database->NewTransaction());
+	}
+
+	if( labels_database ) {
+		labels_txn->Commit();
+		labels_txn.reset(labels_database->NewTransaction());
+	}
+
+	double elapsed = seconds() - start;
+
+	committed_ += pending;
+	pending = 0;
+
+	commits++;
+	commit_time += elapsed;
+	max_commit_time = std::max(max_commit_time, elapsed);
+	// the records queued while committing: the deepest the queue gets
+	max_depth = std::max(max_depth, queue->size());
+
+	if( commits == kReportCommits ) {
+		LOG(INFO) << "Database writer: " << committed_.load() << " records committed, commit latency mean "
+			  << 1e3 * commit_time / commits << " ms max " << 1e3 * max_commit_time << " ms, queue depth max "
+			  << max_depth << " of " << queue->capacity() - 1 << ", " << dropped_.load() << " records dropped";
+		commits = max_depth = 0;
+		commit_time = max_commit_time = 0;
+	}
+
+}
+
+
+} // namespace neural_network_planner
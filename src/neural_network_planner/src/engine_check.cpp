@@ -0,0 +1,101 @@
+// compares the caffe free inference engine against caffe CPU forward
+// usage: engine_check deploy.prototxt weights.caffemodel [time_sequence] [trials] [averaged_ranges_size]
+
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/state_features.h>
+
+#include <caffe/caffe.hpp>
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using boost::lexical_cast;
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s deploy.prototxt weights.caffemodel [time_sequence] [trials] [averaged_ranges_size]\n", argv[0]);
+		return 1;
+	}
+
+	int time_sequence = argc > 3 ? lexical_cast<int>(argv[3]) : 16;
+	int trials = argc > 4 ? lexical_cast<int>(argv[4]) : 100;
+	int averaged_ranges_size = argc > 5 ? lexical_cast<int>(argv[5]) : 24;
+	int state_sequence_size = neural_network_planner::state_size(averaged_ranges_size);
+
+	caffe::Caffe::set_mode(caffe::Caffe::CPU);
+	caffe::Net<float> net(argv[1], caffe::TEST);
+	net.CopyTrainedLayersFrom(argv[2]);
+
+	CHECK(net.has_blob("data"));
+	CHECK(net.has_blob("clip"));
+	CHECK(net.has_blob("out"));
+
+	boost::shared_ptr<caffe::Blob<float> > blobData = net.blob_by_name("data");
+	boost::shared_ptr<caffe::Blob<float> > blobClip = net.blob_by_name("clip");
+	boost::shared_ptr<caffe::Blob<float> > blobOut = net.blob_by_name("out");
+
+	std::vector<int> shape(2);
+	shape[0] = time_sequence;
+	shape[1] = state_sequence_size;
+	blobData->Reshape(shape);
+	blobClip->Reshape(shape);
+	net.Reshape();
+
+	neural_network_planner::LSTMEngine engine;
+	CHECK(engine.Load(argv[2], state_sequence_size, time_sequence)) << "engine can not load " << argv[2];
+	CHECK_EQ(engine.output_size(), blobOut->count(1));
+
+	std::vector<float> states(time_sequence * state_sequence_size);
+	std::vector<float> clip(time_sequence, 1);
+	clip[0] = 0;
+
+	double max_error = 0, sum_error = 0, max_output = 0;
+	int output_size = engine.output_size();
+
+	srand(1);
+
+	for(int trial = 0; trial < trials; trial++) {
+
+		// ranges and distance in meters, relative angle in radians
+		for(int t = 0; t < time_sequence; t++) {
+			float* state = &states[t * state_sequence_size];
+			for(int i = 0; i < averaged_ranges_size + 1; i++)
+				state[i] = 5.0 * rand() / RAND_MAX;
+			state[averaged_ranges_size + 1] = M_PI * rand() / RAND_MAX;
+		}
+
+		std::copy(states.begin(), states.end(), blobData->mutable_cpu_data());
+		for(int t = 0; t < time_sequence; t++)
+			std::fill(blobClip->mutable_cpu_data() + t * state_sequence_size,
+				  blobClip->mutable_cpu_data() + (t + 1) * state_sequence_size, clip[t]);
+
+		net.Forward();
+		engine.Forward(&states[0], &clip[0], time_sequence);
+
+		for(int t = 0; t < time_sequence; t++) {
+			for(int i = 0; i < output_size; i++) {
+				double reference = blobOut->cpu_data()[t * output_size + i];
+				double error = fabs(reference - engine.Output(t)[i]);
+				max_error = std::max(max_error, error);
+				max_output = std::max(max_output, fabs(reference));
+				sum_error += error;
+			}
+		}
+	}
+
+	printf("%s: %d windows of %d timesteps\n", net.name().c_str(), trials, time_sequence);
+	printf("max abs error %g  mean abs error %g  max abs output %g\n", max_error,
+	       sum_error / (trials * time_sequence * output_size), max_output);
+
+	return max_error < 1e-4 ? 0 : 1;
+
+}
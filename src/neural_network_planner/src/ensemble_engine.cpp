@@ -0,0 +1,169 @@
+#include <neural_network_planner/ensemble_engine.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+// the members agree on the output size, their outputs can be aggregated
+bool same_outputs(const vector<shared_ptr<LSTMEngine> >& engines)
+{
+
+	for(int m = 1; m < engines.size(); m++)
+		if( engines[m]->output_size() != engines[0]->output_size() ) {
+			LOG(ERROR) << "Ensemble member " << m << " (" << engines[m]->name() << ") has "
+				   << engines[m]->output_size() << " outputs, " << engines[0]->name()
+				   << " has " << engines[0]->output_size();
+			return false;
+		}
+
+	return true;
+
+}
+
+} // namespace
+
+
+EnsembleEngine::EnsembleEngine() : input_size_(0), output_size_(0), max_timesteps_(0)
+{
+
+}
+
+EnsembleEngine::~EnsembleEngine()
+{
+
+}
+
+bool EnsembleEngine::Load(const vector<string>& models, int input_size, int max_timesteps, const string& output_blob)
+{
+
+	engines.clear();
+
+	if( models.empty() ) {
+		LOG(ERROR) << "Ensemble without members";
+		return false;
+	}
+
+	for(int m = 0; m < models.size(); m++) {
+		engines.push_back(shared_ptr<LSTMEngine>(new LSTMEngine()));
+		if( !engines.back()->Load(models[m], input_size, max_timesteps, output_blob) ) {
+			LOG(ERROR) << "Ensemble member " << m << " (" << models[m] << ") can not be used";
+			engines.clear();
+			return false;
+		}
+	}
+
+	return Loaded(input_size, max_timesteps, output_blob);
+
+}
+
+bool EnsembleEngine::Load(const vector<NetDescription>& nets, int input_size, int max_timesteps, const string& output_blob)
+{
+
+	engines.clear();
+
+	if( nets.empty() ) {
+		LOG(ERROR) << "Ensemble without members";
+		return false;
+	}
+
+	for(int m = 0; m < nets.size(); m++) {
+		engines.push_back(shared_ptr<LSTMEngine>(new LSTMEngine()));
+		if( !engines.back()->Load(nets[m], input_size, max_timesteps, output_blob) ) {
+			LOG(ERROR) << "Ensemble member " << m << " (" << nets[m].name << ") can not be used";
+			engines.clear();
+			return false;
+		}
+	}
+
+	return Loaded(input_size, max_timesteps, output_blob);
+
+}
+
+bool EnsembleEngine::Loaded(int input_size, int max_timesteps, const string& output_blob)
+{
+
+	if( !same_outputs(engines) ) {
+		engines.clear();
+		return false;
+	}
+
+	input_size_ = input_size;
+	output_size_ = engines[0]->output_size();
+	max_timesteps_ = max_timesteps;
+	mean.assign(output_size_, 0.f);
+	deviation.assign(output_size_, 0.f);
+
+	LOG(INFO) << "Ensemble of " << engines.size() << " " << engines[0]->name() << ", "
+		  << output_size_ << " outputs of " << output_blob;
+
+	return true;
+
+}
+
+const float* EnsembleEngine::Forward(const float* states, const float* clip, int timesteps)
+{
+
+	DCHECK_LE(timesteps, max_timesteps_);
+
+	for(int m = 0; m < engines.size(); m++)
+		engines[m]->Forward(states, clip, timesteps);
+
+	return Aggregate(timesteps - 1);
+
+}
+
+const float* EnsembleEngine::Step(const float* state, bool sequence_start)
+{
+
+	for(int m = 0; m < engines.size(); m++)
+		engines[m]->Step(state, sequence_start);
+
+	return Aggregate(0);
+
+}
+
+const float* EnsembleEngine::Aggregate(int t)
+{
+
+	int K = engines.size();
+
+	for(int i = 0; i < output_size_; i++) {
+
+		double sum = 0, square_sum = 0;
+		for(int m = 0; m < K; m++) {
+			double y = engines[m]->Output(t)[i];
+			sum += y;
+			square_sum += y * y;
+		}
+
+		double average = sum / K;
+		mean[i] = average;
+		deviation[i] = sqrt(std::max(0.0, square_sum / K - average * average));
+	}
+
+	return &mean[0];
+
+}
+
+void EnsembleEngine::ResetState()
+{
+
+	for(int m = 0; m < engines.size(); m++)
+		engines[m]->ResetState();
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,214 @@
+// exports a trained snapshot for inference: drops the layers the output does not depend on,
+// folds BatchNorm (and Scale) into the following layers, writes the slim deploy prototxt
+// and caffemodel pair and checks it against the unfolded net with caffe and the engine
+// usage: export_model deploy.prototxt weights.caffemodel slim_deploy.prototxt slim.caffemodel
+//                     [time_sequence] [trials] [averaged_ranges_size] [output_blob]
+
+#include <neural_network_planner/input_normalization.h>
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/net_transforms.h>
+#include <neural_network_planner/state_features.h>
+
+#include <caffe/caffe.hpp>
+#include "caffe/util/io.hpp"
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using boost::lexical_cast;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+void reshape(caffe::Net<float>* net, int time_sequence, int state_sequence_size)
+{
+
+	vector<int> shape(2);
+	shape[0] = time_sequence;
+	shape[1] = state_sequence_size;
+	net->blob_by_name("data")->Reshape(shape);
+	net->blob_by_name("clip")->Reshape(shape);
+	net->Reshape();
+
+}
+
+void feed(caffe::Net<float>* net, const vector<float>& states, const vector<float>& clip, int state_sequence_size)
+{
+
+	std::copy(states.begin(), states.end(), net->blob_by_name("data")->mutable_cpu_data());
+	float* blob_clip = net->blob_by_name("clip")->mutable_cpu_data();
+	for(int t = 0; t < clip.size(); t++)
+		std::fill(blob_clip + t * state_sequence_size, blob_clip + (t + 1) * state_sequence_size, clip[t]);
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 5 ) {
+		printf("usage: %s deploy.prototxt weights.caffemodel slim_deploy.prototxt slim.caffemodel"
+		       " [time_sequence] [trials] [averaged_ranges_size] [output_blob]\n", argv[0]);
+		return 1;
+	}
+
+	int time_sequence = argc > 5 ? lexical_cast<int>(argv[5]) : 16;
+	int trials = argc > 6 ? lexical_cast<int>(argv[6]) : 100;
+	int averaged_ranges_size = argc > 7 ? lexical_cast<int>(argv[7]) : 24;
+	string output_blob = argc > 8 ? argv[8] : "out";
+	int state_sequence_size = state_size(averaged_ranges_size);
+
+	NetDescription net;
+	CHECK(ReadCaffeModel(argv[2], &net)) << "can not read " << argv[2];
+
+	// reference: the unfolded net, normalized with the moving averages as the exported one
+	NetDescription reference = net;
+	for(int i = 0; i < reference.layers.size(); i++) {
+		reference.layers[i].has_use_global_stats = true;
+		reference.layers[i].use_global_stats = true;
+	}
+
+	int trained_layers = net.layers.size();
+	CHECK(PruneNet(&net, output_blob)) << output_blob << " does not depend on the data blob";
+	int folded = FoldBatchNorm(&net);
+
+	// slim deploy: the layers left, with their parameters from the original deploy
+	caffe::NetParameter deploy;
+	caffe::ReadProtoFromTextFileOrDie(argv[1], &deploy);
+
+	// snapshots of a normalized training carry the input_norm layer the deploy may lack
+	if( net.layer_by_name(kInputNormLayer) && AddInputNormalization(&deploy) )
+		LOG(INFO) << "Input normalization of " << argv[2] << " added to the deploy net";
+
+	caffe::NetParameter slim = deploy;
+	slim.clear_layer();
+
+	for(int i = 0; i < deploy.layer_size(); i++) {
+
+		const caffe::LayerParameter& layer_param = deploy.layer(i);
+		const LayerDescription* desc = net.layer_by_name(layer_param.name());
+
+		if( layer_param.type() != "Input" && desc == NULL )
+			continue;
+
+		caffe::LayerParameter* exported = slim.add_layer();
+		exported->CopyFrom(layer_param);
+
+		if( desc == NULL )
+			continue;
+
+		exported->clear_bottom();
+		for(int j = 0; j < desc->bottom.size(); j++)
+			exported->add_bottom(desc->bottom[j]);
+
+		if( desc->type == "BatchNorm" )
+			exported->mutable_batch_norm_param()->set_use_global_stats(true);
+		if( desc->type == "InnerProduct" )
+			exported->mutable_inner_product_param()->set_bias_term(desc->blobs.size() > 1);
+	}
+
+	caffe::WriteProtoToTextFile(slim, argv[3]);
+
+	caffe::NetParameter slim_weights = slim;
+	for(int i = 0; i < slim_weights.layer_size(); i++) {
+
+		caffe::LayerParameter* layer_param = slim_weights.mutable_layer(i);
+		const LayerDescription* desc = net.layer_by_name(layer_param->name());
+		if( desc == NULL )
+			continue;
+
+		for(int j = 0; j < desc->blobs.size(); j++) {
+			caffe::BlobProto* blob = layer_param->add_blobs();
+			for(int k = 0; k < desc->blobs[j].shape.size(); k++)
+				blob->mutable_shape()->add_dim(desc->blobs[j].shape[k]);
+			for(int k = 0; k < desc->blobs[j].data.size(); k++)
+				blob->add_data(desc->blobs[j].data[k]);
+		}
+	}
+
+	caffe::WriteProtoToBinaryFile(slim_weights, argv[4]);
+
+	printf("%s: %d -> %d layers, %d BatchNorm folded\n", net.name.c_str(), trained_layers, int(net.layers.size()), folded);
+	printf("written %s and %s\n", argv[3], argv[4]);
+
+	// caffe: unfolded deploy with moving averages against the exported pair
+	caffe::Caffe::set_mode(caffe::Caffe::CPU);
+
+	caffe::NetParameter reference_param = deploy;
+	reference_param.mutable_state()->set_phase(caffe::TEST);
+	for(int i = 0; i < reference_param.layer_size(); i++)
+		if( reference_param.layer(i).type() == "BatchNorm" )
+			reference_param.mutable_layer(i)->mutable_batch_norm_param()->set_use_global_stats(true);
+
+	caffe::Net<float> reference_net(reference_param);
+	reference_net.CopyTrainedLayersFrom(argv[2]);
+
+	caffe::Net<float> exported_net(argv[3], caffe::TEST);
+	exported_net.CopyTrainedLayersFrom(argv[4]);
+
+	CHECK(exported_net.has_blob(output_blob));
+	reshape(&reference_net, time_sequence, state_sequence_size);
+	reshape(&exported_net, time_sequence, state_sequence_size);
+
+	// engine: the same check on the descriptions
+	LSTMEngine reference_engine, exported_engine;
+	CHECK(reference_engine.Load(reference, state_sequence_size, time_sequence, output_blob));
+	CHECK(exported_engine.Load(net, state_sequence_size, time_sequence, output_blob));
+
+	vector<float> states(time_sequence * state_sequence_size);
+	vector<float> clip(time_sequence, 1);
+	clip[0] = 0;
+
+	double caffe_error = 0, engine_error = 0, max_output = 0;
+	int output_size = exported_engine.output_size();
+
+	srand(1);
+
+	for(int trial = 0; trial < trials; trial++) {
+
+		// ranges and distance in meters, relative angle in radians
+		for(int t = 0; t < time_sequence; t++) {
+			float* state = &states[t * state_sequence_size];
+			for(int i = 0; i < averaged_ranges_size + 1; i++)
+				state[i] = 5.0 * rand() / RAND_MAX;
+			state[averaged_ranges_size + 1] = M_PI * rand() / RAND_MAX;
+		}
+
+		feed(&reference_net, states, clip, state_sequence_size);
+		feed(&exported_net, states, clip, state_sequence_size);
+		reference_net.Forward();
+		exported_net.Forward();
+
+		reference_engine.Forward(&states[0], &clip[0], time_sequence);
+		exported_engine.Forward(&states[0], &clip[0], time_sequence);
+
+		const float* reference_out = reference_net.blob_by_name(output_blob)->cpu_data();
+		const float* exported_out = exported_net.blob_by_name(output_blob)->cpu_data();
+
+		for(int t = 0; t < time_sequence; t++) {
+			for(int i = 0; i < output_size; i++) {
+				float r = reference_out[t * output_size + i];
+				caffe_error = std::max(caffe_error, double(fabs(r - exported_out[t * output_size + i])));
+				engine_error = std::max(engine_error, double(fabs(reference_engine.Output(t)[i] - exported_engine.Output(t)[i])));
+				max_output = std::max(max_output, double(fabs(r)));
+			}
+		}
+	}
+
+	printf("%d windows of %d timesteps, max abs output %g\n", trials, time_sequence, max_output);
+	printf("caffe max abs error %g  engine max abs error %g\n", caffe_error, engine_error);
+
+	// folding reorders float operations: relative tolerance
+	double tolerance = 1e-4 * std::max(1.0, max_output);
+	return caffe_error < tolerance && engine_error < tolerance ? 0 : 1;
+
+}
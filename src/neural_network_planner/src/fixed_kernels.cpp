@@ -0,0 +1,47 @@
+#include <neural_network_planner/fixed_kernels.h>
+
+
+namespace neural_network_planner {
+
+namespace kernels {
+
+
+namespace {
+
+struct FixedKernel
+{
+	int N, X, H;
+	LSTMStepKernel kernel;
+};
+
+/* the shipped nets: 26 streams (24 averaged ranges, distance and angle),
+ * one value per stream into the first LSTM, hidden values into the stacked ones,
+ * LSTM_stack-bn-7-24 and LSTM_stack-bn-7-128
+ */
+const FixedKernel kFixedKernels[] = {
+	{ 26, 1, 24, &FixedLSTM<26, 1, 24> },
+	{ 26, 24, 24, &FixedLSTM<26, 24, 24> },
+	{ 26, 1, 128, &FixedLSTM<26, 1, 128> },
+	{ 26, 128, 128, &FixedLSTM<26, 128, 128> },
+};
+
+} // namespace
+
+
+LSTMStepKernel FixedLSTMStep(int N, int X, int H)
+{
+
+	for(int i = 0; i < sizeof(kFixedKernels) / sizeof(kFixedKernels[0]); i++) {
+		const FixedKernel& fixed = kFixedKernels[i];
+		if( fixed.N == N && fixed.X == X && fixed.H == H )
+			return fixed.kernel;
+	}
+
+	return NULL;
+
+}
+
+
+} // namespace kernels
+
+} // namespace neural_network_planner
@@ -0,0 +1,246 @@
+#include <neural_network_planner/footprint_gate.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+using std::pair;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const unsigned char kNoInformation = 255;
+
+bool inside(const vector<pair<double, double> >& polygon, double x, double y)
+{
+
+	bool in = false;
+	for(int i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+		const pair<double, double>& a = polygon[i];
+		const pair<double, double>& b = polygon[j];
+		if( (a.second > y) != (b.second > y)
+		    && x < (b.first - a.first) * (y - a.second) / (b.second - a.second) + a.first )
+			in = !in;
+	}
+	return in;
+
+}
+
+double segment_distance(const pair<double, double>& a, const pair<double, double>& b, double x, double y)
+{
+
+	double dx = b.first - a.first, dy = b.second - a.second;
+	double length2 = dx * dx + dy * dy;
+	double t = length2 > 0 ? ((x - a.first) * dx + (y - a.second) * dy) / length2 : 0;
+	t = std::max(0.0, std::min(1.0, t));
+	return hypot(a.first + t * dx - x, a.second + t * dy - y);
+
+}
+
+// any of the n costs blocks: >= lethal, NO_INFORMATION only if unknown_is_lethal
+bool span_blocked(const unsigned char* costs, int n, unsigned char lethal, bool unknown_is_lethal)
+{
+
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i threshold = _mm_set1_epi8(char(lethal));
+	const __m128i unknown = _mm_set1_epi8(char(kNoInformation));
+
+	for(; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(costs + i));
+		// unsigned v >= lethal: max(v, lethal) == v
+		__m128i blocked = _mm_cmpeq_epi8(_mm_max_epu8(v, threshold), v);
+		if( !unknown_is_lethal )
+			blocked = _mm_andnot_si128(_mm_cmpeq_epi8(v, unknown), blocked);
+		if( _mm_movemask_epi8(blocked) )
+			return true;
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint8x16_t threshold = vdupq_n_u8(lethal);
+	const uint8x16_t unknown = vdupq_n_u8(kNoInformation);
+
+	for(; i + 16 <= n; i += 16) {
+		uint8x16_t v = vld1q_u8(costs + i);
+		uint8x16_t blocked = vcgeq_u8(v, threshold);
+		if( !unknown_is_lethal )
+			blocked = vbicq_u8(blocked, vceqq_u8(v, unknown));
+		uint8x8_t any = vorr_u8(vget_low_u8(blocked), vget_high_u8(blocked));
+		if( vget_lane_u64(vreinterpret_u64_u8(any), 0) )
+			return true;
+	}
+#endif
+
+	for(; i < n; i++)
+		if( costs[i] >= lethal && (unknown_is_lethal || costs[i] != kNoInformation) )
+			return true;
+
+	return false;
+
+}
+
+} // namespace
+
+
+FootprintGate::FootprintGate() : resolution(0), lethal_cost(254), unknown_is_lethal(false)
+{
+
+}
+
+void FootprintGate::Init(const vector<pair<double, double> >& footprint, double map_resolution, int headings,
+			 unsigned char lethal, bool unknown_lethal)
+{
+
+	CHECK_GE(footprint.size(), 3) << "footprint must be a polygon";
+	CHECK_GT(map_resolution, 0);
+	CHECK_GT(headings, 0);
+
+	resolution = map_resolution;
+	lethal_cost = lethal;
+	unknown_is_lethal = unknown_lethal;
+
+	// the robot is anywhere in its cell: cells within half a cell diagonal of the footprint belong to it
+	double tolerance = 0.5 * M_SQRT2 * resolution;
+
+	double reach = 0;
+	for(int i = 0; i < footprint.size(); i++)
+		reach = std::max(reach, hypot(footprint[i].first, footprint[i].second));
+	int cells = ceil((reach + tolerance) / resolution);
+
+	masks.assign(headings, vector<Span>());
+
+	for(int h = 0; h < headings; h++) {
+
+		double angle = 2 * M_PI * h / headings;
+		double c = cos(angle), s = sin(angle);
+
+		vector<pair<double, double> > polygon(footprint.size());
+		for(int i = 0; i < footprint.size(); i++)
+			polygon[i] = std::make_pair(c * footprint[i].first - s * footprint[i].second,
+						    s * footprint[i].first + c * footprint[i].second);
+
+		for(int dy = -cells; dy <= cells; dy++) {
+
+			Span span;
+			span.dy = dy;
+			span.x0 = cells + 1;
+			span.x1 = -cells - 1;
+
+			for(int dx = -cells; dx <= cells; dx++) {
+
+				double x = dx * resolution, y = dy * resolution;
+				bool covered = inside(polygon, x, y);
+
+				for(int i = 0, j = polygon.size() - 1; !covered && i < polygon.size(); j = i++)
+					covered = segment_distance(polygon[j], polygon[i], x, y) <= tolerance;
+
+				if( covered ) {
+					span.x0 = std::min(span.x0, dx);
+					span.x1 = std::max(span.x1, dx);
+				}
+			}
+
+			if( span.x0 <= span.x1 )
+				masks[h].push_back(span);
+		}
+	}
+
+	int mask_cells = 0;
+	for(int i = 0; i < masks[0].size(); i++)
+		mask_cells += masks[0][i].x1 - masks[0][i].x0 + 1;
+
+	LOG(INFO) << "Footprint gate: " << headings << " headings, " << masks[0].size() << " rows and "
+		  << mask_cells << " cells per mask at " << resolution << " m";
+
+}
+
+int FootprintGate::heading(double theta) const
+{
+
+	int headings = masks.size();
+	int h = int(floor(theta / (2 * M_PI) * headings + 0.5)) % headings;
+	return h < 0 ? h + headings : h;
+
+}
+
+bool FootprintGate::Blocked(const CostGrid& grid, double x, double y, double theta) const
+{
+
+	DCHECK(fabs(grid.resolution - resolution) < 1e-6) << "costmap resolution changed since Init";
+
+	int cx = int(floor((x - grid.origin_x) / grid.resolution));
+	int cy = int(floor((y - grid.origin_y) / grid.resolution));
+
+	const vector<Span>& mask = masks[heading(theta)];
+
+	// cells outside the map, a rolling window around the robot, are not known to be blocked
+	for(int i = 0; i < mask.size(); i++) {
+
+		int row = cy + mask[i].dy;
+		if( row < 0 || row >= grid.size_y )
+			continue;
+
+		int x0 = std::max(cx + mask[i].x0, 0);
+		int x1 = std::min(cx + mask[i].x1, grid.size_x - 1);
+
+		if( x0 <= x1 && span_blocked(grid.costs + row * grid.size_x + x0, x1 - x0 + 1, lethal_cost, unknown_is_lethal) )
+			return true;
+	}
+
+	return false;
+
+}
+
+double FootprintGate::CollisionTime(const CostGrid& grid, double x, double y, double theta,
+				    double linear, double angular, double sim_time, double sim_granularity) const
+{
+
+	// the current pose is not checked: a robot touching inflation can still move away
+	for(double t = sim_granularity; t <= sim_time + 1e-9; t += sim_granularity) {
+
+		x += linear * cos(theta) * sim_granularity;
+		y += linear * sin(theta) * sim_granularity;
+		theta += angular * sim_granularity;
+
+		if( Blocked(grid, x, y, theta) )
+			return t;
+	}
+
+	return -1;
+
+}
+
+bool FootprintGate::Filter(const CostGrid& grid, double x, double y, double theta, double sim_time, double sim_granularity,
+			   double* linear, double* angular) const
+{
+
+	for(double fraction = 1; fraction >= 0.125; fraction *= 0.5) {
+		if( CollisionTime(grid, x, y, theta, fraction * *linear, *angular, sim_time, sim_granularity) < 0 ) {
+			*linear *= fraction;
+			return true;
+		}
+	}
+
+	if( CollisionTime(grid, x, y, theta, 0, *angular, sim_time, sim_granularity) < 0 ) {
+		*linear = 0;
+		return true;
+	}
+
+	return false;
+
+}
+
+
+} // namespace neural_network_planner
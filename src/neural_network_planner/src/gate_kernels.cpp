@@ -0,0 +1,240 @@
+#include <neural_network_planner/gate_kernels.h>
+#include <neural_network_planner/simd_math.h>
+
+#include <cmath>
+#include <cstring>
+
+
+namespace neural_network_planner {
+
+namespace kernels {
+
+
+namespace {
+
+inline float sigmoid(float x) { return 1. / (1. + exp(-x)); }
+
+// caffe reference formulation, used for scalar code and vector tails
+inline void unit_scalar(const float* gates, int H, int d, float cont, const float* c_prev, float* c, float* h)
+{
+
+	float i = sigmoid(gates[d]);
+	float f = cont == 0 ? 0 : cont * sigmoid(gates[H + d]);
+	float o = sigmoid(gates[2 * H + d]);
+	float g = tanh(gates[3 * H + d]);
+
+	float cell = i * g;
+	if( cont != 0 )
+		cell += f * c_prev[d];
+
+	c[d] = cell;
+	h[d] = o * tanh(cell);
+
+}
+
+} // namespace
+
+
+#if defined(__AVX2__) && defined(__FMA__)
+const char* InstructionSet() { return "AVX2"; }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+const char* InstructionSet() { return "NEON"; }
+#else
+const char* InstructionSet() { return "scalar"; }
+#endif
+
+
+#if defined(__AVX2__) && defined(__FMA__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+using namespace simd;
+
+namespace {
+
+inline vfloat vweights(const float* p) { return vload(p); }
+inline vfloat vweights(const int8_t* p) { return vload_int8(p); }
+
+/* register block of S input rows times V output vectors,
+ * weights are loaded once for all the S rows,
+ * quantized weights are scaled once at the end of the product
+ */
+template<int S, int V, typename W>
+inline void gemm_block(const W* Wt, const float* scale, const float* bias, const float* Z, int ldz,
+		       int K, int M, float* Y, int ldy, int m0)
+{
+
+	vfloat acc[S][V];
+
+	for(int v = 0; v < V; v++) {
+		vfloat b = bias && !scale ? vload(bias + m0 + v * kLanes) : vzero();
+		for(int s = 0; s < S; s++)
+			acc[s][v] = b;
+	}
+
+	const W* w_row = Wt + m0;
+
+	for(int k = 0; k < K; k++, w_row += M) {
+
+		vfloat w[V];
+		for(int v = 0; v < V; v++)
+			w[v] = vweights(w_row + v * kLanes);
+
+		for(int s = 0; s < S; s++) {
+			vfloat z = vbroadcast(Z + s * ldz + k);
+			for(int v = 0; v < V; v++)
+				acc[s][v] = vfma(z, w[v], acc[s][v]);
+		}
+	}
+
+	if( scale ) {
+		for(int v = 0; v < V; v++) {
+			vfloat a = vload(scale + m0 + v * kLanes);
+			vfloat b = bias ? vload(bias + m0 + v * kLanes) : vzero();
+			for(int s = 0; s < S; s++)
+				acc[s][v] = vfma(acc[s][v], a, b);
+		}
+	}
+
+	for(int s = 0; s < S; s++)
+		for(int v = 0; v < V; v++)
+			vstore(Y + s * ldy + m0 + v * kLanes, acc[s][v]);
+
+}
+
+// 16 floats per block, 8 floats tail (widths are multiple of kPadding)
+const int kBlockVectors = 16 / kLanes;
+const int kTailVectors = 8 / kLanes;
+
+template<int S, typename W>
+inline void gemm_rows(const W* Wt, const float* scale, const float* bias, const float* Z, int ldz,
+		      int K, int M, float* Y, int ldy)
+{
+
+	int m0 = 0;
+	for(; m0 + 16 <= M; m0 += 16)
+		gemm_block<S, kBlockVectors>(Wt, scale, bias, Z, ldz, K, M, Y, ldy, m0);
+
+	if( m0 < M )
+		gemm_block<S, kTailVectors>(Wt, scale, bias, Z, ldz, K, M, Y, ldy, m0);
+
+}
+
+template<typename W>
+inline void gemm(const W* Wt, const float* scale, const float* bias, const float* Z, int ldz,
+		 int rows, int K, int M, float* Y, int ldy)
+{
+
+	int s = 0;
+	for(; s + 4 <= rows; s += 4)
+		gemm_rows<4>(Wt, scale, bias, Z + s * ldz, ldz, K, M, Y + s * ldy, ldy);
+
+	switch( rows - s ) {
+	  case 3: gemm_rows<3>(Wt, scale, bias, Z + s * ldz, ldz, K, M, Y + s * ldy, ldy); break;
+	  case 2: gemm_rows<2>(Wt, scale, bias, Z + s * ldz, ldz, K, M, Y + s * ldy, ldy); break;
+	  case 1: gemm_rows<1>(Wt, scale, bias, Z + s * ldz, ldz, K, M, Y + s * ldy, ldy); break;
+	  default: break;
+	}
+
+}
+
+} // namespace
+
+void GemmT(const float* Wt, const float* bias, const float* Z, int ldz,
+	   int rows, int K, int M, float* Y, int ldy)
+{
+	gemm(Wt, (const float*) NULL, bias, Z, ldz, rows, K, M, Y, ldy);
+}
+
+void GemmT8(const int8_t* Wq, const float* scale, const float* bias, const float* Z, int ldz,
+	    int rows, int K, int M, float* Y, int ldy)
+{
+	gemm(Wq, scale, bias, Z, ldz, rows, K, M, Y, ldy);
+}
+
+void LSTMUnit(const float* gates, int H, float cont, const float* c_prev, float* c, float* h)
+{
+
+	vfloat v_cont = vset(cont);
+	int d = 0;
+
+	for(; d + kLanes <= H; d += kLanes) {
+
+		vfloat i = vsigmoid(vloadu(gates + d));
+		vfloat o = vsigmoid(vloadu(gates + 2 * H + d));
+		vfloat g = vtanh(vloadu(gates + 3 * H + d));
+
+		vfloat cell = vmul(i, g);
+		if( cont != 0 ) {
+			vfloat f = vmul(v_cont, vsigmoid(vloadu(gates + H + d)));
+			cell = vfma(f, vloadu(c_prev + d), cell);
+		}
+
+		vstoreu(c + d, cell);
+		vstoreu(h + d, vmul(o, vtanh(cell)));
+	}
+
+	for(; d < H; d++)
+		unit_scalar(gates, H, d, cont, c_prev, c, h);
+
+}
+
+#else
+
+void GemmT(const float* Wt, const float* bias, const float* Z, int ldz,
+	   int rows, int K, int M, float* Y, int ldy)
+{
+
+	for(int s = 0; s < rows; s++) {
+
+		float* y = Y + s * ldy;
+		const float* z = Z + s * ldz;
+
+		for(int m = 0; m < M; m++)
+			y[m] = bias ? bias[m] : 0;
+
+		for(int k = 0; k < K; k++) {
+			const float* w_row = Wt + k * M;
+			for(int m = 0; m < M; m++)
+				y[m] += z[k] * w_row[m];
+		}
+	}
+
+}
+
+void GemmT8(const int8_t* Wq, const float* scale, const float* bias, const float* Z, int ldz,
+	    int rows, int K, int M, float* Y, int ldy)
+{
+
+	for(int s = 0; s < rows; s++) {
+
+		float* y = Y + s * ldy;
+		const float* z = Z + s * ldz;
+
+		for(int m = 0; m < M; m++)
+			y[m] = 0;
+
+		for(int k = 0; k < K; k++) {
+			const int8_t* w_row = Wq + k * M;
+			for(int m = 0; m < M; m++)
+				y[m] += z[k] * w_row[m];
+		}
+
+		for(int m = 0; m < M; m++)
+			y[m] = y[m] * scale[m] + (bias ? bias[m] : 0);
+	}
+
+}
+
+void LSTMUnit(const float* gates, int H, float cont, const float* c_prev, float* c, float* h)
+{
+
+	for(int d = 0; d < H; d++)
+		unit_scalar(gates, H, d, cont, c_prev, c, h);
+
+}
+
+#endif
+
+
+} // namespace kernels
+
+} // namespace neural_network_planner
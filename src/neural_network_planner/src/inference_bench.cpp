@@ -0,0 +1,288 @@
+// replays recorded states of BuildDatabase through a trained model, one step at a time
+// as the stateful planner does: throughput, per step latency and error against the recorded labels
+// usage: nn_inference_bench steps labels_db weights [engine] [threads] [max_steps]
+//                           [sequence_length] [averaged_ranges_size] [backend] [deploy.prototxt]
+// steps: states_db of a split recording, or a unified steps_db or .nnd dataset with labels_db -
+// engine: native (.caffemodel, .nnq, .nnw), int8 (.nnq of quantize_model or int8 .nnw) or caffe (needs deploy.prototxt)
+// threads > 1 split the recording in contiguous parts, one engine per thread, each part a new sequence
+
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/mapped_model.h>
+#include <neural_network_planner/quantized_model.h>
+#include <neural_network_planner/state_features.h>
+#include <neural_network_planner/step_database.h>
+
+#include <caffe/caffe.hpp>
+
+#include "boost/scoped_ptr.hpp"
+
+#include "glog/logging.h"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+using boost::lexical_cast;
+using boost::scoped_ptr;
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+double seconds()
+{
+
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+
+}
+
+
+// one timestep of the evaluated net, states carried between calls
+class StepRunner
+{
+
+public:
+
+	virtual ~StepRunner() {}
+
+	virtual const float* Step(const float* state, bool sequence_start) = 0;
+
+};
+
+class EngineRunner : public StepRunner
+{
+
+public:
+
+	bool Load(const string& weights, int state_sequence_size) {
+		return engine.Load(weights, state_sequence_size, 1) && engine.output_size() == 2;
+	}
+
+	const float* Step(const float* state, bool sequence_start) {
+		return engine.Step(state, sequence_start);
+	}
+
+private:
+
+	LSTMEngine engine;
+
+};
+
+// caffe recurrent layers carry their last hidden states over to the next Forward, clip 0 clears them
+class CaffeRunner : public StepRunner
+{
+
+public:
+
+	CaffeRunner(const string& deploy, const string& weights, int state_sequence_size)
+		: net(deploy, caffe::TEST), size(state_sequence_size) {
+
+		net.CopyTrainedLayersFrom(weights);
+
+		CHECK(net.has_blob("data"));
+		CHECK(net.has_blob("clip"));
+		CHECK(net.has_blob("out"));
+
+		blobData = net.blob_by_name("data");
+		blobClip = net.blob_by_name("clip");
+		blobOut = net.blob_by_name("out");
+
+		vector<int> shape(2);
+		shape[0] = 1;
+		shape[1] = size;
+		blobData->Reshape(shape);
+		blobClip->Reshape(shape);
+		net.Reshape();
+
+		CHECK_EQ(blobOut->count(), 2) << "network output must be linear and angular velocity";
+	}
+
+	const float* Step(const float* state, bool sequence_start) {
+		std::copy(state, state + size, blobData->mutable_cpu_data());
+		std::fill(blobClip->mutable_cpu_data(), blobClip->mutable_cpu_data() + size, sequence_start ? 0.f : 1.f);
+		net.Forward();
+		return blobOut->cpu_data();
+	}
+
+private:
+
+	caffe::Net<float> net;
+	int size;
+
+	shared_ptr<caffe::Blob<float> > blobData, blobClip, blobOut;
+
+};
+
+
+struct BenchPart
+{
+	int first, steps;
+	vector<double> latencies;
+	double squared_error, absolute_error[2];
+	double elapsed;
+};
+
+struct BenchSetup
+{
+	string engine, weights, deploy;
+	int state_sequence_size, sequence_length;
+	const vector<float>* states;
+	const vector<float>* labels;
+};
+
+void run_part(const BenchSetup& setup, BenchPart* part)
+{
+
+	scoped_ptr<StepRunner> runner;
+
+	if( setup.engine == "caffe" ) {
+		caffe::Caffe::set_mode(caffe::Caffe::CPU);
+		runner.reset(new CaffeRunner(setup.deploy, setup.weights, setup.state_sequence_size));
+	}
+	else {
+		EngineRunner* engine = new EngineRunner();
+		runner.reset(engine);
+		CHECK(engine->Load(setup.weights, setup.state_sequence_size)) << "engine can not use " << setup.weights;
+	}
+
+	part->latencies.resize(part->steps);
+	part->squared_error = part->absolute_error[0] = part->absolute_error[1] = 0;
+
+	double start = seconds();
+
+	for(int s = 0; s < part->steps; s++) {
+
+		int step = part->first + s;
+		const float* state = &(*setup.states)[step * setup.state_sequence_size];
+		const float* label = &(*setup.labels)[step * 2];
+
+		// sequence_length as the planner, 0 a single sequence per part
+		bool sequence_start = setup.sequence_length > 0 ? s % setup.sequence_length == 0 : s == 0;
+
+		double before = seconds();
+		const float* out = runner->Step(state, sequence_start);
+		part->latencies[s] = seconds() - before;
+
+		for(int i = 0; i < 2; i++) {
+			double error = out[i] - label[i];
+			part->squared_error += error * error;
+			part->absolute_error[i] += fabs(error);
+		}
+	}
+
+	part->elapsed = seconds() - start;
+
+}
+
+double percentile(vector<double>* values, double p)
+{
+
+	size_t n = std::min(values->size() - 1, size_t(p * values->size()));
+	std::nth_element(values->begin(), values->begin() + n, values->end());
+	return (*values)[n];
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 4 ) {
+		printf("usage: %s steps labels_db weights [engine] [threads] [max_steps]"
+		       " [sequence_length] [averaged_ranges_size] [backend] [deploy.prototxt]\n", argv[0]);
+		return 1;
+	}
+
+	BenchSetup setup;
+	setup.weights = argv[3];
+	setup.engine = argc > 4 ? argv[4] : "native";
+	int threads = argc > 5 ? lexical_cast<int>(argv[5]) : 1;
+	int max_steps = argc > 6 ? lexical_cast<int>(argv[6]) : 1000000;
+	setup.sequence_length = argc > 7 ? lexical_cast<int>(argv[7]) : 0;
+	int averaged_ranges_size = argc > 8 ? lexical_cast<int>(argv[8]) : 24;
+	string backend = argc > 9 ? argv[9] : "lmdb";
+	setup.deploy = argc > 10 ? argv[10] : "";
+	setup.state_sequence_size = state_size(averaged_ranges_size);
+
+	CHECK(setup.engine == "native" || setup.engine == "int8" || setup.engine == "caffe") << "unknown engine " << setup.engine;
+	CHECK(setup.engine != "caffe" || !setup.deploy.empty()) << "caffe engine needs the deploy.prototxt";
+	CHECK_GE(threads, 1);
+
+	if( setup.engine == "int8" ) {
+		bool quantized = IsQuantizedModel(setup.weights);
+		NetDescription net;
+		MappedModel mapped;
+		if( !quantized && IsMappedModel(setup.weights) && mapped.Open(setup.weights, &net) )
+			for(int i = 0; i < net.layers.size(); i++)
+				quantized = quantized || mapped.has(net.layers[i].name + "/Wq");
+		CHECK(quantized) << setup.weights << " has no int8 weights, see quantize_model and convert_model";
+	}
+
+	// labels of a split recording in their own database
+	vector<float> states, labels;
+	string labels_path = argv[2];
+	int steps;
+	if( labels_path == "-" )
+		steps = ReadSteps(argv[1], backend, max_steps, setup.state_sequence_size, &states, 2, &labels);
+	else {
+		steps = ReadSteps(argv[1], backend, max_steps, setup.state_sequence_size, &states, 2, NULL);
+		CHECK_EQ(ReadSteps(labels_path, backend, steps, setup.state_sequence_size, NULL, 2, &labels), steps)
+			<< "states and labels databases differ in size";
+	}
+	CHECK_GE(steps, threads) << "less recorded steps than threads";
+
+	setup.states = &states;
+	setup.labels = &labels;
+
+	vector<BenchPart> parts(threads);
+	for(int p = 0; p < threads; p++) {
+		parts[p].first = long(steps) * p / threads;
+		parts[p].steps = long(steps) * (p + 1) / threads - parts[p].first;
+	}
+
+	double start = seconds();
+
+	if( threads == 1 )
+		run_part(setup, &parts[0]);
+	else {
+		boost::thread_group group;
+		for(int p = 0; p < threads; p++)
+			group.create_thread(boost::bind(&run_part, boost::cref(setup), &parts[p]));
+		group.join_all();
+	}
+
+	double elapsed = seconds() - start;
+
+	vector<double> latencies;
+	double squared_error = 0, absolute_error[2] = { 0, 0 }, busy = 0;
+	for(int p = 0; p < threads; p++) {
+		latencies.insert(latencies.end(), parts[p].latencies.begin(), parts[p].latencies.end());
+		squared_error += parts[p].squared_error;
+		absolute_error[0] += parts[p].absolute_error[0];
+		absolute_error[1] += parts[p].absolute_error[1];
+		busy = std::max(busy, parts[p].elapsed);
+	}
+
+	printf("%s on %s (%s engine): %d steps, %d threads, sequence length %d\n", setup.weights.c_str(), argv[1],
+	       setup.engine.c_str(), steps, threads, setup.sequence_length);
+	printf("throughput %.0f steps/sec (%.0f steps/sec per thread), wall %.3f sec\n", steps / busy, steps / busy / threads, elapsed);
+	printf("latency p50 %.2f us  p99 %.2f us  p999 %.2f us  max %.2f us\n", 1e6 * percentile(&latencies, 0.5),
+	       1e6 * percentile(&latencies, 0.99), 1e6 * percentile(&latencies, 0.999), 1e6 * percentile(&latencies, 1.0));
+	printf("labels: euclidean loss %g, mean abs error linear %g angular %g\n", squared_error / (2 * steps),
+	       absolute_error[0] / steps, absolute_error[1] / steps);
+
+	return 0;
+
+}
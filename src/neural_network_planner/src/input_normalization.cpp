@@ -0,0 +1,195 @@
+#include <neural_network_planner/input_normalization.h>
+#include <neural_network_planner/step_dataset.h>
+#include <neural_network_planner/step_record.h>
+
+#include "boost/scoped_ptr.hpp"
+#include "caffe/util/db.hpp"
+
+#include "glog/logging.h"
+
+
+using boost::scoped_ptr;
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+const char* const kInputNormLayer = "input_norm";
+
+
+namespace {
+
+bool produces(const caffe::LayerParameter& layer, const string& blob)
+{
+
+	for(int i = 0; i < layer.top_size(); i++)
+		if( layer.top(i) == blob )
+			return true;
+	return false;
+
+}
+
+} // namespace
+
+
+bool AddInputNormalization(caffe::NetParameter* net_param)
+{
+
+	int last_input = -1;
+	for(int i = 0; i < net_param->layer_size(); i++) {
+		if( net_param->layer(i).name() == kInputNormLayer )
+			return false;
+		if( produces(net_param->layer(i), "data") )
+			last_input = i;
+	}
+
+	if( last_input < 0 )
+		return false;
+
+	for(int i = last_input + 1; i < net_param->layer_size(); i++) {
+		caffe::LayerParameter* layer = net_param->mutable_layer(i);
+		for(int j = 0; j < layer->bottom_size(); j++)
+			if( layer->bottom(j) == "data" )
+				layer->set_bottom(j, kInputNormLayer);
+	}
+
+	caffe::LayerParameter* norm = net_param->add_layer();
+	norm->set_name(kInputNormLayer);
+	norm->set_type("BatchNorm");
+	norm->add_bottom("data");
+	norm->add_top(kInputNormLayer);
+	norm->mutable_batch_norm_param()->set_use_global_stats(true);
+
+	// mean, variance and scale factor are set once from the database, never learned
+	for(int j = 0; j < 3; j++) {
+		caffe::ParamSpec* param = norm->add_param();
+		param->set_lr_mult(0);
+		param->set_decay_mult(0);
+	}
+
+	for(int i = net_param->layer_size() - 1; i > last_input + 1; i--)
+		net_param->mutable_layer()->SwapElements(i, i - 1);
+
+	return true;
+
+}
+
+bool TrainingDatabase(const caffe::NetParameter& net_param, string* source, string* backend)
+{
+
+	for(int i = 0; i < net_param.layer_size(); i++) {
+
+		const caffe::LayerParameter& layer = net_param.layer(i);
+		if( (layer.type() != "Data" && layer.type() != "StepData" && layer.type() != "MappedData") || !produces(layer, "data") )
+			continue;
+
+		bool test_only = false;
+		for(int j = 0; j < layer.include_size(); j++)
+			test_only = test_only || (layer.include(j).has_phase() && layer.include(j).phase() == caffe::TEST);
+		if( test_only )
+			continue;
+
+		*source = layer.data_param().source();
+		if( layer.type() == "MappedData" )
+			*backend = "mapped";
+		else
+			*backend = layer.data_param().backend() == caffe::DataParameter_DB_LEVELDB ? "leveldb" : "lmdb";
+		return true;
+	}
+
+	return false;
+
+}
+
+long InputStatistics(const string& source, const string& backend, int channels, long max_samples,
+		     vector<double>* mean, vector<double>* variance)
+{
+
+	// a .nnd dataset carries the statistics of all its states
+	if( backend == "mapped" ) {
+		StepDataset dataset;
+		CHECK(dataset.Open(source)) << "input normalization: can not read " << source;
+		CHECK_EQ(dataset.state_size(), channels) << "unexpected state size in " << source;
+		mean->assign(dataset.mean(), dataset.mean() + channels);
+		variance->assign(dataset.variance(), dataset.variance() + channels);
+		return dataset.count();
+	}
+
+	scoped_ptr<caffe::db::DB> database(caffe::db::GetDB(backend));
+	database->Open(source, caffe::db::READ);
+	scoped_ptr<caffe::db::Cursor> cursor(database->NewCursor());
+
+	mean->assign(channels, 0);
+	variance->assign(channels, 0);
+
+	// running mean and sum of squared deviations, numerically stable on long recordings
+	vector<double>& m2 = *variance;
+	long samples = 0;
+	caffe::Datum datum;
+	StepRecord record;
+
+	for(; cursor->valid() && (max_samples <= 0 || samples < max_samples); cursor->Next()) {
+
+		// states of a unified steps database or of a states database
+		const float* state;
+		string value = cursor->value();
+		if( DecodeStepRecord(value, &record) ) {
+			CHECK_EQ(record.header->state_size, channels) << "unexpected state size in " << source;
+			state = record.state;
+		}
+		else {
+			datum.ParseFromString(value);
+			CHECK_EQ(datum.float_data_size(), channels) << "unexpected datum size in " << source;
+			state = datum.float_data().data();
+		}
+
+		samples++;
+		for(int c = 0; c < channels; c++) {
+			double value = state[c];
+			double delta = value - (*mean)[c];
+			(*mean)[c] += delta / samples;
+			m2[c] += delta * (value - (*mean)[c]);
+		}
+	}
+
+	for(int c = 0; c < channels; c++)
+		m2[c] = samples > 0 ? m2[c] / samples : 0;
+
+	return samples;
+
+}
+
+bool SetInputNormalization(caffe::Net<float>* net, const vector<double>& mean, const vector<double>& variance)
+{
+
+	if( !net->has_layer(kInputNormLayer) )
+		return false;
+
+	const vector<boost::shared_ptr<caffe::Blob<float> > >& blobs = net->layer_by_name(kInputNormLayer)->blobs();
+	if( blobs.size() != 3 || blobs[0]->count() != mean.size() || blobs[1]->count() != variance.size() )
+		return false;
+
+	// caffe BatchNorm: statistics are the moving sums divided by the scale factor
+	std::copy(mean.begin(), mean.end(), blobs[0]->mutable_cpu_data());
+	std::copy(variance.begin(), variance.end(), blobs[1]->mutable_cpu_data());
+	blobs[2]->mutable_cpu_data()[0] = 1;
+
+	return true;
+
+}
+
+bool HasInputNormalization(caffe::Net<float>* net)
+{
+
+	if( !net->has_layer(kInputNormLayer) )
+		return false;
+
+	const vector<boost::shared_ptr<caffe::Blob<float> > >& blobs = net->layer_by_name(kInputNormLayer)->blobs();
+	return blobs.size() == 3 && blobs[2]->cpu_data()[0] != 0;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,808 @@
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/quantized_model.h>
+#include <neural_network_planner/net_transforms.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+void allocate(EngineBlob* blob, int channels, int inner, int max_timesteps, kernels::Arena* arena)
+{
+
+	blob->channels = channels;
+	blob->inner = inner;
+	blob->step = kernels::RoundUp(channels * inner);
+	arena->Reserve(&blob->data, blob->step * max_timesteps);
+
+}
+
+
+/*
+ * @brief caffe LSTMLayer: gates = W_xc x + b_c + W_hc (cont * h_prev), gate order i f o g.
+ *        Input and recurrent weights are stored transposed and stacked, [ W_xc ; W_hc ]^T,
+ *        so that the four gates of all the streams are one fused product
+ */
+class LSTMLayer : public EngineLayer
+{
+
+public:
+
+	LSTMLayer(shared_ptr<EngineBlob> bottom_blob, shared_ptr<EngineBlob> top_blob)
+		: bottom(bottom_blob), top(top_blob), N(0), X(0), H(0), G(0), Kz(0), fixed_step(NULL),
+		  Wt(NULL), bias(NULL), Wq(NULL), scale(NULL) {}
+
+	bool Init(const LayerDescription& desc, const MappedModel* model) {
+
+		name = desc.name;
+
+		if( desc.blobs.size() != 3 || desc.blobs[0].shape.size() != 2 ) {
+			LOG(ERROR) << "LSTM layer " << name << ": expected W_xc, b_c and W_hc weights";
+			return false;
+		}
+
+		H = desc.blobs[2].shape[1];
+		X = desc.blobs[0].shape[1];
+		G = kernels::RoundUp(4 * H);
+		Kz = X + H;
+
+		if( desc.blobs[0].shape[0] != 4 * H || desc.blobs[1].count() != 4 * H
+		    || desc.blobs[2].shape[0] != 4 * H ) {
+			LOG(ERROR) << "LSTM layer " << name << ": inconsistent weight shapes";
+			return false;
+		}
+
+		// .nnw: already laid out, used in place
+		if( model ) {
+			bias = model->Floats(name + "/bias", G);
+			if( model->has(name + "/Wq") ) {
+				Wq = model->Int8(name + "/Wq", Kz * G + kernels::kPadding);
+				scale = model->Floats(name + "/scale", G);
+				return bias && Wq && scale;
+			}
+			Wt = model->Floats(name + "/Wt", Kz * G);
+			return bias && Wt;
+		}
+
+		bias_data.Allocate(G);
+		std::copy(desc.blobs[1].data.begin(), desc.blobs[1].data.end(), bias_data.data());
+		bias = bias_data.data();
+
+		if( desc.blobs[0].quantized() ) {
+
+			if( !desc.blobs[2].quantized() || desc.blobs[0].scales != desc.blobs[2].scales ) {
+				LOG(ERROR) << "LSTM layer " << name << ": W_xc and W_hc must share the quantization scales";
+				return false;
+			}
+
+			const int8_t* W_xc = &desc.blobs[0].qdata[0];
+			const int8_t* W_hc = &desc.blobs[2].qdata[0];
+
+			Wq_data.Allocate(Kz * G + kernels::kPadding);
+			scale_data.Allocate(G);
+			std::copy(desc.blobs[0].scales.begin(), desc.blobs[0].scales.end(), scale_data.data());
+
+			for(int m = 0; m < 4 * H; m++) {
+				for(int k = 0; k < X; k++)
+					Wq_data[k * G + m] = W_xc[m * X + k];
+				for(int k = 0; k < H; k++)
+					Wq_data[(X + k) * G + m] = W_hc[m * H + k];
+			}
+
+			Wq = Wq_data.data();
+			scale = scale_data.data();
+			return true;
+		}
+
+		const float* W_xc = &desc.blobs[0].data[0];
+		const float* W_hc = &desc.blobs[2].data[0];
+
+		Wt_data.Allocate(Kz * G);
+
+		for(int m = 0; m < 4 * H; m++) {
+			for(int k = 0; k < X; k++)
+				Wt_data[k * G + m] = W_xc[m * X + k];
+			for(int k = 0; k < H; k++)
+				Wt_data[(X + k) * G + m] = W_hc[m * H + k];
+		}
+
+		Wt = Wt_data.data();
+		return true;
+
+	}
+
+	bool Setup(int max_timesteps, kernels::Arena* arena) {
+
+		if( bottom->inner != X ) {
+			LOG(ERROR) << "LSTM layer " << name << ": input has " << bottom->inner
+				   << " values per stream, weights expect " << X;
+			return false;
+		}
+
+		N = bottom->channels;
+		allocate(top.get(), N, H, max_timesteps, arena);
+
+		// sizes of the shipped nets have a kernel compiled for them, float weights only
+		fixed_step = quantized() ? NULL : kernels::FixedLSTMStep(N, X, H);
+
+		arena->Reserve(&z, N * Kz);
+		arena->Reserve(&gates, N * G);
+		arena->Reserve(&h, N * H);
+		arena->Reserve(&c, N * H);
+
+		return true;
+
+	}
+
+	void Forward(const float* clip, int timesteps) {
+
+		for(int t = 0; t < timesteps; t++) {
+
+			float cont = clip ? clip[t] : 1;
+			const float* x = bottom->at(t);
+
+			if( fixed_step ) {
+				fixed_step(Wt, bias, x, cont, h.data(), c.data(), top->at(t));
+				memcpy(h.data(), top->at(t), N * H * sizeof(float));
+				continue;
+			}
+
+			for(int n = 0; n < N; n++) {
+				float* z_n = z.data() + n * Kz;
+				memcpy(z_n, x + n * X, X * sizeof(float));
+				if( cont != 0 ) {
+					const float* h_n = h.data() + n * H;
+					for(int d = 0; d < H; d++)
+						z_n[X + d] = cont * h_n[d];
+				}
+			}
+
+			// a sequence start has no recurrent contribution: only the W_xc rows
+			if( quantized() )
+				kernels::GemmT8(Wq, scale, bias, z.data(), Kz, N, cont != 0 ? Kz : X, G, gates.data(), G);
+			else
+				kernels::GemmT(Wt, bias, z.data(), Kz, N, cont != 0 ? Kz : X, G, gates.data(), G);
+
+			for(int n = 0; n < N; n++)
+				kernels::LSTMUnit(gates.data() + n * G, H, cont, c.data() + n * H, c.data() + n * H, h.data() + n * H);
+
+			memcpy(top->at(t), h.data(), N * H * sizeof(float));
+		}
+
+	}
+
+	void ResetState() {
+
+		std::fill(h.data(), h.data() + h.size(), 0.f);
+		std::fill(c.data(), c.data() + c.size(), 0.f);
+
+	}
+
+	void Tensors(vector<MappedTensor>* tensors) const {
+
+		tensors->push_back(MappedTensor(name + "/bias", TENSOR_FLOAT32, bias, G));
+		if( quantized() ) {
+			tensors->push_back(MappedTensor(name + "/Wq", TENSOR_INT8, Wq, Kz * G + kernels::kPadding));
+			tensors->push_back(MappedTensor(name + "/scale", TENSOR_FLOAT32, scale, G));
+		}
+		else
+			tensors->push_back(MappedTensor(name + "/Wt", TENSOR_FLOAT32, Wt, Kz * G));
+
+	}
+
+	bool specialized() const { return fixed_step != NULL; }
+	bool quantized() const { return Wq != NULL; }
+
+private:
+
+	shared_ptr<EngineBlob> bottom, top;
+
+	int N, X, H, G, Kz;
+
+	kernels::LSTMStepKernel fixed_step;
+
+	// weights in the buffers below or in a mapped model
+	const float* Wt;
+	const float* bias;
+
+	// int8 weights, laid out as Wt, and their scale per gate
+	const int8_t* Wq;
+	const float* scale;
+
+	kernels::AlignedBuffer Wt_data, bias_data;
+	kernels::AlignedInt8Buffer Wq_data;
+	kernels::AlignedBuffer scale_data;
+
+	kernels::AlignedBuffer z, gates, h, c;
+
+};
+
+
+/*
+ * @brief caffe BatchNormLayer: channels are axis 1,
+ *        global stats use the stored moving averages, otherwise
+ *        statistics are computed over the evaluated window.
+ *        Also evaluates the Scale layer, the same per channel affine transform
+ */
+class BatchNormLayer : public EngineLayer
+{
+
+public:
+
+	BatchNormLayer(shared_ptr<EngineBlob> bottom_blob, shared_ptr<EngineBlob> top_blob)
+		: bottom(bottom_blob), top(top_blob), use_global_stats(true), eps(1e-5) {}
+
+	bool Init(const LayerDescription& desc, const MappedModel* model) {
+
+		name = desc.name;
+		// the engine only runs inference: caffe TEST phase default
+		use_global_stats = desc.has_use_global_stats ? desc.use_global_stats : true;
+		eps = desc.eps;
+
+		if( !use_global_stats )
+			LOG(WARNING) << "BatchNorm layer " << name << " uses batch statistics: results depend on the evaluated window";
+
+		if( desc.blobs.size() != 3 || desc.blobs[0].count() != desc.blobs[1].count() ) {
+			LOG(ERROR) << "BatchNorm layer " << name << ": expected mean, variance and scale factor";
+			return false;
+		}
+
+		if( model )
+			return Map(*model, desc.blobs[0].count());
+
+		vector<float> channel_scale, channel_shift;
+		BatchNormAffine(desc, &channel_scale, &channel_shift);
+
+		scale.Allocate(channel_scale.size());
+		shift.Allocate(channel_shift.size());
+		std::copy(channel_scale.begin(), channel_scale.end(), scale.data());
+		std::copy(channel_shift.begin(), channel_shift.end(), shift.data());
+
+		return true;
+
+	}
+
+	// caffe ScaleLayer on axis 1: learned per channel scale and optional bias
+	bool InitScale(const LayerDescription& desc, const MappedModel* model) {
+
+		name = desc.name;
+		use_global_stats = true;
+
+		if( desc.axis != 1 || desc.blobs.empty() || (desc.blobs.size() > 1 && desc.blobs[1].count() != desc.blobs[0].count()) ) {
+			LOG(ERROR) << "Scale layer " << name << ": only learned per channel scales on axis 1 are supported";
+			return false;
+		}
+
+		int C = desc.blobs[0].count();
+		if( model )
+			return Map(*model, C);
+
+		scale.Allocate(C);
+		shift.Allocate(C);
+		std::copy(desc.blobs[0].data.begin(), desc.blobs[0].data.end(), scale.data());
+		if( desc.blobs.size() > 1 )
+			std::copy(desc.blobs[1].data.begin(), desc.blobs[1].data.end(), shift.data());
+
+		return true;
+
+	}
+
+	// copied: batch statistics overwrite the transform at every Forward
+	bool Map(const MappedModel& model, int C) {
+
+		const float* mapped_scale = model.Floats(name + "/scale", C);
+		const float* mapped_shift = model.Floats(name + "/shift", C);
+		if( !mapped_scale || !mapped_shift )
+			return false;
+
+		scale.Allocate(C);
+		shift.Allocate(C);
+		std::copy(mapped_scale, mapped_scale + C, scale.data());
+		std::copy(mapped_shift, mapped_shift + C, shift.data());
+
+		return true;
+
+	}
+
+	void Tensors(vector<MappedTensor>* tensors) const {
+
+		tensors->push_back(MappedTensor(name + "/scale", TENSOR_FLOAT32, scale.data(), scale.size()));
+		tensors->push_back(MappedTensor(name + "/shift", TENSOR_FLOAT32, shift.data(), shift.size()));
+
+	}
+
+	bool Setup(int max_timesteps, kernels::Arena* arena) {
+
+		if( bottom->channels != scale.size() ) {
+			LOG(ERROR) << "BatchNorm layer " << name << ": " << bottom->channels
+				   << " channels, statistics for " << scale.size();
+			return false;
+		}
+
+		allocate(top.get(), bottom->channels, bottom->inner, max_timesteps, arena);
+		return true;
+
+	}
+
+	void Forward(const float* clip, int timesteps) {
+
+		int C = bottom->channels, S = bottom->inner;
+
+		if( !use_global_stats ) {
+
+			for(int ch = 0; ch < C; ch++) {
+
+				double sum = 0, square_sum = 0;
+				for(int t = 0; t < timesteps; t++) {
+					const float* x = bottom->at(t) + ch * S;
+					for(int s = 0; s < S; s++)
+						sum += x[s];
+				}
+				float mean = sum / (timesteps * S);
+
+				for(int t = 0; t < timesteps; t++) {
+					const float* x = bottom->at(t) + ch * S;
+					for(int s = 0; s < S; s++)
+						square_sum += (x[s] - mean) * (x[s] - mean);
+				}
+				float variance = square_sum / (timesteps * S);
+
+				scale[ch] = 1 / sqrt(variance + eps);
+				shift[ch] = -mean * scale[ch];
+			}
+		}
+
+		for(int t = 0; t < timesteps; t++) {
+			const float* x = bottom->at(t);
+			float* y = top->at(t);
+			for(int ch = 0; ch < C; ch++)
+				for(int s = 0; s < S; s++)
+					y[ch * S + s] = x[ch * S + s] * scale[ch] + shift[ch];
+		}
+
+	}
+
+private:
+
+	shared_ptr<EngineBlob> bottom, top;
+
+	bool use_global_stats;
+	float eps;
+
+	kernels::AlignedBuffer scale, shift;
+
+};
+
+
+/*
+ * @brief caffe InnerProductLayer on axis 1: one product per timestep,
+ *        outputs padded to the kernel width
+ */
+class InnerProductLayer : public EngineLayer
+{
+
+public:
+
+	InnerProductLayer(shared_ptr<EngineBlob> bottom_blob, shared_ptr<EngineBlob> top_blob)
+		: bottom(bottom_blob), top(top_blob), K(0), M(0), Mp(0), Wt(NULL), bias(NULL), Wq(NULL), scale(NULL) {}
+
+	bool Init(const LayerDescription& desc, const MappedModel* model) {
+
+		name = desc.name;
+
+		if( desc.axis != 1 ) {
+			LOG(ERROR) << "InnerProduct layer " << name << ": only axis 1 is supported";
+			return false;
+		}
+
+		if( desc.blobs.empty() || desc.blobs[0].shape.size() != 2 ) {
+			LOG(ERROR) << "InnerProduct layer " << name << ": missing weights";
+			return false;
+		}
+
+		const BlobDescription& W = desc.blobs[0];
+		M = desc.transpose ? W.shape[1] : W.shape[0];
+		K = desc.transpose ? W.shape[0] : W.shape[1];
+		Mp = kernels::RoundUp(M);
+		bool has_bias = desc.bias_term && desc.blobs.size() > 1;
+
+		if( model ) {
+			if( has_bias && !(bias = model->Floats(name + "/bias", Mp)) )
+				return false;
+			if( model->has(name + "/Wq") ) {
+				Wq = model->Int8(name + "/Wq", K * Mp + kernels::kPadding);
+				scale = model->Floats(name + "/scale", Mp);
+				return Wq && scale;
+			}
+			Wt = model->Floats(name + "/Wt", K * Mp);
+			return Wt != NULL;
+		}
+
+		if( W.quantized() ) {
+
+			if( desc.transpose ) {
+				LOG(ERROR) << "InnerProduct layer " << name << ": quantized weights can not be transposed";
+				return false;
+			}
+
+			Wq_data.Allocate(K * Mp + kernels::kPadding);
+			scale_data.Allocate(Mp);
+			std::copy(W.scales.begin(), W.scales.end(), scale_data.data());
+
+			for(int m = 0; m < M; m++)
+				for(int k = 0; k < K; k++)
+					Wq_data[k * Mp + m] = W.qdata[m * K + k];
+
+			Wq = Wq_data.data();
+			scale = scale_data.data();
+		}
+		else {
+
+			Wt_data.Allocate(K * Mp);
+			for(int m = 0; m < M; m++)
+				for(int k = 0; k < K; k++)
+					Wt_data[k * Mp + m] = desc.transpose ? W.data[k * M + m] : W.data[m * K + k];
+
+			Wt = Wt_data.data();
+		}
+
+		if( has_bias ) {
+			bias_data.Allocate(Mp);
+			std::copy(desc.blobs[1].data.begin(), desc.blobs[1].data.end(), bias_data.data());
+			bias = bias_data.data();
+		}
+
+		return true;
+
+	}
+
+	bool Setup(int max_timesteps, kernels::Arena* arena) {
+
+		if( bottom->count() != K ) {
+			LOG(ERROR) << "InnerProduct layer " << name << ": input has " << bottom->count()
+				   << " values, weights expect " << K;
+			return false;
+		}
+
+		allocate(top.get(), M, 1, max_timesteps, arena);
+		return true;
+
+	}
+
+	void Forward(const float* clip, int timesteps) {
+
+		if( Wq )
+			kernels::GemmT8(Wq, scale, bias, bottom->at(0), bottom->step,
+					timesteps, K, Mp, top->at(0), top->step);
+		else
+			kernels::GemmT(Wt, bias, bottom->at(0), bottom->step,
+				       timesteps, K, Mp, top->at(0), top->step);
+
+	}
+
+	void Tensors(vector<MappedTensor>* tensors) const {
+
+		if( bias )
+			tensors->push_back(MappedTensor(name + "/bias", TENSOR_FLOAT32, bias, Mp));
+		if( Wq ) {
+			tensors->push_back(MappedTensor(name + "/Wq", TENSOR_INT8, Wq, K * Mp + kernels::kPadding));
+			tensors->push_back(MappedTensor(name + "/scale", TENSOR_FLOAT32, scale, Mp));
+		}
+		else
+			tensors->push_back(MappedTensor(name + "/Wt", TENSOR_FLOAT32, Wt, K * Mp));
+
+	}
+
+private:
+
+	shared_ptr<EngineBlob> bottom, top;
+
+	int K, M, Mp;
+
+	// weights in the buffers below or in a mapped model, no bias: NULL
+	const float* Wt;
+	const float* bias;
+
+	// int8 weights, laid out as Wt, and their scale per output
+	const int8_t* Wq;
+	const float* scale;
+
+	kernels::AlignedBuffer Wt_data, bias_data;
+	kernels::AlignedInt8Buffer Wq_data;
+	kernels::AlignedBuffer scale_data;
+
+};
+
+
+/*
+ * @brief caffe ConcatLayer along the channel axis
+ */
+class ConcatLayer : public EngineLayer
+{
+
+public:
+
+	ConcatLayer(const vector<shared_ptr<EngineBlob> >& bottom_blobs, shared_ptr<EngineBlob> top_blob)
+		: bottoms(bottom_blobs), top(top_blob) {}
+
+	bool Setup(int max_timesteps, kernels::Arena* arena) {
+
+		int channels = 0;
+		for(int i = 0; i < bottoms.size(); i++) {
+			if( bottoms[i]->inner != bottoms[0]->inner ) {
+				LOG(ERROR) << "Concat layer " << name << ": inputs differ beyond the channel axis";
+				return false;
+			}
+			channels += bottoms[i]->channels;
+		}
+
+		allocate(top.get(), channels, bottoms[0]->inner, max_timesteps, arena);
+		return true;
+
+	}
+
+	void Forward(const float* clip, int timesteps) {
+
+		for(int t = 0; t < timesteps; t++) {
+			float* y = top->at(t);
+			for(int i = 0; i < bottoms.size(); i++) {
+				memcpy(y, bottoms[i]->at(t), bottoms[i]->count() * sizeof(float));
+				y += bottoms[i]->count();
+			}
+		}
+
+	}
+
+private:
+
+	vector<shared_ptr<EngineBlob> > bottoms;
+	shared_ptr<EngineBlob> top;
+
+};
+
+} // namespace
+
+
+LSTMEngine::LSTMEngine() : input_size_(0), output_size_(0), max_timesteps_(0)
+{
+
+}
+
+LSTMEngine::~LSTMEngine()
+{
+
+}
+
+bool LSTMEngine::Load(const string& caffemodel, int input_size, int max_timesteps, const string& output_blob)
+{
+
+	NetDescription net;
+
+	// weights of convert_model, used in place from the mapping
+	if( IsMappedModel(caffemodel) ) {
+		shared_ptr<MappedModel> model(new MappedModel());
+		if( !model->Open(caffemodel, &net) )
+			return false;
+		return Load(net, input_size, max_timesteps, output_blob, model);
+	}
+
+	// int8 weights written by quantize_model
+	if( IsQuantizedModel(caffemodel) ) {
+		if( !ReadQuantizedModel(caffemodel, &net) )
+			return false;
+	}
+	else if( !ReadCaffeModel(caffemodel, &net) )
+		return false;
+
+	return Load(net, input_size, max_timesteps, output_blob);
+
+}
+
+bool LSTMEngine::Load(const NetDescription& net, int input_size, int max_timesteps, const string& output_blob)
+{
+
+	return Load(net, input_size, max_timesteps, output_blob, shared_ptr<MappedModel>());
+
+}
+
+bool LSTMEngine::Load(const NetDescription& net, int input_size, int max_timesteps, const string& output_blob,
+		      shared_ptr<MappedModel> model)
+{
+
+	CHECK_GT(input_size, 0);
+	CHECK_GT(max_timesteps, 0);
+
+	if( !kernels::InstructionSetSupported() ) {
+		LOG(ERROR) << "Engine built for " << kernels::InstructionSet() << ", not supported by this CPU: rebuild with NNP_SIMD scalar";
+		return false;
+	}
+
+	net_name = net.name;
+	blobs.clear();
+	layers.clear();
+	arena.Clear();
+	mapped = model;
+
+	// layers the output depends on
+	vector<bool> used;
+	if( !RequiredLayers(net, output_blob, &used) ) {
+		LOG(ERROR) << "Output " << output_blob << " of " << net_name << " does not depend on the data blob";
+		return false;
+	}
+
+	input.reset(new EngineBlob());
+	allocate(input.get(), input_size, 1, max_timesteps, &arena);
+	blobs["data"] = input;
+
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		if( !used[i] )
+			continue;
+
+		const LayerDescription& desc = net.layers[i];
+
+		vector<shared_ptr<EngineBlob> > bottom;
+		for(int j = 0; j < desc.bottom.size(); j++) {
+			if( !blobs.count(desc.bottom[j]) )
+				blobs[desc.bottom[j]].reset(new EngineBlob());
+			bottom.push_back(blobs[desc.bottom[j]]);
+		}
+
+		if( desc.type == "Input" || desc.type == "Data" ) {
+			// states are fed by Forward, clip is passed along
+			for(int j = 0; j < desc.top.size(); j++)
+				if( !blobs.count(desc.top[j]) )
+					blobs[desc.top[j]].reset(new EngineBlob());
+			continue;
+		}
+
+		if( desc.type == "Split" || (desc.type == "Concat" && bottom.size() == 1) ) {
+			for(int j = 0; j < desc.top.size(); j++)
+				blobs[desc.top[j]] = bottom[0];
+			continue;
+		}
+
+		if( desc.top.size() != 1 || bottom.empty() ) {
+			LOG(ERROR) << "Layer " << desc.name << ": expected a single top blob";
+			return false;
+		}
+
+		shared_ptr<EngineBlob> top(new EngineBlob());
+		blobs[desc.top[0]] = top;
+
+		if( desc.type == "LSTM" ) {
+			LSTMLayer* layer = new LSTMLayer(bottom[0], top);
+			layers.push_back(shared_ptr<EngineLayer>(layer));
+			if( !layer->Init(desc, model.get()) )
+				return false;
+		}
+		else if( desc.type == "BatchNorm" ) {
+			BatchNormLayer* layer = new BatchNormLayer(bottom[0], top);
+			layers.push_back(shared_ptr<EngineLayer>(layer));
+			if( !layer->Init(desc, model.get()) )
+				return false;
+		}
+		else if( desc.type == "Scale" && bottom.size() == 1 ) {
+			BatchNormLayer* layer = new BatchNormLayer(bottom[0], top);
+			layers.push_back(shared_ptr<EngineLayer>(layer));
+			if( !layer->InitScale(desc, model.get()) )
+				return false;
+		}
+		else if( desc.type == "InnerProduct" ) {
+			InnerProductLayer* layer = new InnerProductLayer(bottom[0], top);
+			layers.push_back(shared_ptr<EngineLayer>(layer));
+			if( !layer->Init(desc, model.get()) )
+				return false;
+		}
+		else if( desc.type == "Concat" && desc.concat_axis == 1 ) {
+			layers.push_back(shared_ptr<EngineLayer>(new ConcatLayer(bottom, top)));
+			layers.back()->name = desc.name;
+		}
+		else {
+			LOG(ERROR) << "Layer " << desc.name << " of type " << desc.type << " is not supported by the engine";
+			return false;
+		}
+	}
+
+	if( !blobs.count(output_blob) ) {
+		LOG(ERROR) << "Net " << net_name << " has no blob " << output_blob;
+		return false;
+	}
+
+	for(int i = 0; i < layers.size(); i++)
+		if( !layers[i]->Setup(max_timesteps, &arena) )
+			return false;
+
+	arena.Allocate();
+
+	output = blobs[output_blob];
+	input_size_ = input_size;
+	output_size_ = output->count();
+	max_timesteps_ = max_timesteps;
+
+	int recurrent = 0, specialized = 0;
+	for(int i = 0; i < layers.size(); i++) {
+		const LSTMLayer* lstm = dynamic_cast<const LSTMLayer*>(layers[i].get());
+		if( lstm ) {
+			recurrent++;
+			specialized += lstm->specialized();
+		}
+	}
+
+	LOG(INFO) << "Engine " << net_name << " (" << kernels::InstructionSet() << "): " << layers.size()
+		  << " layers evaluated for " << output_blob << ", " << output_size_ << " outputs, "
+		  << specialized << " of " << recurrent << " LSTM layers with fixed size kernels, "
+		  << arena.size() * sizeof(float) << " bytes of activations and states";
+
+	return true;
+
+}
+
+const float* LSTMEngine::Forward(const float* states, const float* clip, int timesteps)
+{
+
+	DCHECK_LE(timesteps, max_timesteps_);
+
+	for(int t = 0; t < timesteps; t++)
+		memcpy(input->at(t), states + t * input_size_, input_size_ * sizeof(float));
+
+	for(int i = 0; i < layers.size(); i++)
+		layers[i]->Forward(clip, timesteps);
+
+	return output->at(timesteps - 1);
+
+}
+
+const float* LSTMEngine::Step(const float* state, bool sequence_start)
+{
+
+	float clip = sequence_start ? 0 : 1;
+	return Forward(state, &clip, 1);
+
+}
+
+const float* LSTMEngine::Output(int t) const
+{
+
+	return output->at(t);
+
+}
+
+const EngineBlob* LSTMEngine::blob(const string& blob_name) const
+{
+
+	std::map<string, shared_ptr<EngineBlob> >::const_iterator it = blobs.find(blob_name);
+	return it == blobs.end() ? NULL : it->second.get();
+
+}
+
+void LSTMEngine::ResetState()
+{
+
+	for(int i = 0; i < layers.size(); i++)
+		layers[i]->ResetState();
+
+}
+
+void LSTMEngine::Tensors(vector<MappedTensor>* tensors) const
+{
+
+	for(int i = 0; i < layers.size(); i++)
+		layers[i]->Tensors(tensors);
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,856 @@
+#include <neural_network_planner/lstm_planner_ros.h>
+#include <neural_network_planner/state_features.h>
+
+#ifdef PLANNER_CAFFE_BACKEND
+#include <neural_network_planner/input_normalization.h>
+#include "caffe/util/upgrade_proto.hpp"
+#endif
+
+// generated by compile_model from the PLANNER_COMPILED_MODEL snapshot
+#ifdef PLANNER_COMPILED_MODEL
+#include <neural_network_planner/compiled_model.h>
+#endif
+
+#include <pluginlib/class_list_macros.h>
+
+#include "glog/logging.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+
+#include <pthread.h>
+#include <sched.h>
+
+
+PLUGINLIB_EXPORT_CLASS(neural_network_planner::LSTMPlannerROS, nav_core::BaseLocalPlanner)
+
+
+namespace neural_network_planner {
+
+
+LSTMPlannerROS::LSTMPlannerROS() : tf_(NULL), costmap_ros_(NULL), engine(NULL), pending_engine(NULL), retired_engine(NULL),
+				   loader_stop(false), loaded_model_time(0), fallback_loader("nav_core", "nav_core::BaseLocalPlanner"),
+				   shadow_mode(false), inference_stop(false), dropped_scans(0), initialized(false), net_confident(true)
+{
+
+}
+
+LSTMPlannerROS::~LSTMPlannerROS()
+{
+
+	scan_sub_.shutdown();
+	odom_sub_.shutdown();
+	reload_srv_.shutdown();
+
+	shadow_log.Close();
+
+	if( scan_queue ) {
+		inference_stop = true;
+		sem_post(&scans_queued);
+		if( inference_thread.joinable() )
+			inference_thread.join();
+		sem_destroy(&scans_queued);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(loader_mutex);
+		loader_stop = true;
+	}
+	loader_condition.notify_one();
+
+	if( loader_thread.joinable() )
+		loader_thread.join();
+
+	delete pending_engine.exchange(NULL);
+	delete retired_engine.exchange(NULL);
+	delete engine;
+
+}
+
+void LSTMPlannerROS::initialize(std::string name, tf::TransformListener* tf, costmap_2d::Costmap2DROS* costmap_ros)
+{
+
+	if( initialized ) {
+		ROS_WARN("LSTM planner has already been initialized, doing nothing");
+		return;
+	}
+
+	tf_ = tf;
+	costmap_ros_ = costmap_ros;
+
+	private_nh = ros::NodeHandle("~/" + name);
+
+	private_nh.param("inference_engine", inference_engine, std::string("native"));
+	private_nh.param("net_model", net_model, std::string(""));
+	private_nh.param("trained_weights", trained_weights, std::string(""));
+	private_nh.param("scan_topic", scan_topic, std::string("/base_scan"));
+	private_nh.param("odom_topic", odom_topic, std::string("/odom"));
+	private_nh.param("odom_frame", odom_frame, std::string("/odom"));
+	private_nh.param("averaged_ranges_size", averaged_ranges_size, 24);
+	private_nh.param("downsampling", downsampling, std::string("mean"));
+	private_nh.param("time_sequence", time_sequence, 16);
+	private_nh.param("stateful", stateful, true);
+	private_nh.param("sequence_length", sequence_length, 0);
+	private_nh.param("goal_update_threshold", goal_update_threshold, 0.1);
+	private_nh.param("max_vel_x", max_vel_x, 0.4);
+	private_nh.param("max_rot_vel", max_rot_vel, 1.0);
+	private_nh.param("xy_goal_tolerance", xy_goal_tolerance, 0.25);
+	private_nh.param("max_inference_time", max_inference_time, 0.05);
+	private_nh.param("command_timeout", command_timeout, 0.3);
+	private_nh.param("model_directory", model_directory, std::string(""));
+	private_nh.param("model_poll_period", model_poll_period, 2.0);
+	private_nh.param("max_disagreement", max_disagreement, 0.25);
+	private_nh.param("fallback_planner", fallback_planner, std::string(""));
+	private_nh.param("shadow_mode", shadow_mode, false);
+	private_nh.param("shadow_log", shadow_log_path, std::string("lstm_shadow.bin"));
+	private_nh.param("robot_radius", robot_radius, 0.2);
+	private_nh.param("ttc_horizon", ttc_horizon, 5.0);
+	private_nh.param("footprint_gate", footprint_gate, true);
+	private_nh.param("gate_sim_time", gate_sim_time, 1.0);
+	private_nh.param("gate_sim_granularity", gate_sim_granularity, 0.05);
+	private_nh.param("scan_queue_size", scan_queue_size, 4);
+	private_nh.param("inference_cpu", inference_cpu, -1);
+	private_nh.param("inference_priority", inference_priority, 0);
+	private_nh.param("check_allocations", check_allocations, false);
+	private_nh.param("allocation_warmup", allocation_warmup, 10);
+
+	state_sequence_size = state_size(averaged_ranges_size);
+
+	CHECK(downsampler.Init(averaged_ranges_size, downsampling)) << "LSTM planner: downsampling must be mean, min, median or pN";
+	obstacle_sampler.Init(averaged_ranges_size, "min");
+
+	// stateful inference evaluates only the incoming scan, the window otherwise
+	evaluated_timesteps = stateful ? 1 : time_sequence;
+
+	if( inference_engine == "caffe" ) {
+
+#ifdef PLANNER_CAFFE_BACKEND
+		caffe::Caffe::set_mode(caffe::Caffe::CPU);
+
+		LOG(INFO) << "Loading caffe network " << net_model << " weights " << trained_weights;
+		// weights of a normalized training need their input_norm layer in the deploy net
+		caffe::NetParameter net_param;
+		caffe::ReadNetParamsFromTextFileOrDie(net_model, &net_param);
+		NetDescription trained;
+		if( ReadCaffeModel(trained_weights, &trained) && trained.layer_by_name(kInputNormLayer)
+		    && AddInputNormalization(&net_param) )
+			LOG(INFO) << "Input normalization of " << trained_weights << " added to " << net_model;
+
+		net_param.mutable_state()->set_phase(caffe::TEST);
+		net.reset(new caffe::Net<float>(net_param));
+		net->CopyTrainedLayersFrom(trained_weights);
+
+		// basic checking for minimal functioning
+		CHECK(net->has_blob("data"));
+		CHECK(net->has_blob("clip"));
+		CHECK(net->has_blob("out"));
+
+		blobData = net->blob_by_name("data");
+		blobClip = net->blob_by_name("clip");
+		blobOut  = net->blob_by_name("out");
+
+		// evaluated timesteps x state
+		std::vector<int> shape(2);
+		shape[0] = evaluated_timesteps;
+		shape[1] = state_sequence_size;
+		blobData->Reshape(shape);
+		blobClip->Reshape(shape);
+		net->Reshape();
+
+		CHECK_EQ(blobOut->shape(0), evaluated_timesteps) << "network output must be one command per timestep";
+		CHECK_EQ(blobOut->count(1), 2) << "network output must be linear and angular velocity";
+#else
+		LOG(FATAL) << "LSTM planner built without PLANNER_CAFFE_BACKEND, use the native inference engine";
+#endif
+	}
+	else if( inference_engine == "compiled" ) {
+
+#ifdef PLANNER_COMPILED_MODEL
+		compiled_net.reset(new compiled::CompiledModel());
+
+		CHECK(compiled::CompiledModel::input_size == state_sequence_size) << "LSTM planner: compiled network "
+			<< compiled::CompiledModel::name() << " was built for another averaged_ranges_size";
+		CHECK(compiled::CompiledModel::output_size == 2) << "network output must be linear and angular velocity";
+
+		LOG(INFO) << "Using network " << compiled::CompiledModel::name() << " compiled into the planner";
+#else
+		LOG(FATAL) << "LSTM planner built without PLANNER_COMPILED_MODEL, use the native inference engine";
+#endif
+	}
+	else if( inference_engine == "ensemble" ) {
+
+		private_nh.getParam("ensemble_weights", ensemble_weights);
+		CHECK(!ensemble_weights.empty()) << "LSTM planner: ensemble_weights must list the member snapshots";
+
+		ensemble.reset(new EnsembleEngine());
+		CHECK(ensemble->Load(ensemble_weights, state_sequence_size, evaluated_timesteps))
+			<< "LSTM planner: can not use the ensemble of " << ensemble_weights.size() << " snapshots";
+		CHECK_EQ(ensemble->output_size(), 2) << "network output must be linear and angular velocity";
+
+		LOG(INFO) << "Ensemble of " << ensemble->members() << " snapshots, disagreement above " << max_disagreement
+			  << (fallback_planner.empty() ? std::string(" stops the robot") : " drives with " + fallback_planner);
+	}
+	else {
+
+		LOG(INFO) << "Loading network weights " << trained_weights;
+		engine = load_engine(trained_weights);
+		CHECK(engine) << "LSTM planner: can not use " << trained_weights;
+	}
+
+	CHECK(!shadow_mode || !fallback_planner.empty()) << "LSTM planner: shadow_mode needs the classic controller as fallback_planner";
+
+	// classic controller: drives in shadow mode, or while the ensemble members disagree
+	if( !fallback_planner.empty() ) {
+		try {
+			fallback = fallback_loader.createInstance(fallback_planner);
+			fallback->initialize(fallback_loader.getName(fallback_planner), tf, costmap_ros);
+		}
+		catch(const pluginlib::PluginlibException& ex) {
+			LOG(FATAL) << "LSTM planner: can not create fallback planner " << fallback_planner << ": " << ex.what();
+		}
+	}
+
+	if( shadow_mode ) {
+		CHECK(shadow_log.Open(shadow_log_path, 64, averaged_ranges_size, robot_radius, ttc_horizon))
+			<< "LSTM planner: can not write the shadow log " << shadow_log_path;
+		LOG(INFO) << "LSTM planner in shadow mode: " << fallback_planner << " drives, the network is logged to " << shadow_log_path;
+	}
+
+	if( footprint_gate ) {
+
+		int gate_headings, gate_lethal_cost;
+		bool gate_unknown_is_lethal;
+		private_nh.param("gate_headings", gate_headings, 64);
+		private_nh.param("gate_lethal_cost", gate_lethal_cost, 254);
+		private_nh.param("gate_unknown_is_lethal", gate_unknown_is_lethal, false);
+
+		CHECK(gate_lethal_cost > 0 && gate_lethal_cost <= 255) << "LSTM planner: gate_lethal_cost must be a costmap cost";
+		CHECK_GT(gate_sim_granularity, 0);
+
+		std::vector<geometry_msgs::Point> footprint = costmap_ros->getRobotFootprint();
+		std::vector<std::pair<double, double> > polygon(footprint.size());
+		for(int i = 0; i < footprint.size(); i++)
+			polygon[i] = std::make_pair(footprint[i].x, footprint[i].y);
+
+		gate.Init(polygon, costmap_ros->getCostmap()->getResolution(), gate_headings, gate_lethal_cost, gate_unknown_is_lethal);
+	}
+
+	gated_commands = rejected_commands = 0;
+
+	scan_obstacles = std::vector<float>(averaged_ranges_size, 0);
+	shadow_obstacles = std::vector<float>(averaged_ranges_size, 0);
+	scan_sector_start = scan_sector_width = sector_start = sector_width = 0;
+
+	arena.Reserve(&window, time_sequence * state_sequence_size);
+	arena.Reserve(&sequence, time_sequence * state_sequence_size);
+	arena.Reserve(&sequence_clip, time_sequence);
+	arena.Allocate();
+	window_head = window_fill = 0;
+	sequence_step = 0;
+	new_sequence = true;
+	overruns = 0;
+	inferences = 0;
+	uncertain_commands = 0;
+
+	if( check_allocations && !malloc_guard.available() )
+		LOG(FATAL) << "LSTM planner: check_allocations needs libnn_malloc_guard.so in LD_PRELOAD";
+
+	goal_received = odom_received = false;
+
+	// the inference thread runs before the first scan is queued
+	QueuedState prototype;
+	prototype.state = std::vector<float>(state_sequence_size, 0);
+	prototype.sequence_start = true;
+	prototype.obstacles = std::vector<float>(averaged_ranges_size, 0);
+	prototype.sector_start = prototype.sector_width = 0;
+	scan_queue.reset(new SpscRing<QueuedState>(std::max(scan_queue_size, 1) + 1, prototype));
+	sem_init(&scans_queued, 0, 0);
+	inference_thread = boost::thread(&LSTMPlannerROS::inference_loop, this);
+
+	if( inference_cpu >= 0 ) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(inference_cpu, &cpus);
+		if( pthread_setaffinity_np(inference_thread.native_handle(), sizeof(cpus), &cpus) != 0 )
+			LOG(WARNING) << "LSTM planner: can not pin the inference thread to cpu " << inference_cpu;
+	}
+
+	if( inference_priority > 0 ) {
+		sched_param priority;
+		priority.sched_priority = inference_priority;
+		if( pthread_setschedparam(inference_thread.native_handle(), SCHED_FIFO, &priority) != 0 )
+			LOG(WARNING) << "LSTM planner: can not run the inference thread SCHED_FIFO " << inference_priority
+				     << ", check the rtprio limit";
+	}
+
+	ros::NodeHandle nh;
+	scan_sub_ = nh.subscribe<sensor_msgs::LaserScan>(scan_topic, 1, boost::bind(&LSTMPlannerROS::scan_callback, this, _1));
+	odom_sub_ = nh.subscribe<nav_msgs::Odometry>(odom_topic, 1, boost::bind(&LSTMPlannerROS::odom_callback, this, _1));
+
+	// networks replaced while driving: native engine only
+	if( engine ) {
+
+		boost::system::error_code error;
+		loaded_model_time = boost::filesystem::last_write_time(trained_weights, error);
+
+		reload_srv_ = private_nh.advertiseService("reload_model", &LSTMPlannerROS::reload_callback, this);
+		loader_thread = boost::thread(&LSTMPlannerROS::model_loader, this);
+
+		if( !model_directory.empty() )
+			LOG(INFO) << "LSTM planner: watching " << model_directory << " for new models every " << model_poll_period << " sec";
+	}
+	else if( !model_directory.empty() )
+		LOG(WARNING) << "LSTM planner: model_directory is only watched by the native engine";
+
+	initialized = true;
+
+	if( stateful )
+		LOG(INFO) << "LSTM planner ready: " << inference_engine << " engine, state size " << state_sequence_size
+			  << " stateful, sequence length " << sequence_length;
+	else
+		LOG(INFO) << "LSTM planner ready: " << inference_engine << " engine, state size " << state_sequence_size
+			  << " time sequence " << time_sequence;
+
+}
+
+bool LSTMPlannerROS::setPlan(const std::vector<geometry_msgs::PoseStamped>& plan)
+{
+
+	if( !initialized ) {
+		ROS_ERROR("LSTM planner has not been initialized, please call initialize() before using this planner");
+		return false;
+	}
+
+	if( plan.empty() )
+		return false;
+
+	// the fallback follows the whole plan, ready to take over
+	if( fallback && !fallback->setPlan(plan) )
+		ROS_WARN("LSTM planner: fallback planner %s rejected the plan", fallback_planner.c_str());
+
+	geometry_msgs::PoseStamped goal = plan.back();
+	geometry_msgs::PoseStamped odom_goal;
+	goal.header.stamp = ros::Time(0);
+
+	try {
+		tf_->transformPose(odom_frame, goal, odom_goal);
+	}
+	catch(tf::TransformException& ex) {
+		ROS_ERROR("LSTM planner can not transform plan target in %s: %s", odom_frame.c_str(), ex.what());
+		return false;
+	}
+
+	std::pair<float, float> target(odom_goal.pose.position.x, odom_goal.pose.position.y);
+
+	boost::mutex::scoped_lock lock(state_mutex);
+
+	// replanning keeps the goal, a new goal restarts the sequence - as updateTarget_callback
+	if( !goal_received || hypot(target.first - current_target.first,
+				    target.second - current_target.second) > goal_update_threshold )
+		new_sequence = true;
+
+	current_target = target;
+	goal_received = true;
+
+	return true;
+
+}
+
+bool LSTMPlannerROS::isGoalReached()
+{
+
+	if( shadow_mode )
+		return fallback->isGoalReached();
+
+	boost::mutex::scoped_lock lock(state_mutex);
+
+	if( !goal_received || !odom_received )
+		return false;
+
+	return hypot(current_target.first - current_source.first,
+		     current_target.second - current_source.second) <= xy_goal_tolerance;
+
+}
+
+bool LSTMPlannerROS::computeVelocityCommands(geometry_msgs::Twist& cmd_vel)
+{
+
+	// the classic controller drives, the network command of the latest scan is only logged
+	if( shadow_mode ) {
+		bool classic_valid = fallback->computeVelocityCommands(cmd_vel);
+		log_shadow(cmd_vel, classic_valid);
+		return classic_valid;
+	}
+
+	boost::mutex::scoped_lock lock(state_mutex);
+
+	if( !goal_received || net_cmd_time.isZero() )
+		return false;
+
+	if( ros::Time::now() - net_cmd_time > ros::Duration(command_timeout) ) {
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: last network command is %.3f sec old",
+				  (ros::Time::now() - net_cmd_time).toSec());
+		return false;
+	}
+
+	if( !net_confident ) {
+
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: ensemble members disagree (%d uncertain commands)%s",
+				  uncertain_commands, fallback ? ", fallback planner drives" : "");
+
+		// the fallback plans on its own costmap and may take long: state is released
+		lock.unlock();
+		return fallback && fallback->computeVelocityCommands(cmd_vel);
+	}
+
+	geometry_msgs::Twist cmd = net_cmd;
+
+	// the costmap is locked by the gate, not the network state
+	lock.unlock();
+
+	if( footprint_gate && !gate_command(&cmd) )
+		return fallback && fallback->computeVelocityCommands(cmd_vel);
+
+	cmd_vel = cmd;
+
+	return true;
+
+}
+
+bool LSTMPlannerROS::gate_command(geometry_msgs::Twist* cmd)
+{
+
+	tf::Stamped<tf::Pose> pose;
+	if( !costmap_ros_->getRobotPose(pose) ) {
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: no robot pose in the costmap, network command rejected");
+		return false;
+	}
+
+	costmap_2d::Costmap2D* costmap = costmap_ros_->getCostmap();
+	boost::unique_lock<costmap_2d::Costmap2D::mutex_t> lock(*costmap->getMutex());
+
+	CostGrid grid;
+	grid.costs = costmap->getCharMap();
+	grid.size_x = costmap->getSizeInCellsX();
+	grid.size_y = costmap->getSizeInCellsY();
+	grid.origin_x = costmap->getOriginX();
+	grid.origin_y = costmap->getOriginY();
+	grid.resolution = costmap->getResolution();
+
+	double linear = cmd->linear.x, angular = cmd->angular.z;
+
+	if( !gate.Filter(grid, pose.getOrigin().x(), pose.getOrigin().y(), tf::getYaw(pose.getRotation()),
+			 gate_sim_time, gate_sim_granularity, &linear, &angular) ) {
+		rejected_commands++;
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: network command (%.2f, %.2f) collides within %.1f sec, rejected (%d rejected)%s",
+				  cmd->linear.x, cmd->angular.z, gate_sim_time, rejected_commands, fallback ? ", fallback planner drives" : "");
+		return false;
+	}
+
+	if( linear != cmd->linear.x ) {
+		gated_commands++;
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: network command (%.2f, %.2f) collides within %.1f sec, linear velocity %.2f (%d gated)",
+				  cmd->linear.x, cmd->angular.z, gate_sim_time, linear, gated_commands);
+	}
+
+	cmd->linear.x = linear;
+	cmd->angular.z = angular;
+
+	return true;
+
+}
+
+void LSTMPlannerROS::log_shadow(const geometry_msgs::Twist& classic_cmd, bool classic_valid)
+{
+
+	// writer behind: the cycle is not logged, the control loop never waits
+	ShadowSample* sample = shadow_log.Reserve();
+	if( !sample )
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(state_mutex);
+
+		if( net_cmd_time.isZero() )
+			return;
+
+		ros::Time now = ros::Time::now();
+		sample->stamp = now.toSec();
+		sample->net_linear = net_cmd.linear.x;
+		sample->net_angular = net_cmd.angular.z;
+		sample->net_age = (now - net_cmd_time).toSec();
+		sample->sector_start = sector_start;
+		sample->sector_width = sector_width;
+		std::copy(shadow_obstacles.begin(), shadow_obstacles.end(), sample->obstacles.begin());
+	}
+
+	sample->classic_linear = classic_cmd.linear.x;
+	sample->classic_angular = classic_cmd.angular.z;
+	sample->classic_valid = classic_valid;
+
+	shadow_log.Commit();
+
+}
+
+void LSTMPlannerROS::odom_callback(const nav_msgs::Odometry::ConstPtr& odom_msg)
+{
+
+	boost::mutex::scoped_lock lock(state_mutex);
+	current_source.first = odom_msg->pose.pose.position.x;
+	current_source.second = odom_msg->pose.pose.position.y;
+	current_orientation = odom_msg->pose.pose.orientation.z;
+	odom_received = true;
+
+}
+
+void LSTMPlannerROS::scan_callback(const sensor_msgs::LaserScan::ConstPtr& laser_msg)
+{
+
+	QueuedState* queued = scan_queue->Reserve();
+
+	// the inference thread is stalled: the queued states are fresher than nothing, this one is dropped
+	if( !queued ) {
+		dropped_scans++;
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: scan queue full, %lu states dropped", dropped_scans.load());
+		return;
+	}
+
+	if( !downsampler.Downsample(laser_msg->ranges, laser_msg->range_min, laser_msg->range_max, &queued->state[0]) ) {
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: scan has less than %d ranges", averaged_ranges_size);
+		return;
+	}
+
+	// nearest obstacle of the state blocks, for the time to collision of the shadow log
+	if( shadow_mode ) {
+		obstacle_sampler.Downsample(laser_msg->ranges, laser_msg->range_min, laser_msg->range_max, &queued->obstacles[0]);
+		queued->sector_start = laser_msg->angle_min;
+		queued->sector_width = laser_msg->ranges.size() / averaged_ranges_size * laser_msg->angle_increment;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(state_mutex);
+
+		if( !goal_received || !odom_received )
+			return;
+
+		TargetFeatures(current_source, current_target, current_orientation,
+			       &queued->state[averaged_ranges_size], &queued->state[averaged_ranges_size + 1]);
+
+		queued->sequence_start = new_sequence;
+		new_sequence = false;
+	}
+
+	scan_queue->Commit();
+	sem_post(&scans_queued);
+
+}
+
+void LSTMPlannerROS::inference_loop()
+{
+
+	while( true ) {
+
+		// a post per queued state, states already taken with a fresher one leave the queue empty
+		if( sem_wait(&scans_queued) != 0 && errno == EINTR )
+			continue;
+
+		if( inference_stop )
+			break;
+
+		if( take_state() )
+			Forward();
+	}
+
+}
+
+bool LSTMPlannerROS::take_state()
+{
+
+	QueuedState* queued = scan_queue->Front();
+	if( !queued )
+		return false;
+
+	// stale states are dropped, a sequence restart they carry is not
+	bool sequence_start = false;
+	int skipped = 0;
+
+	while( scan_queue->size() > 1 ) {
+		sequence_start = sequence_start || queued->sequence_start;
+		scan_queue->Pop();
+		queued = scan_queue->Front();
+		skipped++;
+	}
+
+	sequence_start = sequence_start || queued->sequence_start;
+
+	if( skipped ) {
+		dropped_scans += skipped;
+		ROS_WARN_THROTTLE(5.0, "LSTM planner: inference slower than the scans, %lu states dropped", dropped_scans.load());
+	}
+
+	// a network loaded in background is taken between two inferences, the previous one
+	// is deleted by the loader - here only if two swaps happen within a poll period
+	LSTMEngine* fresh = pending_engine.exchange(NULL);
+	if( fresh ) {
+		delete retired_engine.exchange(engine);
+		engine = fresh;
+
+		// a swapped network starts with cleared states
+		sequence_start = sequence_start || stateful;
+	}
+
+	float* state = stateful ? &sequence[0] : &window[window_head * state_sequence_size];
+	std::copy(queued->state.begin(), queued->state.end(), state);
+
+	if( shadow_mode ) {
+		std::copy(queued->obstacles.begin(), queued->obstacles.end(), scan_obstacles.begin());
+		scan_sector_start = queued->sector_start;
+		scan_sector_width = queued->sector_width;
+	}
+
+	scan_queue->Pop();
+
+	if( sequence_start ) {
+		window_fill = sequence_step = 0;
+	}
+
+	// sequence_length mirrors the clip of training, 0 keeps the state until the goal changes
+	if( sequence_length > 0 && sequence_step == sequence_length )
+		sequence_step = 0;
+
+	if( stateful ) {
+		sequence_clip[0] = sequence_step == 0 ? 0 : 1;
+		sequence_step++;
+	}
+	else {
+		window_head = (window_head + 1) % time_sequence;
+		window_fill = std::min(window_fill + 1, time_sequence);
+	}
+
+	return true;
+
+}
+
+/* stateful: one timestep per scan, recurrent states stay in the network.
+ * window: evaluated oldest state first, the sequence begins
+ * at the oldest valid state - timesteps before it are cleared by clip
+ */
+void LSTMPlannerROS::Forward()
+{
+
+	ros::WallTime start = ros::WallTime::now();
+
+	// the first inferences may still touch lazily allocated library state
+	bool guarded = check_allocations && inferences++ >= allocation_warmup;
+	if( guarded )
+		malloc_guard.Arm();
+
+	if( !stateful ) {
+
+		int first_valid = time_sequence - window_fill;
+
+		for(int t = 0; t < time_sequence; t++) {
+
+			int slot = (window_head + t) % time_sequence;
+			std::copy(window.data() + slot * state_sequence_size, window.data() + (slot + 1) * state_sequence_size,
+				  sequence.data() + t * state_sequence_size);
+
+			sequence_clip[t] = t > first_valid ? 1 : 0;
+		}
+	}
+
+	const float* out;
+
+#ifdef PLANNER_CAFFE_BACKEND
+	if( net ) {
+
+		float* clip = blobClip->mutable_cpu_data();
+		std::copy(sequence.data(), sequence.data() + evaluated_timesteps * state_sequence_size, blobData->mutable_cpu_data());
+		for(int t = 0; t < evaluated_timesteps; t++)
+			std::fill(&clip[t * state_sequence_size], &clip[(t + 1) * state_sequence_size], sequence_clip[t]);
+
+		net->Forward();
+
+		out = blobOut->cpu_data() + (evaluated_timesteps - 1) * 2;
+	}
+	else
+#endif
+#ifdef PLANNER_COMPILED_MODEL
+	if( compiled_net ) {
+
+		if( stateful )
+			out = compiled_net->Step(&sequence[0], sequence_clip[0] == 0);
+		else
+			out = compiled_net->Forward(&sequence[0], &sequence_clip[0], time_sequence);
+	}
+	else
+#endif
+	if( ensemble ) {
+
+		if( stateful )
+			out = ensemble->Step(&sequence[0], sequence_clip[0] == 0);
+		else
+			out = ensemble->Forward(&sequence[0], &sequence_clip[0], time_sequence);
+	}
+	else if( stateful )
+		out = engine->Step(&sequence[0], sequence_clip[0] == 0);
+	else
+		out = engine->Forward(&sequence[0], &sequence_clip[0], time_sequence);
+
+	if( guarded ) {
+		unsigned long allocations = malloc_guard.Disarm();
+		CHECK_EQ(allocations, 0) << "LSTM planner: inference " << inferences << " allocated on the heap";
+	}
+
+	double inference_time = (ros::WallTime::now() - start).toSec();
+
+	// a late command is a wrong command for the current scan, it is dropped
+	if( inference_time > max_inference_time ) {
+		overruns++;
+		ROS_WARN_THROTTLE(1.0, "LSTM planner: inference took %.4f sec, budget %.4f sec (%d overruns)",
+				  inference_time, max_inference_time, overruns);
+		return;
+	}
+
+	// spread of the members relative to the velocity limits
+	double disagreement = 0;
+	if( ensemble )
+		disagreement = std::max(ensemble->Deviation()[0] / max_vel_x, ensemble->Deviation()[1] / max_rot_vel);
+
+	boost::mutex::scoped_lock lock(state_mutex);
+	net_cmd.linear.x = std::max(-max_vel_x, std::min<double>(max_vel_x, out[0]));
+	net_cmd.angular.z = std::max(-max_rot_vel, std::min<double>(max_rot_vel, out[1]));
+	net_cmd_time = ros::Time::now();
+	net_confident = disagreement <= max_disagreement;
+	uncertain_commands += !net_confident;
+
+	// obstacles of the scan the command was computed from
+	if( shadow_mode ) {
+		std::copy(scan_obstacles.begin(), scan_obstacles.end(), shadow_obstacles.begin());
+		sector_start = scan_sector_start;
+		sector_width = scan_sector_width;
+	}
+
+}
+
+LSTMEngine* LSTMPlannerROS::load_engine(const std::string& path)
+{
+
+	LSTMEngine* candidate = new LSTMEngine();
+
+	if( !candidate->Load(path, state_sequence_size, evaluated_timesteps) ) {
+		LOG(ERROR) << "LSTM planner: can not load " << path;
+		delete candidate;
+		return NULL;
+	}
+
+	if( candidate->output_size() != 2 ) {
+		LOG(ERROR) << "LSTM planner: " << path << " outputs " << candidate->output_size()
+			   << " values, network output must be linear and angular velocity";
+		delete candidate;
+		return NULL;
+	}
+
+	return candidate;
+
+}
+
+void LSTMPlannerROS::model_loader()
+{
+
+	boost::mutex::scoped_lock lock(loader_mutex);
+
+	while( !loader_stop ) {
+
+		loader_condition.timed_wait(lock, boost::posix_time::milliseconds(long(1000 * model_poll_period)));
+
+		// engines the scan thread has swapped out
+		delete retired_engine.exchange(NULL);
+
+		std::string path;
+		path.swap(requested_model);
+
+		std::time_t model_time = 0;
+		if( path.empty() && !model_directory.empty() )
+			path = newest_model(&model_time);
+
+		if( loader_stop || path.empty() )
+			continue;
+
+		// parsing and packing the weights take the time, not the swap
+		lock.unlock();
+		ros::WallTime start = ros::WallTime::now();
+		LSTMEngine* fresh = load_engine(path);
+		double load_time = (ros::WallTime::now() - start).toSec();
+		lock.lock();
+
+		// a broken snapshot is not tried again, only a newer one
+		if( model_time )
+			loaded_model_time = model_time;
+
+		if( fresh ) {
+			delete pending_engine.exchange(fresh);
+			LOG(INFO) << "LSTM planner: " << path << " (" << fresh->name() << ") loaded in " << load_time
+				  << " sec, used from the next scan";
+		}
+	}
+
+}
+
+std::string LSTMPlannerROS::newest_model(std::time_t* model_time)
+{
+
+	namespace fs = boost::filesystem;
+
+	std::string newest;
+	std::time_t newest_time = loaded_model_time;
+	boost::system::error_code error;
+
+	for(fs::directory_iterator it(model_directory, error), end; !error && it != end; it.increment(error)) {
+
+		std::string extension = it->path().extension().string();
+		if( extension != ".caffemodel" && extension != ".nnq" && extension != ".nnw" )
+			continue;
+
+		std::time_t time = fs::last_write_time(it->path(), error);
+		if( !error && time > newest_time ) {
+			newest = it->path().string();
+			newest_time = time;
+		}
+	}
+
+	if( error )
+		ROS_WARN_THROTTLE(10.0, "LSTM planner: can not list %s: %s", model_directory.c_str(), error.message().c_str());
+
+	// caffe writes snapshots in place: a file modified within the last poll may be partial
+	if( newest.empty() || std::difftime(std::time(NULL), newest_time) < model_poll_period )
+		return std::string();
+
+	*model_time = newest_time;
+	return newest;
+
+}
+
+bool LSTMPlannerROS::reload_callback(std_srvs::Trigger::Request& request, std_srvs::Trigger::Response& response)
+{
+
+	std::string path;
+	private_nh.param("trained_weights", path, trained_weights);
+
+	{
+		boost::mutex::scoped_lock lock(loader_mutex);
+		requested_model = path;
+	}
+	loader_condition.notify_one();
+
+	response.success = true;
+	response.message = "loading " + path + ", swapped in once loaded";
+	return true;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,41 @@
+#include <neural_network_planner/malloc_guard.h>
+
+#include <dlfcn.h>
+
+
+namespace neural_network_planner {
+
+
+// resolved in the preloaded library, if any
+MallocGuard::MallocGuard()
+{
+
+	arm = reinterpret_cast<void (*)(int)>(dlsym(RTLD_DEFAULT, "nn_malloc_guard_arm"));
+	allocations = reinterpret_cast<unsigned long (*)()>(dlsym(RTLD_DEFAULT, "nn_malloc_guard_allocations"));
+
+	if( !allocations )
+		arm = 0;
+
+}
+
+void MallocGuard::Arm()
+{
+
+	if( arm )
+		arm(1);
+
+}
+
+unsigned long MallocGuard::Disarm()
+{
+
+	if( !arm )
+		return 0;
+
+	arm(0);
+	return allocations();
+
+}
+
+
+} // namespace neural_network_planner
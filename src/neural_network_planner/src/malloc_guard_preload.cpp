@@ -0,0 +1,110 @@
+// libnn_malloc_guard.so: counts heap allocations of the threads armed by MallocGuard,
+// preloaded in the planner process for debugging, e.g. launch-prefix="env LD_PRELOAD=.../libnn_malloc_guard.so"
+// allocations are forwarded to glibc, nothing else changes
+
+#include <cerrno>
+#include <cstddef>
+
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+}
+
+
+namespace {
+
+// static TLS, known at startup: a dynamic TLS access could allocate itself
+__thread int armed __attribute__((tls_model("initial-exec"))) = 0;
+__thread unsigned long allocations __attribute__((tls_model("initial-exec"))) = 0;
+
+inline void count()
+{
+
+	if( armed )
+		allocations++;
+
+}
+
+} // namespace
+
+
+extern "C" {
+
+void nn_malloc_guard_arm(int on)
+{
+
+	armed = on;
+	if( on )
+		allocations = 0;
+
+}
+
+unsigned long nn_malloc_guard_allocations()
+{
+
+	return allocations;
+
+}
+
+void* malloc(size_t size)
+{
+
+	count();
+	return __libc_malloc(size);
+
+}
+
+void* calloc(size_t number, size_t size)
+{
+
+	count();
+	return __libc_calloc(number, size);
+
+}
+
+void* realloc(void* pointer, size_t size)
+{
+
+	count();
+	return __libc_realloc(pointer, size);
+
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+
+	count();
+	return __libc_memalign(alignment, size);
+
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+
+	count();
+	return __libc_memalign(alignment, size);
+
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size)
+{
+
+	if( alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 )
+		return EINVAL;
+
+	count();
+	void* memory = __libc_memalign(alignment, size);
+	if( memory == NULL && size != 0 )
+		return ENOMEM;
+
+	*pointer = memory;
+	return 0;
+
+}
+
+}
@@ -0,0 +1,118 @@
+#include <neural_network_planner/mapped_data_layer.h>
+
+#include "caffe/layer_factory.hpp"
+
+#include "glog/logging.h"
+
+#include <algorithm>
+
+
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+template <typename Dtype>
+void MappedDataLayer<Dtype>::LayerSetUp(const vector<caffe::Blob<Dtype>*>& bottom, const vector<caffe::Blob<Dtype>*>& top)
+{
+
+	const caffe::DataParameter& param = this->layer_param_.data_param();
+
+	dataset.reset(new StepDataset());
+	CHECK(dataset->Open(param.source())) << "MappedData: can not read " << param.source();
+	CHECK_GT(dataset->count(), 0) << "MappedData: no step in " << param.source();
+
+	batch_size = param.batch_size();
+	position = 0;
+
+	// every batch made of whole windows: one sequential read of time ordered steps
+	if( dataset->window_length() > 0 )
+		CHECK_EQ(batch_size % dataset->window_length(), 0) << "MappedData: batch_size must be a multiple of the "
+								     << dataset->window_length() << " step windows of " << param.source();
+
+	vector<int> shape(2);
+	shape[0] = batch_size;
+	shape[1] = dataset->state_size();
+	top[0]->Reshape(shape);
+	if( top.size() > 2 )
+		top[2]->Reshape(shape);
+
+	shape[1] = dataset->label_size();
+	top[1]->Reshape(shape);
+
+	LOG(INFO) << "MappedData " << param.source() << ": " << dataset->count() << " steps of " << dataset->episode_count()
+		  << " episodes, batches of " << batch_size;
+
+}
+
+template <typename Dtype>
+void MappedDataLayer<Dtype>::Forward_cpu(const vector<caffe::Blob<Dtype>*>& bottom, const vector<caffe::Blob<Dtype>*>& top)
+{
+
+	const int state_size = dataset->state_size();
+	const int label_size = dataset->label_size();
+	const int32_t* episodes = dataset->episodes();
+
+	Dtype* data = top[0]->mutable_cpu_data();
+	Dtype* labels = top[1]->mutable_cpu_data();
+	Dtype* clip = top.size() > 2 ? top[2]->mutable_cpu_data() : NULL;
+
+	// consecutive steps are contiguous in the columns: a copy per run up to the end of the dataset
+	for(int b = 0; b < batch_size; ) {
+
+		int run = std::min<uint64_t>(batch_size - b, dataset->count() - position);
+
+		const float* states = dataset->states() + position * state_size;
+		std::copy(states, states + run * state_size, data + b * state_size);
+
+		const float* step_labels = dataset->labels() + position * label_size;
+		std::copy(step_labels, step_labels + run * label_size, labels + b * label_size);
+
+		for(int i = 0; clip && i < run; i++) {
+			uint64_t step = position + i;
+			Dtype cont = step > 0 && episodes[step] == episodes[step - 1] ? 1 : 0;
+			std::fill(clip + (b + i) * state_size, clip + (b + i + 1) * state_size, cont);
+		}
+
+		b += run;
+		position += run;
+		if( position == dataset->count() )
+			position = 0;
+	}
+
+}
+
+
+template class MappedDataLayer<float>;
+template class MappedDataLayer<double>;
+
+
+namespace {
+
+template <typename Dtype>
+boost::shared_ptr<caffe::Layer<Dtype> > create_mapped_data_layer(const caffe::LayerParameter& param)
+{
+
+	return boost::shared_ptr<caffe::Layer<Dtype> >(new MappedDataLayer<Dtype>(param));
+
+}
+
+} // namespace
+
+
+void RegisterMappedDataLayer()
+{
+
+	static bool registered = false;
+	if( registered )
+		return;
+
+	caffe::LayerRegistry<float>::AddCreator("MappedData", &create_mapped_data_layer<float>);
+	caffe::LayerRegistry<double>::AddCreator("MappedData", &create_mapped_data_layer<double>);
+	registered = true;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,368 @@
+#include <neural_network_planner/mapped_model.h>
+#include <neural_network_planner/byte_order.h>
+
+#include "glog/logging.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'W', '1' };
+
+const uint32_t kVersion = 1;
+
+const int kMaxElements = 1 << 28;
+
+size_t tensor_bytes(int dtype, size_t count)
+{
+
+	return dtype == TENSOR_INT8 ? count : count * sizeof(float);
+
+}
+
+size_t align(size_t offset)
+{
+
+	return (offset + kMappedAlignment - 1) / kMappedAlignment * kMappedAlignment;
+
+}
+
+
+class Writer
+{
+
+public:
+
+	void Bytes(const void* data, size_t size) { if( size ) buffer.append(static_cast<const char*>(data), size); }
+	void Int(int32_t v) { Bytes(&v, sizeof(v)); }
+	void Uint(uint32_t v) { Bytes(&v, sizeof(v)); }
+	void Long(uint64_t v) { Bytes(&v, sizeof(v)); }
+	void Float(float v) { Bytes(&v, sizeof(v)); }
+	void String(const string& s) { Int(s.size()); Bytes(s.data(), s.size()); }
+
+	string buffer;
+
+};
+
+// bounded reads from the mapping
+class Reader
+{
+
+public:
+
+	Reader(const char* d, size_t s) : ok(true), data(d), size(s), position(0) {}
+
+	void Bytes(void* out, size_t n) {
+		ok = ok && n <= size - position;
+		if( ok ) {
+			memcpy(out, data + position, n);
+			position += n;
+		}
+	}
+
+	int32_t Int() { int32_t v = 0; Bytes(&v, sizeof(v)); return v; }
+	uint32_t Uint() { uint32_t v = 0; Bytes(&v, sizeof(v)); return v; }
+	uint64_t Long() { uint64_t v = 0; Bytes(&v, sizeof(v)); return v; }
+	float Float() { float v = 0; Bytes(&v, sizeof(v)); return v; }
+
+	string String() {
+		int32_t n = Int();
+		if( !ok || n < 0 || n > size - position ) {
+			ok = false;
+			return string();
+		}
+		string s(data + position, n);
+		position += n;
+		return s;
+	}
+
+	int Count(int limit) {
+		int32_t n = Int();
+		if( n < 0 || n > limit )
+			ok = false;
+		return ok ? n : 0;
+	}
+
+	bool ok;
+
+private:
+
+	const char* data;
+	size_t size, position;
+
+};
+
+} // namespace
+
+
+MappedModel::MappedModel() : mapping(NULL), size_(0)
+{
+
+}
+
+MappedModel::~MappedModel()
+{
+
+	if( mapping )
+		munmap(mapping, size_);
+
+}
+
+bool MappedModel::Open(const string& path, NetDescription* net)
+{
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if( fd < 0 ) {
+		LOG(ERROR) << "Can not open model " << path;
+		return false;
+	}
+
+	struct stat info;
+	if( fstat(fd, &info) != 0 || info.st_size < sizeof(kMagic) ) {
+		LOG(ERROR) << "Can not read model " << path;
+		close(fd);
+		return false;
+	}
+
+	size_ = info.st_size;
+	mapping = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( mapping == MAP_FAILED ) {
+		LOG(ERROR) << "Can not map model " << path;
+		mapping = NULL;
+		return false;
+	}
+
+	const char* base = static_cast<const char*>(mapping);
+	Reader in(base, size_);
+
+	char magic[4] = { 0, 0, 0, 0 };
+	in.Bytes(magic, sizeof(magic));
+	in.ok = in.ok && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+
+	uint32_t byte_order = in.Uint(), version = in.Uint(), alignment = in.Uint();
+
+	if( !in.ok || !NativeByteOrder(byte_order) || version != kVersion || alignment != kMappedAlignment ) {
+		LOG(ERROR) << path << " is not a version " << kVersion << " .nnw model of this byte order";
+		return false;
+	}
+
+	net->name = in.String();
+	net->layers.clear();
+	net->layers.resize(in.Count(1 << 16));
+
+	for(int i = 0; in.ok && i < net->layers.size(); i++) {
+
+		LayerDescription& layer = net->layers[i];
+
+		layer.name = in.String();
+		layer.type = in.String();
+		layer.bottom.resize(in.Count(1 << 10));
+		for(int j = 0; j < layer.bottom.size(); j++)
+			layer.bottom[j] = in.String();
+		layer.top.resize(in.Count(1 << 10));
+		for(int j = 0; j < layer.top.size(); j++)
+			layer.top[j] = in.String();
+
+		layer.num_output = in.Int();
+		layer.axis = in.Int();
+		layer.bias_term = in.Int();
+		layer.transpose = in.Int();
+		layer.has_use_global_stats = in.Int();
+		layer.use_global_stats = in.Int();
+		layer.eps = in.Float();
+		layer.concat_axis = in.Int();
+
+		// shapes only, the weights are in the tensors
+		layer.blobs.resize(in.Count(1 << 10));
+		for(int j = 0; in.ok && j < layer.blobs.size(); j++) {
+			layer.blobs[j].shape.resize(in.Count(8));
+			for(int k = 0; k < layer.blobs[j].shape.size(); k++)
+				layer.blobs[j].shape[k] = in.Count(kMaxElements);
+		}
+	}
+
+	tensors.clear();
+	int num_tensors = in.Count(1 << 16);
+
+	for(int i = 0; in.ok && i < num_tensors; i++) {
+
+		MappedTensor tensor;
+		tensor.name = in.String();
+		tensor.dtype = in.Int();
+		tensor.count = in.Long();
+		uint64_t offset = in.Long();
+
+		if( (tensor.dtype != TENSOR_FLOAT32 && tensor.dtype != TENSOR_INT8) || tensor.count > kMaxElements
+		    || offset % kMappedAlignment != 0 || offset > size_ || tensor_bytes(tensor.dtype, tensor.count) > size_ - offset ) {
+			in.ok = false;
+			break;
+		}
+
+		tensor.data = base + offset;
+		tensors[tensor.name] = tensor;
+	}
+
+	if( !in.ok || net->layers.empty() ) {
+		LOG(ERROR) << "Can not parse mapped model " << path;
+		tensors.clear();
+		return false;
+	}
+
+	return true;
+
+}
+
+const MappedTensor* MappedModel::find(const string& name, int dtype, size_t count) const
+{
+
+	std::map<string, MappedTensor>::const_iterator it = tensors.find(name);
+	if( it == tensors.end() ) {
+		LOG(ERROR) << "Mapped model has no tensor " << name;
+		return NULL;
+	}
+
+	if( it->second.dtype != dtype || it->second.count != count ) {
+		LOG(ERROR) << "Mapped tensor " << name << ": " << it->second.count << " values of type " << it->second.dtype
+			   << ", expected " << count << " of type " << dtype;
+		return NULL;
+	}
+
+	return &it->second;
+
+}
+
+const float* MappedModel::Floats(const string& name, size_t count) const
+{
+
+	const MappedTensor* tensor = find(name, TENSOR_FLOAT32, count);
+	return tensor ? static_cast<const float*>(tensor->data) : NULL;
+
+}
+
+const int8_t* MappedModel::Int8(const string& name, size_t count) const
+{
+
+	const MappedTensor* tensor = find(name, TENSOR_INT8, count);
+	return tensor ? static_cast<const int8_t*>(tensor->data) : NULL;
+
+}
+
+
+bool WriteMappedModel(const string& path, const NetDescription& net, const vector<MappedTensor>& tensors)
+{
+
+	Writer out;
+	out.Bytes(kMagic, sizeof(kMagic));
+	out.Uint(kByteOrder);
+	out.Uint(kVersion);
+	out.Uint(kMappedAlignment);
+	out.String(net.name);
+	out.Int(net.layers.size());
+
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		const LayerDescription& layer = net.layers[i];
+
+		out.String(layer.name);
+		out.String(layer.type);
+		out.Int(layer.bottom.size());
+		for(int j = 0; j < layer.bottom.size(); j++)
+			out.String(layer.bottom[j]);
+		out.Int(layer.top.size());
+		for(int j = 0; j < layer.top.size(); j++)
+			out.String(layer.top[j]);
+
+		out.Int(layer.num_output);
+		out.Int(layer.axis);
+		out.Int(layer.bias_term);
+		out.Int(layer.transpose);
+		out.Int(layer.has_use_global_stats);
+		out.Int(layer.use_global_stats);
+		out.Float(layer.eps);
+		out.Int(layer.concat_axis);
+
+		out.Int(layer.blobs.size());
+		for(int j = 0; j < layer.blobs.size(); j++) {
+			out.Int(layer.blobs[j].shape.size());
+			for(int k = 0; k < layer.blobs[j].shape.size(); k++)
+				out.Int(layer.blobs[j].shape[k]);
+		}
+	}
+
+	// the table has a fixed size per entry: offsets follow it, aligned
+	size_t table_size = sizeof(int32_t);
+	for(int i = 0; i < tensors.size(); i++)
+		table_size += sizeof(int32_t) + tensors[i].name.size() + sizeof(int32_t) + 2 * sizeof(uint64_t);
+
+	vector<uint64_t> offsets(tensors.size());
+	size_t offset = align(out.buffer.size() + table_size);
+
+	out.Int(tensors.size());
+	for(int i = 0; i < tensors.size(); i++) {
+		offsets[i] = offset;
+		out.String(tensors[i].name);
+		out.Int(tensors[i].dtype);
+		out.Long(tensors[i].count);
+		out.Long(offsets[i]);
+		offset = align(offset + tensor_bytes(tensors[i].dtype, tensors[i].count));
+	}
+
+	for(int i = 0; i < tensors.size(); i++) {
+		out.buffer.resize(offsets[i], '\0');
+		out.Bytes(tensors[i].data, tensor_bytes(tensors[i].dtype, tensors[i].count));
+	}
+
+	string temporary = path + ".tmp";
+	FILE* model = fopen(temporary.c_str(), "wb");
+	if( model == NULL ) {
+		LOG(ERROR) << "Can not open " << temporary << " for writing";
+		return false;
+	}
+
+	bool ok = fwrite(out.buffer.data(), 1, out.buffer.size(), model) == out.buffer.size();
+	ok = fclose(model) == 0 && ok;
+	ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+
+	if( !ok ) {
+		LOG(ERROR) << "Can not write " << path;
+		remove(temporary.c_str());
+	}
+
+	return ok;
+
+}
+
+bool IsMappedModel(const string& path)
+{
+
+	FILE* model = fopen(path.c_str(), "rb");
+	if( model == NULL )
+		return false;
+
+	char magic[4] = { 0, 0, 0, 0 };
+	bool mapped = fread(magic, 1, sizeof(magic), model) == sizeof(magic)
+		      && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+	fclose(model);
+
+	return mapped;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,214 @@
+#include <neural_network_planner/net_transforms.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+void BatchNormAffine(const LayerDescription& batch_norm, vector<float>* scale, vector<float>* shift)
+{
+
+	const vector<BlobDescription>& blobs = batch_norm.blobs;
+
+	int C = blobs[0].count();
+	float factor = blobs[2].data[0] == 0 ? 0 : 1 / blobs[2].data[0];
+
+	scale->resize(C);
+	shift->resize(C);
+
+	for(int c = 0; c < C; c++) {
+		float mean = factor * blobs[0].data[c];
+		float variance = factor * blobs[1].data[c];
+		(*scale)[c] = 1 / sqrt(variance + batch_norm.eps);
+		(*shift)[c] = -mean * (*scale)[c];
+	}
+
+}
+
+bool PruneNet(NetDescription* net, const string& output_blob)
+{
+
+	vector<bool> used;
+	if( !RequiredLayers(*net, output_blob, &used) )
+		return false;
+
+	vector<LayerDescription> layers;
+	for(int i = 0; i < net->layers.size(); i++)
+		if( used[i] )
+			layers.push_back(net->layers[i]);
+
+	LOG(INFO) << "Pruned " << net->layers.size() - layers.size() << " layers of " << net->name
+		  << " not needed for " << output_blob;
+
+	net->layers.swap(layers);
+	return true;
+
+}
+
+
+namespace {
+
+vector<int> consumers(const NetDescription& net, const string& blob)
+{
+
+	vector<int> readers;
+	for(int i = 0; i < net.layers.size(); i++)
+		if( std::find(net.layers[i].bottom.begin(), net.layers[i].bottom.end(), blob) != net.layers[i].bottom.end() )
+			readers.push_back(i);
+	return readers;
+
+}
+
+bool uniform(const vector<float>& values)
+{
+
+	for(int i = 1; i < values.size(); i++)
+		if( fabs(values[i] - values[0]) > 1e-6 * std::max(1.f, fabsf(values[0])) )
+			return false;
+	return true;
+
+}
+
+bool foldable(const LayerDescription& layer, const string& blob, const vector<float>& scale, const vector<float>& shift)
+{
+
+	if( layer.blobs.empty() || layer.blobs[0].quantized() || layer.bottom[0] != blob )
+		return false;
+
+	if( layer.type == "InnerProduct" ) {
+		int K = layer.transpose ? layer.blobs[0].shape[0] : layer.blobs[0].shape[1];
+		return layer.axis == 1 && K % scale.size() == 0;
+	}
+
+	if( layer.type == "LSTM" )
+		return uniform(scale) && uniform(shift);
+
+	return false;
+
+}
+
+/* W' = W diag(scale of the channel of each input), b' = b + W shift
+ * LSTM: a single channel transform, inputs are the values of one stream
+ */
+void fold(LayerDescription* layer, const vector<float>& scale, const vector<float>& shift)
+{
+
+	BlobDescription& W = layer->blobs[0];
+	bool lstm = layer->type == "LSTM";
+	bool transpose = !lstm && layer->transpose;
+
+	int M = transpose ? W.shape[1] : W.shape[0];
+	int K = transpose ? W.shape[0] : W.shape[1];
+	int inner = lstm ? K : K / scale.size();
+
+	if( layer->blobs.size() < 2 ) {
+		layer->blobs.push_back(BlobDescription());
+		layer->blobs[1].shape.assign(1, M);
+		layer->blobs[1].data.assign(M, 0);
+		layer->bias_term = true;
+	}
+
+	vector<float>& bias = layer->blobs[1].data;
+
+	for(int m = 0; m < M; m++) {
+		for(int k = 0; k < K; k++) {
+			float& w = transpose ? W.data[k * M + m] : W.data[m * K + k];
+			int c = k / inner;
+			bias[m] += w * shift[c];
+			w *= scale[c];
+		}
+	}
+
+}
+
+} // namespace
+
+
+int FoldBatchNorm(NetDescription* net)
+{
+
+	int folded = 0;
+
+	for(int i = 0; i < net->layers.size(); i++) {
+
+		LayerDescription& batch_norm = net->layers[i];
+		if( batch_norm.type != "BatchNorm" )
+			continue;
+
+		// whatever is folded or not, inference uses the moving averages
+		batch_norm.has_use_global_stats = true;
+		batch_norm.use_global_stats = true;
+
+		if( batch_norm.blobs.size() != 3 || batch_norm.bottom.size() != 1 || batch_norm.top.size() != 1
+		    || batch_norm.bottom[0] == batch_norm.top[0] ) {
+			LOG(INFO) << "BatchNorm " << batch_norm.name << " is computed in place or malformed: kept";
+			continue;
+		}
+
+		vector<float> scale, shift;
+		BatchNormAffine(batch_norm, &scale, &shift);
+
+		// caffe BatchNorm has no learned parameters, a Scale layer usually follows
+		string output = batch_norm.top[0];
+		vector<int> readers = consumers(*net, output);
+		int scale_layer = -1;
+
+		if( readers.size() == 1 && net->layers[readers[0]].type == "Scale" ) {
+
+			const LayerDescription& affine = net->layers[readers[0]];
+			if( affine.axis != 1 || affine.blobs.empty() || affine.blobs[0].count() != scale.size()
+			    || affine.top[0] == output ) {
+				LOG(INFO) << "BatchNorm " << batch_norm.name << ": Scale " << affine.name << " can not be merged, kept";
+				continue;
+			}
+
+			for(int c = 0; c < scale.size(); c++) {
+				float gamma = affine.blobs[0].data[c];
+				float beta = affine.blobs.size() > 1 ? affine.blobs[1].data[c] : 0;
+				scale[c] *= gamma;
+				shift[c] = shift[c] * gamma + beta;
+			}
+
+			scale_layer = readers[0];
+			output = affine.top[0];
+			readers = consumers(*net, output);
+		}
+
+		bool fold_all = !readers.empty();
+		for(int r = 0; r < readers.size(); r++)
+			fold_all = fold_all && foldable(net->layers[readers[r]], output, scale, shift);
+
+		if( !fold_all ) {
+			LOG(INFO) << "BatchNorm " << batch_norm.name << " can not be folded in the layers reading " << output << ": kept";
+			continue;
+		}
+
+		for(int r = 0; r < readers.size(); r++) {
+			fold(&net->layers[readers[r]], scale, shift);
+			net->layers[readers[r]].bottom[0] = batch_norm.bottom[0];
+		}
+
+		LOG(INFO) << "BatchNorm " << batch_norm.name << (scale_layer >= 0 ? " and its Scale" : "")
+			  << " folded in " << readers.size() << " layers";
+
+		if( scale_layer >= 0 )
+			net->layers.erase(net->layers.begin() + scale_layer);
+		net->layers.erase(net->layers.begin() + i);
+		i--;
+		folded++;
+	}
+
+	return folded;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,205 @@
+// packs the steps of BuildDatabase (a columnar .nnd dataset or a unified steps database)
+// into a .nnd of window_length step windows for the MappedData layer: the steps of every
+// episode are time ordered and cut where the recording pauses longer than max_gap seconds,
+// every continuous segment gives consecutive windows stored contiguously, its last steps
+// short of a window are dropped. The episodes of the output are the segments: clip is 0
+// where a goal starts or the recording resumes, a batch of whole windows is a sequential read.
+// Steps are stored once per sampling period (1 / sampling_rate of build_database) at most,
+// max_gap must be above that period and its jitter: auto, the default, takes kGapPeriods
+// times the median stamp difference of consecutive steps of an episode - the sampling period,
+// a missed step is kept, a longer pause cuts. 0 never cuts
+// usage: pack_windows steps output.nnd [window_length] [max_gap|auto] [backend]
+
+#include <neural_network_planner/step_dataset.h>
+#include <neural_network_planner/step_record.h>
+
+#include "boost/scoped_ptr.hpp"
+#include "caffe/util/db.hpp"
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using boost::lexical_cast;
+using boost::scoped_ptr;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+struct Step
+{
+	int episode;
+	double stamp;
+	// row in the loaded columns
+	uint64_t index;
+
+	bool operator<(const Step& other) const {
+		return episode != other.episode ? episode < other.episode : stamp < other.stamp;
+	}
+};
+
+
+// max_gap auto: sampling periods of a pause cutting a segment
+const double kGapPeriods = 2.5;
+
+
+struct Steps
+{
+	int state_size, label_size;
+	vector<float> states, labels;
+	vector<Step> order;
+};
+
+
+void read_dataset(const string& path, Steps* steps)
+{
+
+	StepDataset dataset;
+	CHECK(dataset.Open(path)) << "can not read " << path;
+
+	steps->state_size = dataset.state_size();
+	steps->label_size = dataset.label_size();
+	steps->states.assign(dataset.states(), dataset.states() + dataset.count() * dataset.state_size());
+	steps->labels.assign(dataset.labels(), dataset.labels() + dataset.count() * dataset.label_size());
+
+	for(uint64_t i = 0; i < dataset.count(); i++) {
+		Step step = { dataset.episodes()[i], dataset.stamps()[i], i };
+		steps->order.push_back(step);
+	}
+
+}
+
+void read_database(const string& path, const string& backend, Steps* steps)
+{
+
+	scoped_ptr<caffe::db::DB> database(caffe::db::GetDB(backend));
+	database->Open(path, caffe::db::READ);
+	scoped_ptr<caffe::db::Cursor> cursor(database->NewCursor());
+
+	StepRecord record;
+	for(uint64_t i = 0; cursor->valid(); cursor->Next(), i++) {
+
+		string value = cursor->value();
+		CHECK(DecodeStepRecord(value, &record)) << path << " is not a steps database, key " << cursor->key();
+
+		if( i == 0 ) {
+			steps->state_size = record.header->state_size;
+			steps->label_size = record.header->label_size;
+		}
+		CHECK(record.header->state_size == steps->state_size && record.header->label_size == steps->label_size)
+			<< "step " << cursor->key() << " differs in size";
+
+		steps->states.insert(steps->states.end(), record.state, record.state + steps->state_size);
+		steps->labels.insert(steps->labels.end(), record.label, record.label + steps->label_size);
+
+		Step step = { record.header->episode, record.header->stamp, i };
+		steps->order.push_back(step);
+	}
+
+}
+
+
+// median stamp difference of consecutive steps of an episode, steps time ordered; 0 without any
+double median_period(const vector<Step>& order)
+{
+
+	vector<double> deltas;
+	for(size_t i = 1; i < order.size(); i++)
+		if( order[i].episode == order[i - 1].episode )
+			deltas.push_back(order[i].stamp - order[i - 1].stamp);
+
+	if( deltas.empty() )
+		return 0;
+
+	std::nth_element(deltas.begin(), deltas.begin() + deltas.size() / 2, deltas.end());
+	return deltas[deltas.size() / 2];
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s steps output.nnd [window_length] [max_gap|auto] [backend]\n"
+		       "max_gap: seconds above the sampling period (1 / sampling_rate) of the recording,\n"
+		       "auto: %.1f times the median period of the steps, 0: no cut\n", argv[0], kGapPeriods);
+		return 1;
+	}
+
+	string source = argv[1], output = argv[2];
+	int window_length = argc > 3 ? lexical_cast<int>(argv[3]) : 16;
+	string gap = argc > 4 ? argv[4] : "auto";
+	string backend = argc > 5 ? argv[5] : "lmdb";
+
+	CHECK_GT(window_length, 0);
+
+	Steps steps;
+	steps.state_size = steps.label_size = 0;
+	if( IsStepDataset(source) )
+		read_dataset(source, &steps);
+	else
+		read_database(source, backend, &steps);
+
+	CHECK(!steps.order.empty()) << "no step in " << source;
+
+	// time order inside every episode, episodes in the order of their goals
+	std::stable_sort(steps.order.begin(), steps.order.end());
+
+	double period = median_period(steps.order);
+	double max_gap = gap == "auto" ? kGapPeriods * period : lexical_cast<double>(gap);
+	CHECK_GE(max_gap, 0);
+
+	if( gap != "auto" && max_gap > 0 && max_gap <= period )
+		LOG(WARNING) << "max_gap " << max_gap << " s is not above the " << period << " s median period of the steps: "
+			     << "most of them start a segment";
+	printf("%s: median period %.3f s, segments cut at pauses over %.3f s\n", source.c_str(), period, max_gap);
+
+	StepDatasetWriter writer;
+	CHECK(writer.Open(output, steps.state_size, steps.label_size, window_length)) << "can not write " << output;
+
+	int segments = 0, windows = 0;
+	for(size_t begin = 0, end; begin < steps.order.size(); begin = end) {
+
+		// continuous segment: same episode, no pause longer than max_gap
+		for(end = begin + 1; end < steps.order.size(); end++) {
+			const Step& previous = steps.order[end - 1];
+			const Step& step = steps.order[end];
+			if( step.episode != previous.episode || (max_gap > 0 && step.stamp - previous.stamp > max_gap) )
+				break;
+		}
+
+		size_t packed = (end - begin) / window_length * window_length;
+		if( packed == 0 )
+			continue;
+
+		for(size_t i = begin; i < begin + packed; i++) {
+			const Step& step = steps.order[i];
+			CHECK(writer.Append(&steps.states[step.index * steps.state_size], &steps.labels[step.index * steps.label_size],
+					    segments, step.stamp)) << "can not write " << output;
+		}
+
+		segments++;
+		windows += packed / window_length;
+	}
+
+	uint64_t written = writer.count();
+	CHECK(writer.Close()) << "can not complete " << output;
+
+	printf("%s: %lu steps, %d segments of %d step windows: %d windows, %lu steps packed, %lu dropped\n",
+	       output.c_str(), (unsigned long)steps.order.size(), segments, window_length, windows,
+	       (unsigned long)written, (unsigned long)(steps.order.size() - written));
+
+	if( 2 * written < steps.order.size() )
+		LOG(WARNING) << "Most steps dropped as segments shorter than a window: check max_gap (" << max_gap
+			     << " s) against the sampling period, or use a shorter window_length";
+
+	return 0;
+
+}
@@ -0,0 +1,231 @@
+// int8 post training quantization of a trained LSTM net for the inference engine:
+// weight scales are calibrated on recorded states, the int8 net is then compared
+// with the float one on the validation databases used by TrainValidateRNN
+// usage: quantize_model weights.caffemodel output.nnq calibration_steps_db validation_steps_db validation_labels_db
+//                       [calibration_steps] [validate_set_size] [time_sequence] [averaged_ranges_size] [backend]
+// steps databases: states_db of a split recording, unified steps_db or .nnd dataset, validation_labels_db -
+// for the labels of a unified or .nnd validation recording
+
+#include <neural_network_planner/lstm_engine.h>
+#include <neural_network_planner/quantized_model.h>
+#include <neural_network_planner/state_features.h>
+#include <neural_network_planner/step_database.h>
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using boost::lexical_cast;
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+
+/* calibration statistics of a quantized layer: inputs of the fused product,
+ * LSTM [ x ; cont * h_prev ] per stream, InnerProduct the whole bottom blob
+ */
+struct Calibration
+{
+	int layer;
+	InputMoments moments;
+};
+
+void accumulate(const LSTMEngine& engine, const LayerDescription& desc, const vector<float>& clip,
+		int timesteps, Calibration* calibration)
+{
+
+	const EngineBlob* bottom = engine.blob(desc.bottom[0]);
+	const EngineBlob* top = engine.blob(desc.top[0]);
+	CHECK(bottom && top) << "layer " << desc.name << " is not evaluated by the engine";
+
+	int K = calibration->moments.size();
+	vector<float> z(K);
+
+	if( desc.type == "InnerProduct" ) {
+		for(int t = 0; t < timesteps; t++)
+			calibration->moments.Add(bottom->at(t));
+		return;
+	}
+
+	int X = bottom->inner, H = top->inner;
+
+	for(int t = 0; t < timesteps; t++) {
+		for(int n = 0; n < bottom->channels; n++) {
+
+			std::copy(bottom->at(t) + n * X, bottom->at(t) + (n + 1) * X, z.begin());
+
+			if( t > 0 && clip[t] != 0 )
+				for(int d = 0; d < H; d++)
+					z[X + d] = clip[t] * top->at(t - 1)[n * H + d];
+			else
+				std::fill(z.begin() + X, z.end(), 0.f);
+
+			calibration->moments.Add(&z[0]);
+		}
+	}
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 6 ) {
+		printf("usage: %s weights.caffemodel output.nnq calibration_steps_db validation_steps_db validation_labels_db"
+		       " [calibration_steps] [validate_set_size] [time_sequence] [averaged_ranges_size] [backend]\n", argv[0]);
+		return 1;
+	}
+
+	string weights = argv[1], output = argv[2];
+	int calibration_steps = argc > 6 ? lexical_cast<int>(argv[6]) : 1000;
+	int validate_set_size = argc > 7 ? lexical_cast<int>(argv[7]) : 1000;
+	int time_sequence = argc > 8 ? lexical_cast<int>(argv[8]) : 16;
+	int averaged_ranges_size = argc > 9 ? lexical_cast<int>(argv[9]) : 24;
+	string backend = argc > 10 ? argv[10] : "lmdb";
+
+	int state_sequence_size = state_size(averaged_ranges_size);
+	const int labels_size = 2;
+
+	NetDescription net;
+	CHECK(ReadCaffeModel(weights, &net)) << "can not read " << weights;
+
+	LSTMEngine reference;
+	CHECK(reference.Load(net, state_sequence_size, time_sequence)) << "engine can not load " << weights;
+	CHECK_EQ(reference.output_size(), labels_size);
+
+	vector<float> calibration_states, validation_states, validation_labels;
+	calibration_steps = ReadSteps(argv[3], backend, calibration_steps, state_sequence_size, &calibration_states, labels_size, NULL);
+
+	// labels of a split recording in their own database
+	string validation_labels_path = argv[5];
+	if( validation_labels_path == "-" )
+		validate_set_size = ReadSteps(argv[4], backend, validate_set_size, state_sequence_size, &validation_states,
+					      labels_size, &validation_labels);
+	else {
+		validate_set_size = ReadSteps(argv[4], backend, validate_set_size, state_sequence_size, &validation_states,
+					      labels_size, NULL);
+		CHECK_EQ(ReadSteps(validation_labels_path, backend, validate_set_size, state_sequence_size, NULL,
+				   labels_size, &validation_labels), validate_set_size)
+			<< "validation states and labels databases differ in size";
+	}
+
+	CHECK_GE(calibration_steps, time_sequence) << "not enough calibration steps";
+	CHECK_GE(validate_set_size, time_sequence) << "not enough validation steps";
+
+	// windows of consecutive steps, as the train and test nets read the databases
+	vector<float> clip(time_sequence, 1);
+	clip[0] = 0;
+
+	// calibration of every weight layer the output depends on
+	vector<bool> used;
+	RequiredLayers(net, "out", &used);
+
+	vector<shared_ptr<Calibration> > calibrations;
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		const LayerDescription& desc = net.layers[i];
+		if( !used[i] || desc.blobs.empty() || (desc.type != "LSTM" && desc.type != "InnerProduct") )
+			continue;
+
+		int K = desc.type == "LSTM" ? desc.blobs[0].shape[1] + desc.blobs[2].shape[1] : desc.blobs[0].count() / desc.blobs[0].shape[0];
+
+		shared_ptr<Calibration> calibration(new Calibration());
+		calibration->layer = i;
+		calibration->moments = InputMoments(K);
+		calibrations.push_back(calibration);
+	}
+
+	int calibration_windows = calibration_steps / time_sequence;
+	for(int w = 0; w < calibration_windows; w++) {
+		reference.Forward(&calibration_states[w * time_sequence * state_sequence_size], &clip[0], time_sequence);
+		for(int i = 0; i < calibrations.size(); i++)
+			accumulate(reference, net.layers[calibrations[i]->layer], clip, time_sequence, calibrations[i].get());
+	}
+
+	// only the evaluated layers are written, dead branches of the training net are dropped
+	NetDescription quantized;
+	quantized.name = net.name;
+
+	long float_bytes = 0, int8_bytes = 0;
+
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		if( !used[i] )
+			continue;
+
+		LayerDescription layer = net.layers[i];
+
+		for(int j = 0; j < layer.blobs.size(); j++)
+			float_bytes += layer.blobs[j].count() * sizeof(float);
+
+		const InputMoments* moments = NULL;
+		for(int c = 0; c < calibrations.size(); c++)
+			if( calibrations[c]->layer == i )
+				moments = &calibrations[c]->moments;
+
+		if( moments && QuantizeLayer(&layer, moments) )
+			printf("%s: %s int8, calibrated on %ld inputs\n", layer.name.c_str(), layer.type.c_str(), moments->count());
+
+		for(int j = 0; j < layer.blobs.size(); j++) {
+			const BlobDescription& blob = layer.blobs[j];
+			int8_bytes += blob.quantized() ? blob.qdata.size() + blob.scales.size() * sizeof(float)
+						       : blob.data.size() * sizeof(float);
+		}
+
+		quantized.layers.push_back(layer);
+	}
+
+	CHECK(WriteQuantizedModel(output, quantized)) << "can not write " << output;
+
+	LSTMEngine engine;
+	CHECK(engine.Load(output, state_sequence_size, time_sequence)) << "engine can not load " << output;
+
+	// validation: caffe EuclideanLoss of both nets, and how far the int8 outputs move
+	reference.ResetState();
+
+	double reference_loss = 0, quantized_loss = 0, max_diff = 0, sum_diff = 0;
+	int validation_windows = validate_set_size / time_sequence;
+
+	for(int w = 0; w < validation_windows; w++) {
+
+		const float* states = &validation_states[w * time_sequence * state_sequence_size];
+		reference.Forward(states, &clip[0], time_sequence);
+		engine.Forward(states, &clip[0], time_sequence);
+
+		double reference_window = 0, quantized_window = 0;
+
+		for(int t = 0; t < time_sequence; t++) {
+			const float* label = &validation_labels[(w * time_sequence + t) * labels_size];
+			for(int i = 0; i < labels_size; i++) {
+				double r = reference.Output(t)[i], q = engine.Output(t)[i];
+				reference_window += (r - label[i]) * (r - label[i]);
+				quantized_window += (q - label[i]) * (q - label[i]);
+				max_diff = std::max(max_diff, fabs(r - q));
+				sum_diff += fabs(r - q);
+			}
+		}
+
+		reference_loss += reference_window / (2 * time_sequence);
+		quantized_loss += quantized_window / (2 * time_sequence);
+	}
+
+	reference_loss /= validation_windows;
+	quantized_loss /= validation_windows;
+
+	printf("%s -> %s: weights %ld -> %ld bytes\n", weights.c_str(), output.c_str(), float_bytes, int8_bytes);
+	printf("validation %d windows of %d steps\n", validation_windows, time_sequence);
+	printf("float loss %.6f  int8 loss %.6f  delta %+.6f\n", reference_loss, quantized_loss, quantized_loss - reference_loss);
+	printf("output max abs diff %g  mean abs diff %g\n", max_diff, sum_diff / (validation_windows * time_sequence * labels_size));
+
+	return 0;
+
+}
@@ -0,0 +1,405 @@
+#include <neural_network_planner/quantized_model.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+void InputMoments::Add(const float* z)
+{
+
+	for(int i = 0; i < K; i++) {
+		if( z[i] == 0 )
+			continue;
+		double* row = &sum[i * K];
+		for(int j = 0; j < K; j++)
+			row[j] += double(z[i]) * z[j];
+	}
+	samples++;
+
+}
+
+double InputMoments::Error(const vector<double>& d) const
+{
+
+	double error = 0;
+	for(int i = 0; i < K; i++) {
+		if( d[i] == 0 )
+			continue;
+		const double* row = &sum[i * K];
+		double dot = 0;
+		for(int j = 0; j < K; j++)
+			dot += row[j] * d[j];
+		error += d[i] * dot;
+	}
+	return samples ? error / samples : error;
+
+}
+
+
+namespace {
+
+const int kQuantMax = 127;
+
+inline int8_t quantize(float w, float scale)
+{
+	float q = floor(w / scale + 0.5f);
+	return int8_t(std::max(-float(kQuantMax), std::min(float(kQuantMax), q)));
+}
+
+} // namespace
+
+
+void ChooseScales(const vector<float>& W, int rows, int K, const InputMoments* moments, vector<float>* scales)
+{
+
+	scales->assign(rows, 1);
+	vector<double> d(K);
+
+	for(int m = 0; m < rows; m++) {
+
+		const float* w = &W[m * K];
+
+		float max_abs = 0;
+		for(int k = 0; k < K; k++)
+			max_abs = std::max(max_abs, fabsf(w[k]));
+
+		if( max_abs == 0 )
+			continue;
+
+		(*scales)[m] = max_abs / kQuantMax;
+
+		if( moments == NULL || moments->count() == 0 )
+			continue;
+
+		// clipping the largest weights buys resolution for all the others
+		double best_error = -1;
+		for(int step = 0; step <= 25; step++) {
+
+			float scale = (1 - 0.02f * step) * max_abs / kQuantMax;
+			for(int k = 0; k < K; k++)
+				d[k] = w[k] - scale * quantize(w[k], scale);
+
+			double error = moments->Error(d);
+			if( best_error < 0 || error < best_error ) {
+				best_error = error;
+				(*scales)[m] = scale;
+			}
+		}
+	}
+
+}
+
+bool QuantizeLayer(LayerDescription* layer, const InputMoments* moments)
+{
+
+	vector<BlobDescription>& blobs = layer->blobs;
+
+	// rows of the (stacked) weight matrix, one per output
+	int rows = 0, K = 0, X = 0;
+	vector<float> W;
+
+	if( layer->type == "LSTM" && blobs.size() == 3 && !blobs[0].quantized() ) {
+
+		rows = blobs[0].shape[0];
+		X = blobs[0].shape[1];
+		K = X + blobs[2].shape[1];
+
+		W.resize(rows * K);
+		for(int m = 0; m < rows; m++) {
+			std::copy(&blobs[0].data[m * X], &blobs[0].data[m * X] + X, &W[m * K]);
+			std::copy(&blobs[2].data[m * (K - X)], &blobs[2].data[m * (K - X)] + K - X, &W[m * K + X]);
+		}
+	}
+	else if( layer->type == "InnerProduct" && !blobs.empty() && !layer->transpose
+		 && blobs[0].shape.size() == 2 && !blobs[0].quantized() ) {
+
+		rows = blobs[0].shape[0];
+		K = X = blobs[0].shape[1];
+		W = blobs[0].data;
+	}
+	else
+		return false;
+
+	if( moments && moments->size() != K ) {
+		LOG(ERROR) << "Layer " << layer->name << ": calibration inputs of size " << moments->size()
+			   << ", weights expect " << K;
+		return false;
+	}
+
+	vector<float> scales;
+	ChooseScales(W, rows, K, moments, &scales);
+
+	// LSTM: W_xc columns [0, X), W_hc columns [X, K)
+	int parts = layer->type == "LSTM" ? 2 : 1;
+	for(int p = 0; p < parts; p++) {
+
+		BlobDescription& blob = blobs[p == 0 ? 0 : 2];
+		int begin = p == 0 ? 0 : X, width = p == 0 ? X : K - X;
+
+		blob.qdata.resize(rows * width);
+		for(int m = 0; m < rows; m++)
+			for(int k = 0; k < width; k++)
+				blob.qdata[m * width + k] = quantize(W[m * K + begin + k], scales[m]);
+
+		blob.scales = scales;
+		vector<float>().swap(blob.data);
+	}
+
+	return true;
+
+}
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'Q', '1' };
+
+enum { DTYPE_FLOAT = 0, DTYPE_INT8 = 1 };
+
+class Writer
+{
+
+public:
+
+	explicit Writer(FILE* f) : ok(true), file(f) {}
+
+	void Bytes(const void* data, size_t size) { if( size ) ok = ok && fwrite(data, 1, size, file) == size; }
+	void Int(int32_t v) { Bytes(&v, sizeof(v)); }
+	void Float(float v) { Bytes(&v, sizeof(v)); }
+	void String(const string& s) { Int(s.size()); Bytes(s.data(), s.size()); }
+
+	bool ok;
+
+private:
+
+	FILE* file;
+
+};
+
+class Reader
+{
+
+public:
+
+	explicit Reader(FILE* f) : ok(true), file(f) {}
+
+	void Bytes(void* data, size_t size) { if( size ) ok = ok && fread(data, 1, size, file) == size; }
+	int32_t Int() { int32_t v = 0; Bytes(&v, sizeof(v)); return v; }
+	float Float() { float v = 0; Bytes(&v, sizeof(v)); return v; }
+
+	string String() {
+		int32_t size = Int();
+		if( !ok || size < 0 || size > (1 << 20) ) {
+			ok = false;
+			return string();
+		}
+		string s(size, '\0');
+		Bytes(&s[0], size);
+		return s;
+	}
+
+	// sizes read from the file are bounded before allocating
+	int Count(int limit) {
+		int32_t n = Int();
+		if( n < 0 || n > limit )
+			ok = false;
+		return ok ? n : 0;
+	}
+
+	bool ok;
+
+private:
+
+	FILE* file;
+
+};
+
+const int kMaxElements = 1 << 28;
+
+} // namespace
+
+
+bool WriteQuantizedModel(const string& path, const NetDescription& net)
+{
+
+	FILE* model = fopen(path.c_str(), "wb");
+	if( model == NULL ) {
+		LOG(ERROR) << "Can not open " << path << " for writing";
+		return false;
+	}
+
+	Writer out(model);
+	out.Bytes(kMagic, sizeof(kMagic));
+	out.String(net.name);
+	out.Int(net.layers.size());
+
+	for(int i = 0; i < net.layers.size(); i++) {
+
+		const LayerDescription& layer = net.layers[i];
+
+		out.String(layer.name);
+		out.String(layer.type);
+		out.Int(layer.bottom.size());
+		for(int j = 0; j < layer.bottom.size(); j++)
+			out.String(layer.bottom[j]);
+		out.Int(layer.top.size());
+		for(int j = 0; j < layer.top.size(); j++)
+			out.String(layer.top[j]);
+
+		out.Int(layer.num_output);
+		out.Int(layer.axis);
+		out.Int(layer.bias_term);
+		out.Int(layer.transpose);
+		out.Int(layer.has_use_global_stats);
+		out.Int(layer.use_global_stats);
+		out.Float(layer.eps);
+		out.Int(layer.concat_axis);
+
+		out.Int(layer.blobs.size());
+		for(int j = 0; j < layer.blobs.size(); j++) {
+
+			const BlobDescription& blob = layer.blobs[j];
+
+			out.Int(blob.shape.size());
+			for(int k = 0; k < blob.shape.size(); k++)
+				out.Int(blob.shape[k]);
+
+			if( blob.quantized() ) {
+				out.Int(DTYPE_INT8);
+				out.Bytes(&blob.qdata[0], blob.qdata.size());
+				out.Bytes(&blob.scales[0], blob.scales.size() * sizeof(float));
+			}
+			else {
+				out.Int(DTYPE_FLOAT);
+				out.Bytes(blob.data.empty() ? NULL : &blob.data[0], blob.data.size() * sizeof(float));
+			}
+		}
+	}
+
+	bool ok = out.ok;
+	ok = fclose(model) == 0 && ok;
+
+	if( !ok )
+		LOG(ERROR) << "Can not write " << path;
+
+	return ok;
+
+}
+
+bool ReadQuantizedModel(const string& path, NetDescription* net)
+{
+
+	FILE* model = fopen(path.c_str(), "rb");
+	if( model == NULL ) {
+		LOG(ERROR) << "Can not open model " << path;
+		return false;
+	}
+
+	net->name.clear();
+	net->layers.clear();
+
+	Reader in(model);
+
+	char magic[4] = { 0, 0, 0, 0 };
+	in.Bytes(magic, sizeof(magic));
+	in.ok = in.ok && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+
+	net->name = in.String();
+	net->layers.resize(in.Count(1 << 16));
+
+	for(int i = 0; in.ok && i < net->layers.size(); i++) {
+
+		LayerDescription& layer = net->layers[i];
+
+		layer.name = in.String();
+		layer.type = in.String();
+		layer.bottom.resize(in.Count(1 << 10));
+		for(int j = 0; j < layer.bottom.size(); j++)
+			layer.bottom[j] = in.String();
+		layer.top.resize(in.Count(1 << 10));
+		for(int j = 0; j < layer.top.size(); j++)
+			layer.top[j] = in.String();
+
+		layer.num_output = in.Int();
+		layer.axis = in.Int();
+		layer.bias_term = in.Int();
+		layer.transpose = in.Int();
+		layer.has_use_global_stats = in.Int();
+		layer.use_global_stats = in.Int();
+		layer.eps = in.Float();
+		layer.concat_axis = in.Int();
+
+		layer.blobs.resize(in.Count(1 << 10));
+		for(int j = 0; in.ok && j < layer.blobs.size(); j++) {
+
+			BlobDescription& blob = layer.blobs[j];
+
+			blob.shape.resize(in.Count(8));
+			long count = 1;
+			for(int k = 0; k < blob.shape.size(); k++) {
+				blob.shape[k] = in.Count(kMaxElements);
+				count *= blob.shape[k];
+			}
+			if( count > kMaxElements ) {
+				in.ok = false;
+				break;
+			}
+
+			int dtype = in.Int();
+			if( dtype == DTYPE_INT8 && !blob.shape.empty() ) {
+				blob.qdata.resize(count);
+				blob.scales.resize(blob.shape[0]);
+				in.Bytes(&blob.qdata[0], count);
+				in.Bytes(&blob.scales[0], blob.scales.size() * sizeof(float));
+			}
+			else if( dtype == DTYPE_FLOAT ) {
+				blob.data.resize(count);
+				if( count )
+					in.Bytes(&blob.data[0], count * sizeof(float));
+			}
+			else
+				in.ok = false;
+		}
+	}
+
+	fclose(model);
+
+	if( !in.ok || net->layers.empty() ) {
+		LOG(ERROR) << "Can not parse quantized model " << path;
+		return false;
+	}
+
+	return true;
+
+}
+
+bool IsQuantizedModel(const string& path)
+{
+
+	FILE* model = fopen(path.c_str(), "rb");
+	if( model == NULL )
+		return false;
+
+	char magic[4] = { 0, 0, 0, 0 };
+	bool quantized = fread(magic, 1, sizeof(magic), model) == sizeof(magic)
+			 && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+	fclose(model);
+
+	return quantized;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,157 @@
+// rebuilds the databases of BuildDatabase from its scan archive (scan_archive: true) for another
+// averaged_ranges_size, without driving the robot again: the compressed blocks of the archive
+// are decoded and featurized by threads workers, the steps are then written in their recording
+// order with their original keys, as split states/labels databases, a unified steps database
+// or a columnar .nnd dataset. downsampling is the ScanDownsampler mode of the ranges: mean, min,
+// median or pN
+// usage: refeaturize scans.nns output_prefix [averaged_ranges_size] [threads] [format] [backend] [downsampling]
+
+#include <neural_network_planner/scan_archive.h>
+#include <neural_network_planner/scan_downsampler.h>
+#include <neural_network_planner/state_features.h>
+#include <neural_network_planner/step_blocks.h>
+
+#include "glog/logging.h"
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+using boost::lexical_cast;
+using std::string;
+using std::vector;
+
+using namespace neural_network_planner;
+
+
+const int kLabelsSize = 2;
+
+
+double seconds()
+{
+
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + 1e-6 * now.tv_usec;
+
+}
+
+
+void featurize(const ScanArchiveReader* archive, int averaged_ranges_size, const string& downsampling, boost::atomic<int>* next,
+	       vector<StepBlock>* blocks)
+{
+
+	ScanDownsampler downsampler;
+	downsampler.Init(averaged_ranges_size, downsampling);
+
+	int size = state_size(averaged_ranges_size);
+	vector<ScanFrame> frames;
+	vector<float> state(size);
+
+	for(int b = (*next)++; b < blocks->size(); b = (*next)++) {
+
+		StepBlock& block = (*blocks)[b];
+		block.ok = archive->ReadBlock(b, &frames);
+		if( !block.ok )
+			continue;
+
+		block.states.reserve(frames.size() * size);
+		block.labels.reserve(frames.size() * kLabelsSize);
+
+		for(int f = 0; f < frames.size(); f++) {
+
+			const ScanFrame& frame = frames[f];
+
+			// features of BuildDatabase: ranges then target distance and relative angle
+			if( !downsampler.Downsample(frame.ranges, frame.range_min, frame.range_max, &state[0]) ) {
+				block.skipped++;
+				continue;
+			}
+			TargetFeatures(std::make_pair(frame.x, frame.y), std::make_pair(frame.target_x, frame.target_y),
+				       frame.orientation, &state[averaged_ranges_size], &state[averaged_ranges_size + 1]);
+
+			block.keys.push_back(frame.step);
+			block.episodes.push_back(frame.episode);
+			block.stamps.push_back(frame.stamp);
+			block.states.insert(block.states.end(), state.begin(), state.end());
+			block.labels.push_back(frame.linear_x);
+			block.labels.push_back(frame.angular_z);
+		}
+	}
+
+}
+
+
+int main(int argc, char **argv) {
+
+	if( argc < 3 ) {
+		printf("usage: %s scans.nns output_prefix [averaged_ranges_size] [threads] [format] [backend] [downsampling]\n", argv[0]);
+		return 1;
+	}
+
+	string archive_path = argv[1], prefix = argv[2];
+	int averaged_ranges_size = argc > 3 ? lexical_cast<int>(argv[3]) : 24;
+	int threads = argc > 4 ? lexical_cast<int>(argv[4]) : boost::thread::hardware_concurrency();
+	string format = argc > 5 ? argv[5] : "split";
+	string backend = argc > 6 ? argv[6] : "lmdb";
+	string downsampling = argc > 7 ? argv[7] : "mean";
+
+	CHECK(ScanDownsampler().Init(averaged_ranges_size, downsampling)) << "averaged_ranges_size must be positive, downsampling mean, min, median or pN";
+	CHECK(format == "split" || format == "unified" || format == "columnar") << "format must be split, unified or columnar";
+	threads = std::max(threads, 1);
+
+	double start = seconds();
+
+	ScanArchiveReader archive;
+	CHECK(archive.Open(archive_path)) << "can not read " << archive_path;
+
+	double read_time = seconds() - start;
+	start = seconds();
+
+	// blocks are independent: each worker takes the next one
+	vector<StepBlock> blocks(archive.blocks());
+	boost::atomic<int> next(0);
+	boost::thread_group workers;
+	for(int t = 0; t < threads; t++)
+		workers.create_thread(boost::bind(&featurize, &archive, averaged_ranges_size, downsampling, &next, &blocks));
+	workers.join_all();
+
+	double featurize_time = seconds() - start;
+
+	int bad_blocks = 0, skipped = 0;
+	double first_stamp = 0, last_stamp = 0;
+	for(int b = 0; b < blocks.size(); b++) {
+		bad_blocks += !blocks[b].ok;
+		skipped += blocks[b].skipped;
+		if( !blocks[b].stamps.empty() ) {
+			if( first_stamp == 0 )
+				first_stamp = blocks[b].stamps.front();
+			last_stamp = blocks[b].stamps.back();
+		}
+	}
+	if( bad_blocks > 0 )
+		LOG(WARNING) << bad_blocks << " corrupted blocks of " << archive_path << " skipped";
+	if( skipped > 0 )
+		LOG(WARNING) << skipped << " scans with less than " << averaged_ranges_size << " ranges skipped";
+
+	start = seconds();
+	long steps = WriteStepBlocks(blocks, state_size(averaged_ranges_size), kLabelsSize, prefix, averaged_ranges_size, format, backend);
+	double write_time = seconds() - start;
+
+	double total = read_time + featurize_time + write_time;
+	printf("%ld steps of %d ranges from %d blocks, %d threads: read %.3f s, featurize %.3f s, write %.3f s",
+	       steps, averaged_ranges_size, archive.blocks(), threads, read_time, featurize_time, write_time);
+	if( total > 0 && last_stamp > first_stamp )
+		printf(", %.0fx real time", (last_stamp - first_stamp) / total);
+	printf("\n");
+
+	return 0;
+
+}
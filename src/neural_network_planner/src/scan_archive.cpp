@@ -0,0 +1,325 @@
+#include <neural_network_planner/scan_archive.h>
+#include <neural_network_planner/byte_order.h>
+
+#include "glog/logging.h"
+
+#include <snappy.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'A', '1' };
+
+const uint32_t kVersion = 1;
+
+// range codes: 0 NaN, 1 + millimeters, kInfinity beyond the largest range
+const uint16_t kNaN = 0;
+const uint16_t kInfinity = 0xFFFF;
+const float kMaxRange = (kInfinity - 2) * 0.001f;
+
+// frames, raw and compressed size
+const size_t kBlockHeader = 3 * sizeof(uint32_t);
+
+uint16_t quantize(float range)
+{
+
+	if( !(range >= 0) )
+		return kNaN;
+	if( !(range <= kMaxRange) )
+		return kInfinity;
+	return 1 + static_cast<uint16_t>(range * 1000 + 0.5f);
+
+}
+
+float dequantize(uint16_t code)
+{
+
+	if( code == kNaN )
+		return std::numeric_limits<float>::quiet_NaN();
+	if( code == kInfinity )
+		return std::numeric_limits<float>::infinity();
+	return (code - 1) * 0.001f;
+
+}
+
+template <typename T>
+void put(string* out, T value)
+{
+
+	out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+
+}
+
+// bounded reads from a decompressed block
+class Reader
+{
+
+public:
+
+	Reader(const char* d, size_t s) : ok(true), data(d), size(s), position(0) {}
+
+	template <typename T>
+	T get() {
+		T value = T();
+		ok = ok && sizeof(T) <= size - position;
+		if( ok ) {
+			memcpy(&value, data + position, sizeof(T));
+			position += sizeof(T);
+		}
+		return value;
+	}
+
+	bool done() const { return position == size; }
+
+	bool ok;
+
+private:
+
+	const char* data;
+	size_t size, position;
+
+};
+
+} // namespace
+
+
+ScanArchiveWriter::ScanArchiveWriter() : file(NULL), block_frames(1), pending(0), frames_(0), raw_bytes_(0), compressed_bytes_(0)
+{
+
+}
+
+ScanArchiveWriter::~ScanArchiveWriter()
+{
+
+	Close();
+
+}
+
+bool ScanArchiveWriter::Open(const string& path, int frames_per_block)
+{
+
+	Close();
+
+	block_frames = std::max(frames_per_block, 1);
+	pending = 0;
+	frames_ = raw_bytes_ = compressed_bytes_ = 0;
+	block.clear();
+
+	file = fopen(path.c_str(), "wb");
+	if( !file )
+		return false;
+
+	if( fwrite(kMagic, 1, sizeof(kMagic), file) != sizeof(kMagic) || fwrite(&kByteOrder, sizeof(kByteOrder), 1, file) != 1
+	    || fwrite(&kVersion, sizeof(kVersion), 1, file) != 1 ) {
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+
+	return true;
+
+}
+
+bool ScanArchiveWriter::Append(const ScanFrame& frame)
+{
+
+	if( !file )
+		return false;
+
+	put<int32_t>(&block, frame.step);
+	put<int32_t>(&block, frame.episode);
+	put<double>(&block, frame.stamp);
+	put<float>(&block, frame.angle_min);
+	put<float>(&block, frame.angle_max);
+	put<float>(&block, frame.range_min);
+	put<float>(&block, frame.range_max);
+	put<float>(&block, frame.x);
+	put<float>(&block, frame.y);
+	put<float>(&block, frame.orientation);
+	put<float>(&block, frame.target_x);
+	put<float>(&block, frame.target_y);
+	put<float>(&block, frame.linear_x);
+	put<float>(&block, frame.angular_z);
+	put<uint32_t>(&block, frame.ranges.size());
+
+	// zigzag deltas: small steps between neighbouring ranges are small codes, either sign
+	uint16_t previous = 0;
+	for(int i = 0; i < frame.ranges.size(); i++) {
+		uint16_t code = quantize(frame.ranges[i]);
+		int16_t delta = static_cast<int16_t>(code - previous);
+		put<uint16_t>(&block, static_cast<uint16_t>((delta << 1) ^ (delta >> 15)));
+		previous = code;
+	}
+
+	frames_++;
+	if( ++pending == block_frames )
+		return write_block();
+	return true;
+
+}
+
+bool ScanArchiveWriter::write_block()
+{
+
+	if( pending == 0 )
+		return true;
+
+	snappy::Compress(block.data(), block.size(), &compressed);
+
+	uint32_t header[3] = { static_cast<uint32_t>(pending), static_cast<uint32_t>(block.size()), static_cast<uint32_t>(compressed.size()) };
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1
+		  && fwrite(compressed.data(), 1, compressed.size(), file) == compressed.size();
+
+	raw_bytes_ += block.size();
+	compressed_bytes_ += compressed.size();
+
+	pending = 0;
+	block.clear();
+
+	return ok;
+
+}
+
+bool ScanArchiveWriter::Flush()
+{
+
+	if( !file )
+		return false;
+
+	bool ok = write_block();
+	return fflush(file) == 0 && ok;
+
+}
+
+void ScanArchiveWriter::Close()
+{
+
+	if( !file )
+		return;
+
+	if( !write_block() )
+		LOG(ERROR) << "Can not write the last frames of the scan archive";
+
+	fclose(file);
+	file = NULL;
+
+}
+
+
+bool ScanArchiveReader::Open(const string& path)
+{
+
+	data.clear();
+	offsets.clear();
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if( !file ) {
+		LOG(ERROR) << "Can not open scan archive " << path;
+		return false;
+	}
+
+	char buffer[1 << 16];
+	for(size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+		data.append(buffer, n);
+	fclose(file);
+
+	uint32_t byte_order = 0, version = 0;
+	if( data.size() < sizeof(kMagic) + 2 * sizeof(uint32_t) || memcmp(data.data(), kMagic, sizeof(kMagic)) != 0 ) {
+		LOG(ERROR) << path << " is not a scan archive";
+		return false;
+	}
+	memcpy(&byte_order, data.data() + sizeof(kMagic), sizeof(byte_order));
+	memcpy(&version, data.data() + sizeof(kMagic) + sizeof(byte_order), sizeof(version));
+
+	if( !NativeByteOrder(byte_order) || version != kVersion ) {
+		LOG(ERROR) << path << " is not a version " << kVersion << " scan archive of this byte order";
+		return false;
+	}
+
+	// a truncated last block, the recording stopped while writing it, is ignored
+	size_t offset = sizeof(kMagic) + 2 * sizeof(uint32_t);
+	while( data.size() - offset >= kBlockHeader ) {
+		uint32_t header[3];
+		memcpy(header, data.data() + offset, sizeof(header));
+		if( header[2] > data.size() - offset - kBlockHeader ) {
+			LOG(WARNING) << "Scan archive " << path << " is truncated, " << offsets.size() << " blocks read";
+			break;
+		}
+		offsets.push_back(offset);
+		offset += kBlockHeader + header[2];
+	}
+
+	return true;
+
+}
+
+bool ScanArchiveReader::ReadBlock(int index, vector<ScanFrame>* frames) const
+{
+
+	uint32_t header[3];
+	memcpy(header, data.data() + offsets[index], sizeof(header));
+	const char* compressed = data.data() + offsets[index] + kBlockHeader;
+
+	size_t raw_size = 0;
+	if( !snappy::GetUncompressedLength(compressed, header[2], &raw_size) || raw_size != header[1] )
+		return false;
+
+	string raw(raw_size, '\0');
+	if( raw_size > 0 && !snappy::RawUncompress(compressed, header[2], &raw[0]) )
+		return false;
+
+	// frames of 64 bytes at least: steps, stamp, 11 values, range count
+	if( header[0] > raw_size / 64 )
+		return false;
+
+	Reader in(raw.data(), raw.size());
+	frames->resize(header[0]);
+
+	for(int f = 0; in.ok && f < frames->size(); f++) {
+
+		ScanFrame& frame = (*frames)[f];
+		frame.step = in.get<int32_t>();
+		frame.episode = in.get<int32_t>();
+		frame.stamp = in.get<double>();
+		frame.angle_min = in.get<float>();
+		frame.angle_max = in.get<float>();
+		frame.range_min = in.get<float>();
+		frame.range_max = in.get<float>();
+		frame.x = in.get<float>();
+		frame.y = in.get<float>();
+		frame.orientation = in.get<float>();
+		frame.target_x = in.get<float>();
+		frame.target_y = in.get<float>();
+		frame.linear_x = in.get<float>();
+		frame.angular_z = in.get<float>();
+
+		uint32_t count = in.get<uint32_t>();
+		if( !in.ok || count > raw.size() / sizeof(uint16_t) )
+			return false;
+
+		frame.ranges.resize(count);
+		uint16_t code = 0;
+		for(int i = 0; i < count; i++) {
+			uint16_t zigzag = in.get<uint16_t>();
+			code += static_cast<uint16_t>((zigzag >> 1) ^ -(zigzag & 1));
+			frame.ranges[i] = dequantize(code);
+		}
+	}
+
+	return in.ok && in.done();
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,145 @@
+#include <neural_network_planner/scan_downsampler.h>
+#include <neural_network_planner/simd_math.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+
+using std::string;
+
+
+namespace neural_network_planner {
+
+
+using namespace kernels;
+using namespace kernels::simd;
+
+
+ScanDownsampler::ScanDownsampler() : output_size_(0), mode_(MEAN), percentile(50), name_("mean")
+{
+
+}
+
+bool ScanDownsampler::Init(int output_size, const string& mode)
+{
+
+	if( output_size <= 0 )
+		return false;
+
+	// built for an instruction set this CPU lacks (NNP_SIMD): refused rather than SIGILL on the first scan
+	if( !InstructionSetSupported() )
+		return false;
+
+	if( mode == "mean" )
+		mode_ = MEAN;
+	else if( mode == "min" )
+		mode_ = MIN;
+	else if( mode == "median" ) {
+		mode_ = PERCENTILE;
+		percentile = 50;
+	}
+	else if( mode.size() > 1 && mode[0] == 'p' ) {
+		try {
+			percentile = boost::lexical_cast<float>(mode.substr(1));
+		}
+		catch( boost::bad_lexical_cast& ) {
+			return false;
+		}
+		if( !(percentile >= 0 && percentile <= 100) )
+			return false;
+		mode_ = PERCENTILE;
+	}
+	else
+		return false;
+
+	output_size_ = output_size;
+	name_ = mode;
+	return true;
+
+}
+
+bool ScanDownsampler::Downsample(const float* ranges, int count, float range_min, float range_max, float* output)
+{
+
+	int block_size = output_size_ > 0 ? count / output_size_ : 0;
+	if( block_size == 0 )
+		return false;
+
+	const vfloat lo = vset(range_min);
+	const vfloat hi = vset(range_max);
+
+	for(int k = 0; k < output_size_; k++) {
+
+		const float* block = ranges + k * block_size;
+
+		if( mode_ == PERCENTILE ) {
+			output[k] = percentile_of(block, block_size, range_min, range_max);
+			continue;
+		}
+
+		// measurements clamped to range_max, lanes out of the block statistics where x < range_min or NaN
+		int i = 0;
+		if( mode_ == MEAN ) {
+
+			vfloat sum = vzero(), valid = vzero();
+			for(; i + kLanes <= block_size; i += kLanes) {
+				vfloat x = vloadu(block + i);
+				sum = vadd(sum, vselect_ge(x, lo, vmin(x, hi), vzero()));
+				valid = vadd(valid, vcount_ge(x, lo));
+			}
+
+			float total = vhsum(sum), measured = vhsum(valid);
+			for(; i < block_size; i++)
+				if( block[i] >= range_min ) {
+					total += std::min(block[i], range_max);
+					measured++;
+				}
+
+			output[k] = measured > 0 ? total / measured : range_max;
+		}
+		else {
+
+			vfloat nearest = hi;
+			for(; i + kLanes <= block_size; i += kLanes) {
+				vfloat x = vloadu(block + i);
+				nearest = vmin(nearest, vselect_ge(x, lo, x, hi));
+			}
+
+			float minimum = vhmin(nearest);
+			for(; i < block_size; i++)
+				if( block[i] >= range_min && block[i] < minimum )
+					minimum = block[i];
+
+			output[k] = minimum;
+		}
+	}
+
+	return true;
+
+}
+
+float ScanDownsampler::percentile_of(const float* block, int size, float range_min, float range_max)
+{
+
+	if( scratch.size() < size )
+		scratch.resize(size);
+
+	int measured = 0;
+	for(int i = 0; i < size; i++)
+		if( block[i] >= range_min )
+			scratch[measured++] = std::min(block[i], range_max);
+
+	if( measured == 0 )
+		return range_max;
+
+	// nearest rank
+	int rank = static_cast<int>(percentile / 100 * (measured - 1) + 0.5f);
+	std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.begin() + measured);
+	return scratch[rank];
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,207 @@
+#include <neural_network_planner/shadow_logger.h>
+
+#include "glog/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <limits>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'S', '1' };
+
+// simulation step of TimeToCollision, seconds
+const float kCollisionStep = 0.05;
+
+// written records between two divergence reports
+const long kReportRecords = 500;
+
+} // namespace
+
+
+float TimeToCollision(float linear, float angular, const vector<float>& obstacles,
+		      float sector_start, float sector_width, float robot_radius, float horizon)
+{
+
+	float radius2 = robot_radius * robot_radius;
+	float x = 0, y = 0, theta = 0;
+
+	for(float t = 0; t <= horizon; t += kCollisionStep) {
+
+		for(int k = 0; k < obstacles.size(); k++) {
+
+			float range = obstacles[k];
+			if( !(range > 0) || range == std::numeric_limits<float>::infinity() )
+				continue;
+
+			float angle = sector_start + (k + 0.5f) * sector_width;
+			float dx = range * cos(angle) - x;
+			float dy = range * sin(angle) - y;
+
+			if( dx * dx + dy * dy <= radius2 )
+				return t;
+		}
+
+		x += linear * cos(theta) * kCollisionStep;
+		y += linear * sin(theta) * kCollisionStep;
+		theta += angular * kCollisionStep;
+	}
+
+	return horizon;
+
+}
+
+
+ShadowLogger::ShadowLogger() : file(NULL), robot_radius(0), horizon(0), stop(false), dropped_(0),
+			       records(0), linear_error(0), angular_error(0), ttc_error(0)
+{
+
+	sem_init(&samples_queued, 0, 0);
+
+}
+
+ShadowLogger::~ShadowLogger()
+{
+
+	Close();
+	sem_destroy(&samples_queued);
+
+}
+
+bool ShadowLogger::Open(const string& log_path, int capacity, int sectors, float radius, float ttc_horizon)
+{
+
+	Close();
+
+	file = fopen(log_path.c_str(), "wb");
+	if( file == NULL ) {
+		LOG(ERROR) << "Can not open shadow log " << log_path;
+		return false;
+	}
+
+	// records reach the disk in large writes, never from the control thread
+	setvbuf(file, NULL, _IOFBF, 1 << 16);
+
+	uint32_t record_size = sizeof(ShadowRecord);
+	fwrite(kMagic, 1, sizeof(kMagic), file);
+	fwrite(&record_size, sizeof(record_size), 1, file);
+
+	path = log_path;
+	robot_radius = radius;
+	horizon = ttc_horizon;
+
+	ShadowSample prototype;
+	prototype.obstacles = vector<float>(sectors, 0);
+	queue.reset(new SpscRing<ShadowSample>(capacity + 1, prototype));
+
+	stop = false;
+	dropped_ = 0;
+	records = 0;
+	linear_error = angular_error = ttc_error = 0;
+
+	writer_thread = boost::thread(&ShadowLogger::writer, this);
+
+	return true;
+
+}
+
+ShadowSample* ShadowLogger::Reserve()
+{
+
+	ShadowSample* sample = queue->Reserve();
+	if( !sample )
+		dropped_++;
+	return sample;
+
+}
+
+void ShadowLogger::Close()
+{
+
+	if( !file )
+		return;
+
+	stop = true;
+	sem_post(&samples_queued);
+	if( writer_thread.joinable() )
+		writer_thread.join();
+
+	fclose(file);
+	file = NULL;
+
+	LOG(INFO) << "Shadow log " << path << " closed, " << dropped_.load() << " cycles dropped";
+
+}
+
+void ShadowLogger::writer()
+{
+
+	while( true ) {
+
+		if( sem_wait(&samples_queued) != 0 && errno == EINTR )
+			continue;
+
+		bool stopping = stop;
+
+		for(ShadowSample* sample = queue->Front(); sample; sample = queue->Front()) {
+			write(*sample);
+			queue->Pop();
+		}
+
+		if( stopping )
+			break;
+	}
+
+	fflush(file);
+
+}
+
+void ShadowLogger::write(const ShadowSample& sample)
+{
+
+	ShadowRecord record;
+	record.stamp = sample.stamp;
+	record.classic_linear = sample.classic_linear;
+	record.classic_angular = sample.classic_angular;
+	record.net_linear = sample.net_linear;
+	record.net_angular = sample.net_angular;
+	record.net_age = sample.net_age;
+	record.classic_valid = sample.classic_valid;
+
+	record.classic_ttc = TimeToCollision(sample.classic_linear, sample.classic_angular, sample.obstacles,
+					     sample.sector_start, sample.sector_width, robot_radius, horizon);
+	record.net_ttc = TimeToCollision(sample.net_linear, sample.net_angular, sample.obstacles,
+					 sample.sector_start, sample.sector_width, robot_radius, horizon);
+
+	if( fwrite(&record, sizeof(record), 1, file) != 1 )
+		LOG_EVERY_N(ERROR, 1000) << "Can not write shadow log " << path;
+
+	if( !sample.classic_valid )
+		return;
+
+	records++;
+	linear_error += fabs(record.net_linear - record.classic_linear);
+	angular_error += fabs(record.net_angular - record.classic_angular);
+	ttc_error += record.net_ttc - record.classic_ttc;
+
+	if( records == kReportRecords ) {
+		LOG(INFO) << "Shadow LSTM vs classic over " << records << " cycles: mean abs error linear "
+			  << linear_error / records << " angular " << angular_error / records
+			  << ", mean time to collision difference " << ttc_error / records << " sec";
+		records = 0;
+		linear_error = angular_error = ttc_error = 0;
+	}
+
+}
+
+
+} // namespace neural_network_planner
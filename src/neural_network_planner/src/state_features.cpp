@@ -0,0 +1,22 @@
+#include <neural_network_planner/state_features.h>
+
+#include <cmath>
+
+
+namespace neural_network_planner {
+
+
+void TargetFeatures(const std::pair<float, float>& source, const std::pair<float, float>& target,
+				float orientation, float* distance, float* relative_angle)
+{
+
+	float x_rel = target.first - source.first;
+	float y_rel = target.second - source.second;
+
+	*distance = hypot( x_rel, y_rel);
+	*relative_angle = fabs(atan2( y_rel , x_rel ) - orientation);
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,111 @@
+#include <neural_network_planner/step_blocks.h>
+#include <neural_network_planner/step_database.h>
+#include <neural_network_planner/step_dataset.h>
+#include <neural_network_planner/step_record.h>
+
+#include "boost/scoped_ptr.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+
+#include "glog/logging.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cstdio>
+
+
+using boost::lexical_cast;
+using boost::scoped_ptr;
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+// steps of a database transaction
+const int kCommitSteps = 1000;
+
+} // namespace
+
+
+long WriteStepBlocks(const vector<StepBlock>& blocks, int size, int label_size, const string& prefix,
+		     int averaged_ranges_size, const string& format, const string& backend)
+{
+
+	string resolution = "r" + lexical_cast<string>(averaged_ranges_size);
+	long steps = 0;
+
+	if( format == "columnar" ) {
+
+		string path = prefix + "steps-" + resolution + ".nnd";
+		StepDatasetWriter dataset;
+		CHECK(dataset.Open(path, size, label_size)) << "can not write " << path;
+
+		for(int b = 0; b < blocks.size(); b++)
+			for(int i = 0; i < blocks[b].keys.size(); i++, steps++)
+				CHECK(dataset.Append(&blocks[b].states[i * size], &blocks[b].labels[i * label_size],
+						     blocks[b].episodes[i], blocks[b].stamps[i])) << "can not write " << path;
+
+		CHECK(dataset.Close()) << "can not complete " << path;
+		printf("written %s\n", path.c_str());
+		return steps;
+	}
+
+	bool unified = format == "unified";
+	string states_path = prefix + (unified ? "steps_db-" : "states_db-") + resolution + "_" + backend;
+	string labels_path = prefix + "labels_db-" + resolution + "_twist-variant_" + backend;
+
+	scoped_ptr<caffe::db::DB> states_database(caffe::db::GetDB(backend)), labels_database;
+	states_database->Open(states_path, caffe::db::NEW);
+	scoped_ptr<caffe::db::Transaction> states_txn(states_database->NewTransaction()), labels_txn;
+
+	if( !unified ) {
+		labels_database.reset(caffe::db::GetDB(backend));
+		labels_database->Open(labels_path, caffe::db::NEW);
+		labels_txn.reset(labels_database->NewTransaction());
+	}
+
+	string value;
+	for(int b = 0; b < blocks.size(); b++) {
+		for(int i = 0; i < blocks[b].keys.size(); i++) {
+
+			const StepBlock& block = blocks[b];
+			string key = caffe::format_int(block.keys[i], 8);
+
+			if( unified ) {
+				EncodeStepRecord(&block.states[i * size], size, &block.labels[i * label_size], label_size,
+						 block.episodes[i], block.stamps[i], &value);
+				states_txn->Put(key, value);
+			}
+			else {
+				EncodeDatum(&block.states[i * size], size, &value);
+				states_txn->Put(key, value);
+				EncodeDatum(&block.labels[i * label_size], label_size, &value);
+				labels_txn->Put(key, value);
+			}
+
+			if( ++steps % kCommitSteps == 0 ) {
+				states_txn->Commit();
+				states_txn.reset(states_database->NewTransaction());
+				if( labels_txn ) {
+					labels_txn->Commit();
+					labels_txn.reset(labels_database->NewTransaction());
+				}
+			}
+		}
+	}
+
+	states_txn->Commit();
+	if( labels_txn )
+		labels_txn->Commit();
+
+	printf("written %s%s\n", states_path.c_str(), unified ? "" : (" and " + labels_path).c_str());
+	return steps;
+
+}
+
+
+} // namespace neural_network_planner
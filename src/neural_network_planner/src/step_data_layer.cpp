@@ -0,0 +1,125 @@
+#include <neural_network_planner/step_data_layer.h>
+#include <neural_network_planner/step_record.h>
+
+#include "caffe/layer_factory.hpp"
+
+#include "glog/logging.h"
+
+#include <algorithm>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+template <typename Dtype>
+void StepDataLayer<Dtype>::LayerSetUp(const vector<caffe::Blob<Dtype>*>& bottom, const vector<caffe::Blob<Dtype>*>& top)
+{
+
+	const caffe::DataParameter& param = this->layer_param_.data_param();
+
+	database.reset(caffe::db::GetDB(param.backend()));
+	database->Open(param.source(), caffe::db::READ);
+	cursor.reset(database->NewCursor());
+
+	CHECK(cursor->valid()) << "StepData: no step in " << param.source();
+
+	// the record points into the value, the cursor returns a copy
+	string value = cursor->value();
+	StepRecord record;
+	CHECK(DecodeStepRecord(value, &record)) << "StepData: " << param.source() << " is not a steps database";
+
+	batch_size = param.batch_size();
+	state_size = record.header->state_size;
+	label_size = record.header->label_size;
+	continued = false;
+
+	vector<int> shape(2);
+	shape[0] = batch_size;
+	shape[1] = state_size;
+	top[0]->Reshape(shape);
+	if( top.size() > 2 )
+		top[2]->Reshape(shape);
+
+	shape[1] = label_size;
+	top[1]->Reshape(shape);
+
+	LOG(INFO) << "StepData " << param.source() << ": " << batch_size << " steps of " << state_size
+		  << " state and " << label_size << " label values";
+
+}
+
+template <typename Dtype>
+void StepDataLayer<Dtype>::Forward_cpu(const vector<caffe::Blob<Dtype>*>& bottom, const vector<caffe::Blob<Dtype>*>& top)
+{
+
+	Dtype* data = top[0]->mutable_cpu_data();
+	Dtype* labels = top[1]->mutable_cpu_data();
+	Dtype* clip = top.size() > 2 ? top[2]->mutable_cpu_data() : NULL;
+
+	string value;
+	StepRecord record;
+
+	for(int b = 0; b < batch_size; b++) {
+
+		value = cursor->value();
+		CHECK(DecodeStepRecord(value, &record)) << "StepData: malformed step " << cursor->key();
+		CHECK(record.header->state_size == state_size && record.header->label_size == label_size)
+			<< "StepData: step " << cursor->key() << " differs in size";
+
+		std::copy(record.state, record.state + state_size, data + b * state_size);
+		std::copy(record.label, record.label + label_size, labels + b * label_size);
+
+		if( clip ) {
+			Dtype cont = continued && record.header->episode == episode ? 1 : 0;
+			std::fill(clip + b * state_size, clip + (b + 1) * state_size, cont);
+		}
+
+		episode = record.header->episode;
+		continued = true;
+
+		cursor->Next();
+		if( !cursor->valid() ) {
+			cursor->SeekToFirst();
+			continued = false;
+		}
+	}
+
+}
+
+
+template class StepDataLayer<float>;
+template class StepDataLayer<double>;
+
+
+namespace {
+
+template <typename Dtype>
+boost::shared_ptr<caffe::Layer<Dtype> > create_step_data_layer(const caffe::LayerParameter& param)
+{
+
+	return boost::shared_ptr<caffe::Layer<Dtype> >(new StepDataLayer<Dtype>(param));
+
+}
+
+} // namespace
+
+
+void RegisterStepDataLayer()
+{
+
+	static bool registered = false;
+	if( registered )
+		return;
+
+	caffe::LayerRegistry<float>::AddCreator("StepData", &create_step_data_layer<float>);
+	caffe::LayerRegistry<double>::AddCreator("StepData", &create_step_data_layer<double>);
+	registered = true;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,91 @@
+#include <neural_network_planner/step_database.h>
+#include <neural_network_planner/step_dataset.h>
+#include <neural_network_planner/step_record.h>
+
+#include "boost/scoped_ptr.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+
+#include "glog/logging.h"
+
+#include <algorithm>
+
+
+using boost::scoped_ptr;
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+void EncodeDatum(const float* values, int size, string* value)
+{
+
+	caffe::Datum datum;
+	datum.set_channels(size);
+	datum.set_height(1);
+	datum.set_width(1);
+	for(int i = 0; i < size; i++)
+		datum.add_float_data(values[i]);
+	datum.set_encoded(false);
+	datum.SerializeToString(value);
+
+}
+
+int ReadSteps(const string& path, const string& backend, int max_steps,
+	      int state_size, vector<float>* states, int label_size, vector<float>* labels)
+{
+
+	if( IsStepDataset(path) ) {
+		StepDataset dataset;
+		CHECK(dataset.Open(path)) << "can not read " << path;
+		CHECK(dataset.state_size() == state_size && dataset.label_size() == label_size) << "unexpected step size in " << path;
+
+		int steps = std::min<uint64_t>(dataset.count(), std::max(max_steps, 0));
+		if( states )
+			states->insert(states->end(), dataset.states(), dataset.states() + long(steps) * state_size);
+		if( labels )
+			labels->insert(labels->end(), dataset.labels(), dataset.labels() + long(steps) * label_size);
+		return steps;
+	}
+
+	scoped_ptr<caffe::db::DB> database(caffe::db::GetDB(backend));
+	database->Open(path, caffe::db::READ);
+	scoped_ptr<caffe::db::Cursor> cursor(database->NewCursor());
+
+	int steps = 0;
+	caffe::Datum datum;
+	StepRecord record;
+
+	for(; cursor->valid() && steps < max_steps; cursor->Next(), steps++) {
+
+		string value = cursor->value();
+		if( DecodeStepRecord(value, &record) ) {
+			CHECK(record.header->state_size == state_size && record.header->label_size == label_size)
+				<< "unexpected step size in " << path << ", key " << cursor->key();
+			if( states )
+				states->insert(states->end(), record.state, record.state + state_size);
+			if( labels )
+				labels->insert(labels->end(), record.label, record.label + label_size);
+			continue;
+		}
+
+		// split: the datum is the state or the label of the step
+		CHECK(!states || !labels) << path << " holds the states or the labels of the steps, not both";
+		int size = states ? state_size : label_size;
+		vector<float>* values = states ? states : labels;
+
+		datum.ParseFromString(value);
+		CHECK_EQ(datum.float_data_size(), size) << "unexpected datum size in " << path;
+
+		for(int i = 0; i < size; i++)
+			values->push_back(datum.float_data(i));
+	}
+
+	return steps;
+
+}
+
+
+} // namespace neural_network_planner
@@ -0,0 +1,269 @@
+#include <neural_network_planner/step_dataset.h>
+#include <neural_network_planner/byte_order.h>
+
+#include "glog/logging.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using std::string;
+using std::vector;
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+const char kMagic[4] = { 'N', 'N', 'D', '1' };
+
+const uint32_t kVersion = 1;
+
+uint64_t align(uint64_t offset)
+{
+
+	return (offset + kDatasetAlignment - 1) / kDatasetAlignment * kDatasetAlignment;
+
+}
+
+// column at the next aligned offset of the file, false on a write error
+bool write_column(FILE* file, const void* data, size_t bytes, uint64_t* offset)
+{
+
+	static const char padding[kDatasetAlignment] = { 0 };
+
+	long position = ftell(file);
+	if( position < 0 )
+		return false;
+
+	*offset = align(position);
+	size_t pad = *offset - position;
+	return fwrite(padding, 1, pad, file) == pad && (bytes == 0 || fwrite(data, 1, bytes, file) == bytes);
+
+}
+
+// the column lies in the file, aligned for its type
+bool column_fits(uint64_t offset, uint64_t bytes, size_t size)
+{
+
+	return offset % kDatasetAlignment == 0 && offset <= size && bytes <= size - offset;
+
+}
+
+} // namespace
+
+
+StepDataset::StepDataset() : mapping(NULL), size(0), header(NULL)
+{
+
+}
+
+StepDataset::~StepDataset()
+{
+
+	if( mapping )
+		munmap(mapping, size);
+
+}
+
+bool StepDataset::Open(const string& path)
+{
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if( fd < 0 ) {
+		LOG(ERROR) << "Can not open dataset " << path;
+		return false;
+	}
+
+	struct stat info;
+	if( fstat(fd, &info) != 0 || info.st_size < sizeof(StepDatasetHeader) ) {
+		LOG(ERROR) << "Can not read dataset " << path;
+		close(fd);
+		return false;
+	}
+
+	size = info.st_size;
+	mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( mapping == MAP_FAILED ) {
+		LOG(ERROR) << "Can not map dataset " << path;
+		mapping = NULL;
+		return false;
+	}
+
+	// training reads the steps in order
+	madvise(mapping, size, MADV_SEQUENTIAL);
+
+	header = static_cast<const StepDatasetHeader*>(mapping);
+
+	if( memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || !NativeByteOrder(header->byte_order) || header->version != kVersion ) {
+		LOG(ERROR) << path << " is not a version " << kVersion << " .nnd dataset of this byte order";
+		return false;
+	}
+
+	uint64_t n = header->count;
+	bool ok = header->state_size > 0 && n < (1ull << 40) && (header->window_length == 0 || n % header->window_length == 0)
+		  && column_fits(header->states, n * header->state_size * sizeof(float), size)
+		  && column_fits(header->labels, n * header->label_size * sizeof(float), size)
+		  && column_fits(header->episodes, n * sizeof(int32_t), size)
+		  && column_fits(header->stamps, n * sizeof(double), size)
+		  && column_fits(header->mean, header->state_size * sizeof(double), size)
+		  && column_fits(header->variance, header->state_size * sizeof(double), size)
+		  && column_fits(header->episode_starts, header->episode_count * sizeof(uint32_t), size);
+
+	if( !ok ) {
+		LOG(ERROR) << "Malformed dataset " << path;
+		return false;
+	}
+
+	return true;
+
+}
+
+
+StepDatasetWriter::StepDatasetWriter() : file(NULL), state_size(0), label_size(0), window_length(0), count_(0)
+{
+
+}
+
+StepDatasetWriter::~StepDatasetWriter()
+{
+
+	Close();
+
+}
+
+bool StepDatasetWriter::Open(const string& dataset_path, int states, int labels_per_step, int window)
+{
+
+	Close();
+
+	path = dataset_path;
+	temporary = path + ".tmp";
+	state_size = states;
+	label_size = labels_per_step;
+	window_length = window;
+	count_ = 0;
+
+	labels.clear();
+	episodes.clear();
+	stamps.clear();
+	episode_starts.clear();
+	mean.assign(state_size, 0);
+	m2.assign(state_size, 0);
+
+	file = fopen(temporary.c_str(), "wb");
+	if( !file )
+		return false;
+
+	// room for the header, written last: the states column follows
+	char placeholder[kDatasetAlignment * 2] = { 0 };
+	if( fwrite(placeholder, 1, align(sizeof(StepDatasetHeader)), file) != align(sizeof(StepDatasetHeader)) ) {
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+
+	return true;
+
+}
+
+bool StepDatasetWriter::Append(const float* state, const float* label, int episode, double stamp)
+{
+
+	if( !file || fwrite(state, sizeof(float), state_size, file) != state_size )
+		return false;
+
+	labels.insert(labels.end(), label, label + label_size);
+
+	if( episodes.empty() || episodes.back() != episode )
+		episode_starts.push_back(count_);
+	episodes.push_back(episode);
+	stamps.push_back(stamp);
+
+	count_++;
+	for(int c = 0; c < state_size; c++) {
+		double delta = state[c] - mean[c];
+		mean[c] += delta / count_;
+		m2[c] += delta * (state[c] - mean[c]);
+	}
+
+	return true;
+
+}
+
+void StepDatasetWriter::Flush()
+{
+
+	if( file )
+		fflush(file);
+
+}
+
+bool StepDatasetWriter::Close()
+{
+
+	if( !file )
+		return false;
+
+	StepDatasetHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.byte_order = kByteOrder;
+	header.version = kVersion;
+	header.state_size = state_size;
+	header.label_size = label_size;
+	header.episode_count = episode_starts.size();
+	header.window_length = window_length;
+	header.count = count_;
+	header.states = align(sizeof(StepDatasetHeader));
+
+	vector<double> variance(state_size, 0);
+	for(int c = 0; c < state_size && count_ > 0; c++)
+		variance[c] = m2[c] / count_;
+
+	bool ok = write_column(file, labels.empty() ? NULL : &labels[0], labels.size() * sizeof(float), &header.labels)
+		  && write_column(file, episodes.empty() ? NULL : &episodes[0], episodes.size() * sizeof(int32_t), &header.episodes)
+		  && write_column(file, stamps.empty() ? NULL : &stamps[0], stamps.size() * sizeof(double), &header.stamps)
+		  && write_column(file, mean.empty() ? NULL : &mean[0], mean.size() * sizeof(double), &header.mean)
+		  && write_column(file, variance.empty() ? NULL : &variance[0], variance.size() * sizeof(double), &header.variance)
+		  && write_column(file, episode_starts.empty() ? NULL : &episode_starts[0],
+				  episode_starts.size() * sizeof(uint32_t), &header.episode_starts)
+		  && fseek(file, 0, SEEK_SET) == 0
+		  && fwrite(&header, sizeof(header), 1, file) == 1;
+
+	ok = fclose(file) == 0 && ok;
+	file = NULL;
+
+	if( !ok || rename(temporary.c_str(), path.c_str()) != 0 ) {
+		LOG(ERROR) << "Can not complete dataset " << path << ", steps left in " << temporary;
+		return false;
+	}
+
+	return true;
+
+}
+
+
+bool IsStepDataset(const string& path)
+{
+
+	char magic[4] = { 0, 0, 0, 0 };
+	FILE* file = fopen(path.c_str(), "rb");
+	if( !file )
+		return false;
+
+	bool dataset = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+	fclose(file);
+	return dataset;
+
+}
+
+
+} // namespace neural_network_planner
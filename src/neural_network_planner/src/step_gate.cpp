@@ -0,0 +1,68 @@
+#include <neural_network_planner/step_gate.h>
+
+#include <cmath>
+
+
+namespace neural_network_planner {
+
+
+namespace {
+
+float distance(const std::pair<float, float>& a, const std::pair<float, float>& b)
+{
+
+	return hypot(b.second - a.second, b.first - a.first);
+
+}
+
+} // namespace
+
+
+StepGate::StepGate(float minimal_step, float pos_update) : minimal_step_distance(minimal_step), pos_update_threshold(pos_update),
+							   current_source(0, 0), prev_source(0, 0), current_target(0, 0),
+							   actual_start(false), goal_received_(false)
+{
+
+}
+
+void StepGate::UpdatePosition(const std::pair<float, float>& position)
+{
+
+	if( distance(current_source, position) > pos_update_threshold )
+		current_source = position;
+
+}
+
+void StepGate::SetTarget(const std::pair<float, float>& target)
+{
+
+	current_target = target;
+	goal_received_ = true;
+
+}
+
+bool StepGate::Tick()
+{
+
+	/* step consistency checking:
+	 * condition 1: actual movement more than the minimal distance
+	 * condition 2: first iteration check is always a false positive
+	 *              odom could remain alive while database node can
+	 *              restart - meaning the first callback will update
+	 *              a position always distant from initial zero values
+	 */
+	bool moved = distance(prev_source, current_source) > minimal_step_distance;
+	bool due = moved && actual_start && goal_received_;
+
+	if( !due && moved )
+		actual_start = true;
+	else if( !due && distance(current_source, current_target) <= minimal_step_distance ) // target reached within the minimal step range
+		goal_received_ = false;
+
+	prev_source = current_source;
+	return due;
+
+}
+
+
+} // namespace neural_network_planner
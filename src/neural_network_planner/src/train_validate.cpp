@@ -2,8 +2,12 @@
 
 // ROS related
 #include <neural_network_planner/train_validate.h>
+#include <neural_network_planner/input_normalization.h>
+#include <neural_network_planner/step_data_layer.h>
+#include <neural_network_planner/mapped_data_layer.h>
 
 // caffe related
+#include "caffe/util/upgrade_proto.hpp"
 
 #include "glog/logging.h"
 
@@ -19,11 +23,28 @@ using std::cout;
 using std::endl;
 using std::cin;
 using std::string;
+using std::vector;
 
 using boost::lexical_cast;
 
 namespace neural_network_planner {
 
+	namespace {
+
+	// clip blob produced by a data layer (StepData, MappedData) from the recorded episodes, not an Input
+	bool clip_from_data(caffe::Net<float>* net, caffe::Blob<float>* clip)
+	{
+
+		for(int i = 0; i < net->layers().size(); i++)
+			for(int j = 0; j < net->top_vecs()[i].size(); j++)
+				if( net->top_vecs()[i][j] == clip )
+					return string(net->layers()[i]->type()) != "Input";
+		return false;
+
+	}
+
+	} // namespace
+
 	TrainValidateRNN::TrainValidateRNN(string& process_name) : private_nh("~")
 	{
 		
@@ -40,6 +61,8 @@ namespace neural_network_planner {
 		private_nh.param("folder_path", folder_path, std::string(""));
 		private_nh.param("averaged_ranges_size", averaged_ranges_size, 22 );
 		private_nh.param("validation_test_frequency", val_freq, 2 );
+		private_nh.param("input_normalization", input_normalization, false );
+		private_nh.param("normalization_samples", normalization_samples, 0 );
 
 		if (GPU) {
 	    		caffe::Caffe::set_mode(caffe::Caffe::GPU);
@@ -54,6 +77,31 @@ namespace neural_network_planner {
 		LOG(INFO) << "Parsing solver config " << solver_conf;
 		caffe::SolverParameter solver_param;
 		caffe::ReadProtoFromTextFileOrDie(solver_conf, &solver_param);
+
+		// normalization layer added to the train and test nets of the solver, snapshots carry it
+		caffe::NetParameter train_param;
+		if( input_normalization ) {
+
+			CHECK(solver_param.has_net() && solver_param.test_net_size() == 1)
+				<< "input normalization: solver must name the net and one test_net prototxt";
+
+			caffe::NetParameter test_param;
+			caffe::ReadNetParamsFromTextFileOrDie(solver_param.net(), &train_param);
+			caffe::ReadNetParamsFromTextFileOrDie(solver_param.test_net(0), &test_param);
+
+			CHECK(AddInputNormalization(&train_param)) << "input normalization: no data blob or already normalized in " << solver_param.net();
+			CHECK(AddInputNormalization(&test_param)) << "input normalization: no data blob or already normalized in " << solver_param.test_net(0);
+
+			solver_param.clear_net();
+			solver_param.mutable_net_param()->CopyFrom(train_param);
+			solver_param.clear_test_net();
+			solver_param.add_test_net_param()->CopyFrom(test_param);
+		}
+
+		// nets may read the unified steps database or the columnar dataset of BuildDatabase
+		RegisterStepDataLayer();
+		RegisterMappedDataLayer();
+
 		solver.reset(caffe::SolverRegistry<float>::CreateSolver(solver_param));	
 
 		net = solver->net();
@@ -118,6 +166,23 @@ namespace neural_network_planner {
 			LOG(INFO) << "Selected start a new training";
 		}
 
+		// resumed weights already normalized keep their statistics
+		if( input_normalization && !HasInputNormalization(net.get()) ) {
+
+			string source, backend;
+			CHECK(TrainingDatabase(train_param, &source, &backend)) << "input normalization: data is not read from a database";
+
+			vector<double> mean, variance;
+			long samples = normalization_samples > 0 ? normalization_samples : train_set_size;
+			samples = InputStatistics(source, backend, state_sequence_size, samples, &mean, &variance);
+			CHECK_GT(samples, 0) << "input normalization: no state in " << source;
+			CHECK(SetInputNormalization(net.get(), mean, variance)) << "input normalization: unexpected input_norm layer";
+
+			LOG(INFO) << "Input statistics of " << samples << " states of " << source;
+			for(int c = 0; c < state_sequence_size; c++)
+				LOG(INFO) << "   channel " << c << " mean " << mean[c] << " std " << sqrt(variance[c]);
+		}
+
 		
 		time_t now = time(0);
 		tm *local = localtime(&now);
@@ -166,10 +231,14 @@ namespace neural_network_planner {
            * by chosing a constant time sequence here in this implementation
            * clip blobs values are always the same 
            * this operation is done only here one time for all
+           * nets reading episodes (StepData, MappedData) get their clip from the data layer
            */
 
+		bool constant_clip = !clip_from_data(net.get(), blobClip.get());
+		bool test_constant_clip = !clip_from_data(test_net.get(), test_blobClip.get());
+
 		// populate training clip blob 
-		for(int i = 0; i < train_batch_size; i++) {
+		for(int i = 0; i < train_batch_size && constant_clip; i++) {
 
 			if( i % state_sequence_size == 0 ) {
 				blobClip->mutable_cpu_data()[i] = 0;
@@ -180,7 +249,7 @@ namespace neural_network_planner {
 		}
 	
 		// populate validating clip blob 
-		for(int i = 0; i < validate_batch_size; i++) {
+		for(int i = 0; i < validate_batch_size && test_constant_clip; i++) {
 
 			if( i % state_sequence_size == 0 ) {
 				test_blobClip->mutable_cpu_data()[i] = 0;